@@ -0,0 +1,82 @@
+#include "atlas.h"
+
+#include <algorithm>
+
+// Empty space around every sprite, so filtering never bleeds neighbours in.
+static const int PAD = 1;
+
+void Atlas::clear()
+{
+    for (SDL_Surface* s : m_surfs)
+        SDL_FreeSurface(s);
+    m_surfs.clear();
+    m_rects.clear();
+    if (m_tex)
+        SDL_DestroyTexture(m_tex);
+    m_tex = nullptr;
+}
+
+int Atlas::add(SDL_Surface* surf)
+{
+    if (!surf)
+        return -1;
+    m_surfs.push_back(surf);
+    m_rects.push_back(SDL_Rect{ 0, 0, surf->w, surf->h });
+    return int(m_surfs.size()) - 1;
+}
+
+bool Atlas::build(SDL_Renderer* renderer)
+{
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) != 0)
+        return false;
+    int max_w = info.max_texture_width > 0 ? info.max_texture_width : 4096;
+
+    // Shelf packing, tallest first: fill rows left to right, start a new row when full.
+    std::vector<int> order(m_surfs.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = int(i);
+    std::sort(order.begin(), order.end(), [this](int a, int b){ return m_rects[a].h > m_rects[b].h; });
+
+    int width = 1024;
+    for (const SDL_Rect& r : m_rects)
+        width = std::max(width, r.w + 2*PAD);
+    width = std::min(width, max_w);
+
+    int x = 0, y = 0, shelf = 0;
+    for (int i : order) {
+        SDL_Rect& r = m_rects[i];
+        if (x + r.w + 2*PAD > width) {
+            x = 0;
+            y += shelf;
+            shelf = 0;
+        }
+        r.x = x + PAD;
+        r.y = y + PAD;
+        x += r.w + 2*PAD;
+        shelf = std::max(shelf, r.h + 2*PAD);
+    }
+    int height = 1;
+    while (height < y + shelf)
+        height *= 2;
+
+    SDL_Surface* sheet = SDL_CreateRGBSurface(0, width, height, 32, 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000);
+    if (!sheet)
+        return false;
+    SDL_FillRect(sheet, NULL, 0);
+    for (size_t i = 0; i < m_surfs.size(); ++i) {
+        // Copy alpha as-is instead of blending onto the (transparent) sheet.
+        SDL_SetSurfaceBlendMode(m_surfs[i], SDL_BLENDMODE_NONE);
+        SDL_Rect dst = m_rects[i];
+        SDL_BlitSurface(m_surfs[i], NULL, sheet, &dst);
+    }
+
+    if (m_tex)
+        SDL_DestroyTexture(m_tex);
+    m_tex = SDL_CreateTextureFromSurface(renderer, sheet);
+    SDL_FreeSurface(sheet);
+    if (!m_tex)
+        return false;
+    SDL_SetTextureBlendMode(m_tex, SDL_BLENDMODE_BLEND);
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL.h>
+
+// Packs all our little images (texts, Mr.Point, ...) into a single texture at
+// startup, so a whole frame can be drawn from it in one `SpriteBatch` and we
+// never need to ask the driver for a texture's size again.
+class Atlas {
+public:
+    Atlas() : m_tex(nullptr) {}
+    ~Atlas() { clear(); }
+
+    // Frees everything, which has to happen before the renderer goes.
+    void clear();
+
+    // Takes ownership of `surf`. Returns the sprite's id, or -1 if `surf` is null.
+    int add(SDL_Surface* surf);
+
+    // Packs everything added so far into one texture. Adding more afterwards
+    // needs another `build`.
+    bool build(SDL_Renderer* renderer);
+
+    SDL_Texture* texture() const { return m_tex; }
+    // Where sprite `id` is in the texture, and thus also its size.
+    const SDL_Rect& rect(int id) const { return m_rects[id]; }
+
+private:
+    Atlas(const Atlas&);
+    Atlas& operator=(const Atlas&);
+
+    SDL_Texture* m_tex;
+    std::vector<SDL_Surface*> m_surfs;
+    std::vector<SDL_Rect> m_rects;
+};
@@ -0,0 +1,1081 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "atlas.h"
+#include "blink.h"
+#include "choreography.h"
+#include "colormap.h"
+#include "convert.h"
+#include "depthfilter.h"
+#include "headpose.h"
+#include "pointcloud.h"
+#include "pupil.h"
+#include "quality.h"
+#include "registration.h"
+#include "sharpness.h"
+#include "simd.h"
+#include "spritebatch.h"
+#include "stimuli.h"
+#include "timing.h"
+#include "trajectory.h"
+
+// Keeps the optimizer from throwing away what we're measuring.
+static volatile double g_sink;
+
+// Runs `f` `n` times and reports the time per item, `f` processing `items` items per call.
+// Per item is in nanoseconds, or in microseconds for whole frames (`items` being 0).
+template<typename F>
+static double timeit(const char* what, int n, size_t items, F f)
+{
+    f();  // Warm-up.
+    Uint64 t0 = host_us();
+    for (int i = 0; i < n; ++i)
+        f();
+    double us = double(host_us() - t0) / (double(n) * (items ? items : 1));
+    if (items)
+        std::cout << "  " << what << ": " << 1000.0 * us << " ns" << std::endl;
+    else
+        std::cout << "  " << what << ": " << us << " us" << std::endl;
+    return us;
+}
+
+// The choreography as it used to be written in `main`, kept as the reference.
+static bool choreography_ifelse(double t, double& x, double& y)
+{
+    if (0 <= t && t < 3) { x = lerp(t, 0.01, 0.99, 0, 3); }
+    else if (3 <= t && t < 5) { y = lerp(t, 0.01, 0.99, 3, 5); }
+    else if (5 <= t && t < 8) { x = lerp(t, 0.99, 0.01, 5, 8); }
+    else if (8 <= t && t < 10) { y = lerp(t, 0.99, 0.01, 8, 10); }
+    else if (10 <= t && t < 14) { x = lerp(t, 0.01, 0.99, 10, 14); }
+    else if (14 <= t && t < 15) { x = lerp(t, 0.99, 0.01, 14, 15); y = lerp(t, 0.01, 0.20, 14, 15); }
+    else if (15 <= t && t < 19) { x = lerp(t, 0.01, 0.99, 15, 19); }
+    else if (19 <= t && t < 20) { x = lerp(t, 0.99, 0.01, 19, 20); y = lerp(t, 0.20, 0.40, 19, 20); }
+    else if (20 <= t && t < 24) { x = lerp(t, 0.01, 0.99, 20, 24); }
+    else if (24 <= t && t < 25) { x = lerp(t, 0.99, 0.01, 24, 25); y = lerp(t, 0.40, 0.60, 24, 25); }
+    else if (25 <= t && t < 29) { x = lerp(t, 0.01, 0.99, 25, 29); }
+    else if (29 <= t && t < 30) { x = lerp(t, 0.99, 0.01, 29, 30); y = lerp(t, 0.60, 0.80, 29, 30); }
+    else if (30 <= t && t < 34) { x = lerp(t, 0.01, 0.99, 30, 34); }
+    else if (34 <= t && t < 35) { x = lerp(t, 0.99, 0.01, 34, 35); y = lerp(t, 0.80, 0.99, 34, 35); }
+    else if (35 <= t && t < 39) { x = lerp(t, 0.01, 0.99, 35, 39); }
+    else if (39 <= t && t < 40) { x = lerp(t, 0.99, 0.01, 39, 40); y = lerp(t, 0.99, 0.01, 39, 40); }
+    else if (40 <= t && t < 44) { y = lerp(t, 0.01, 0.99, 40, 44); }
+    else if (44 <= t && t < 45) { x = lerp(t, 0.01, 0.20, 44, 45); y = lerp(t, 0.99, 0.01, 44, 45); }
+    else if (45 <= t && t < 49) { y = lerp(t, 0.01, 0.99, 45, 49); }
+    else if (49 <= t && t < 50) { x = lerp(t, 0.20, 0.40, 49, 50); y = lerp(t, 0.99, 0.01, 49, 50); }
+    else if (50 <= t && t < 54) { y = lerp(t, 0.01, 0.99, 50, 54); }
+    else if (54 <= t && t < 55) { x = lerp(t, 0.40, 0.60, 54, 55); y = lerp(t, 0.99, 0.01, 54, 55); }
+    else if (55 <= t && t < 59) { y = lerp(t, 0.01, 0.99, 55, 59); }
+    else if (59 <= t && t < 60) { x = lerp(t, 0.60, 0.80, 59, 60); y = lerp(t, 0.99, 0.01, 59, 60); }
+    else if (60 <= t && t < 64) { y = lerp(t, 0.01, 0.99, 60, 64); }
+    else if (64 <= t && t < 65) { x = lerp(t, 0.80, 0.99, 64, 65); y = lerp(t, 0.99, 0.01, 64, 65); }
+    else if (65 <= t && t < 69) { y = lerp(t, 0.01, 0.99, 65, 69); }
+    else if (69 <= t && t < 70) { x = lerp(t, 0.99, 0.01, 69, 70); y = lerp(t, 0.99, 0.01, 69, 70); }
+    else return false;
+    return true;
+}
+
+// The same tables, but as if loaded from a file at runtime.
+static bool choreography_runtime(const std::vector<Keyframe>& k, double t, Point& p)
+{
+    if (!(k.front().t <= t && t < k.back().t))
+        return false;
+    std::vector<Keyframe>::const_iterator it = std::upper_bound(k.begin(), k.end(), t,
+        [](double t, const Keyframe& kf){ return t < kf.t; });
+    const Keyframe& a = *(it - 1);
+    const Keyframe& b = *it;
+    p.x = lerp(t, a.x, b.x, a.t, b.t);
+    p.y = lerp(t, a.y, b.y, a.t, b.t);
+    return true;
+}
+
+// The standard choreography's tables back to back, as `choreography_runtime` wants them.
+static std::vector<Keyframe> standard_keyframes()
+{
+    std::vector<Keyframe> loaded;
+    for (const Keyframe& k : BORDER_SWEEP) loaded.push_back(k);
+    double offset = BORDER_SWEEP_END;
+    for (const Keyframe& k : HORIZONTAL_ZIGZAG) if (k.t > 0) loaded.push_back({ k.t + offset, k.x, k.y });
+    offset = HORIZONTAL_ZIGZAG_END;
+    for (const Keyframe& k : VERTICAL_ZIGZAG) if (k.t > 0) loaded.push_back({ k.t + offset, k.x, k.y });
+    return loaded;
+}
+
+static int bench_choreography()
+{
+    std::cout << "choreography (per lookup):" << std::endl;
+
+    std::vector<Keyframe> loaded = standard_keyframes();
+    Trajectory linear = standard_trajectory(SHAPE_LINEAR);
+
+    // Frame times as they'd come from a 60 Hz render loop.
+    std::vector<double> ts;
+    for (double t = 0; t < STANDARD_DURATION; t += 1.0/60.0)
+        ts.push_back(t);
+
+    // All three have to agree before we bother timing them. The if/else chain
+    // only updates the coordinates a segment moves, so right after a corner the
+    // other one is a frame stale; hence the tolerance of a frame's movement.
+    double x = 0.01, y = 0.01;
+    for (double t : ts) {
+        Point p = { 0, 0 }, q = { 0, 0 };
+        choreography_ifelse(t, x, y);
+        linear.at(t, p);
+        choreography_runtime(loaded, t, q);
+        const double tol = 0.02;
+        if (std::abs(p.x - x) > tol || std::abs(p.y - y) > tol || std::abs(q.x - p.x) > 1e-6 || std::abs(q.y - p.y) > 1e-6) {
+            std::cerr << "Mismatch at t=" << t << ": if/else (" << x << "," << y << "), linear trajectory ("
+                      << p.x << "," << p.y << "), runtime (" << q.x << "," << q.y << ")" << std::endl;
+            return 1;
+        }
+    }
+
+    const int reps = 2000;
+    timeit("if/else chain", reps, ts.size(), [&]{
+        double x = 0.01, y = 0.01;
+        for (double t : ts) { choreography_ifelse(t, x, y); g_sink = x + y; }
+    });
+    timeit("linear trajectory", reps, ts.size(), [&]{
+        Point p = { 0, 0 };
+        for (double t : ts) { linear.at(t, p); g_sink = p.x + p.y; }
+    });
+    timeit("runtime table", reps, ts.size(), [&]{
+        Point p = { 0, 0 };
+        for (double t : ts) { choreography_runtime(loaded, t, p); g_sink = p.x + p.y; }
+    });
+    return 0;
+}
+
+static int bench_trajectory()
+{
+    std::cout << "trajectory (per lookup):" << std::endl;
+
+    std::vector<double> ts;
+    for (double t = 0; t < STANDARD_DURATION; t += 1.0/60.0)
+        ts.push_back(t);
+
+    // The linear shape has to be exactly what the keyframe tables say.
+    std::vector<Keyframe> loaded = standard_keyframes();
+    Trajectory linear = standard_trajectory(SHAPE_LINEAR);
+    for (double t : ts) {
+        Point p = { 0, 0 }, q = { 0, 0 };
+        choreography_runtime(loaded, t, p);
+        linear.at(t, q);
+        if (std::abs(p.x - q.x) > 1e-6 || std::abs(p.y - q.y) > 1e-6) {
+            std::cerr << "Mismatch at t=" << t << ": lerp (" << p.x << "," << p.y
+                      << "), linear trajectory (" << q.x << "," << q.y << ")" << std::endl;
+            return 1;
+        }
+    }
+
+    // The smooth shapes mustn't leave the keyframes' area, nor change velocity
+    // abruptly anywhere, table ends included. The lookup tables' steps change it
+    // by up to about 0.02 per ms, a corner of the lerp by 0.25 or more.
+    Shape smooth[] = { SHAPE_MIN_JERK, SHAPE_CATMULL_ROM };
+    for (Shape shape : smooth) {
+        Trajectory traj = standard_trajectory(shape);
+        const double dt = 0.001;
+        Point prev = { 0, 0 }, p = { 0, 0 };
+        double vx = 0.0, vy = 0.0, max_dv = 0.0;
+        for (int i = 0; traj.at(i * dt, p); ++i) {
+            if (p.x < 0.01 - 1e-9 || p.x > 0.99 + 1e-9 || p.y < 0.01 - 1e-9 || p.y > 0.99 + 1e-9) {
+                std::cerr << shape_name(shape) << " leaves the keyframes' area at t=" << i * dt
+                          << ": (" << p.x << "," << p.y << ")" << std::endl;
+                return 1;
+            }
+            if (i > 0) {
+                double wx = (p.x - prev.x) / dt, wy = (p.y - prev.y) / dt;
+                if (i > 1)
+                    max_dv = std::max(max_dv, std::hypot(wx - vx, wy - vy));
+                vx = wx;
+                vy = wy;
+            }
+            prev = p;
+        }
+        std::cout << "  " << shape_name(shape) << ": largest velocity change per ms " << max_dv << std::endl;
+        if (max_dv > 0.05) {
+            std::cerr << shape_name(shape) << " changes velocity abruptly!" << std::endl;
+            return 1;
+        }
+    }
+
+    // Through keyframes it doesn't have to turn at, the spline keeps going.
+    static const Keyframe ARC[] = { { 0, 0.1, 0.5 }, { 1, 0.5, 0.2 }, { 2, 0.9, 0.5 } };
+    Trajectory arc;
+    arc.append(ARC, SHAPE_CATMULL_ROM);
+    Point before = { 0, 0 }, after = { 0, 0 };
+    arc.at(0.999, before);
+    arc.at(1.001, after);
+    if (std::hypot(after.x - before.x, after.y - before.y) / 0.002 < 0.2) {
+        std::cerr << "catmullrom stops where it doesn't have to!" << std::endl;
+        return 1;
+    }
+
+    // In the standard choreography, it only comes to rest where a table starts or
+    // ends, and its curves around the keyframes reach all the way to the border.
+    Trajectory spline = standard_trajectory(SHAPE_CATMULL_ROM);
+    const Keyframe* tables[] = { BORDER_SWEEP, HORIZONTAL_ZIGZAG, VERTICAL_ZIGZAG };
+    const size_t sizes[] = { sizeof(BORDER_SWEEP) / sizeof(Keyframe), sizeof(HORIZONTAL_ZIGZAG) / sizeof(Keyframe),
+                             sizeof(VERTICAL_ZIGZAG) / sizeof(Keyframe) };
+    double table_t0 = 0.0;
+    for (int j = 0; j < 3; ++j) {
+        for (size_t i = 1; i + 1 < sizes[j]; ++i) {
+            double t = table_t0 + tables[j][i].t;
+            spline.at(t - 0.001, before);
+            spline.at(t + 0.001, after);
+            if (std::hypot(after.x - before.x, after.y - before.y) / 0.002 < 0.02) {
+                std::cerr << "catmullrom comes to rest at t=" << t << "!" << std::endl;
+                return 1;
+            }
+        }
+        table_t0 += tables[j][sizes[j] - 1].t;
+    }
+    Point lo = { 1, 1 }, hi = { 0, 0 }, p = { 0, 0 };
+    for (int i = 0; spline.at(i * 0.001, p); ++i) {
+        lo.x = std::min(lo.x, p.x); lo.y = std::min(lo.y, p.y);
+        hi.x = std::max(hi.x, p.x); hi.y = std::max(hi.y, p.y);
+    }
+    if (lo.x > 0.011 || lo.y > 0.011 || hi.x < 0.989 || hi.y < 0.989) {
+        std::cerr << "catmullrom doesn't reach the border: (" << lo.x << "," << lo.y << ") to ("
+                  << hi.x << "," << hi.y << ")" << std::endl;
+        return 1;
+    }
+
+    // A Bezier segment starts and ends at its endpoints, and bends towards its
+    // control points: it passes its midpoint at u = 1/2, far off the straight line.
+    Trajectory curve;
+    const Point b0 = { 0.2, 0.8 }, b1 = { 0.2, 0.1 }, b2 = { 0.9, 0.1 }, b3 = { 0.9, 0.8 };
+    curve.append_bezier(b0, b1, b2, b3, 2.0, Trajectory::EASE_MIN_JERK);
+    curve.append_bezier(b3, Point{ 0.9, 0.9 }, Point{ 0.5, 0.9 }, Point{ 0.5, 0.5 }, 1.0, Trajectory::EASE_LINEAR);
+    const Point mid = { (b0.x + 3*b1.x + 3*b2.x + b3.x) / 8, (b0.y + 3*b1.y + 3*b2.y + b3.y) / 8 };
+    Point start = { 0, 0 }, end = { 0, 0 }, join = { 0, 0 }, last = { 0, 0 }, q = { 0, 0 };
+    double closest = 1.0;
+    for (int i = 0; curve.at(i * 0.0005, q) && i * 0.0005 < 2.0; ++i)
+        closest = std::min(closest, std::hypot(q.x - mid.x, q.y - mid.y));
+    curve.at(0.0, start);
+    curve.at(2.0 - 1e-9, end);
+    curve.at(2.0, join);
+    curve.at(curve.duration() - 1e-9, last);
+    if (std::hypot(start.x - b0.x, start.y - b0.y) > 1e-6 || std::hypot(end.x - b3.x, end.y - b3.y) > 1e-6 ||
+        std::hypot(join.x - b3.x, join.y - b3.y) > 1e-6 || std::hypot(last.x - 0.5, last.y - 0.5) > 1e-6) {
+        std::cerr << "Bezier segments don't start and end at their endpoints!" << std::endl;
+        return 1;
+    }
+    if (closest > 0.002) {
+        std::cerr << "The Bezier segment misses its midpoint by " << closest << "!" << std::endl;
+        return 1;
+    }
+
+    const int reps = 2000;
+
+    Shape shapes[] = { SHAPE_LINEAR, SHAPE_MIN_JERK, SHAPE_CATMULL_ROM };
+    for (Shape shape : shapes) {
+        Trajectory traj = standard_trajectory(shape);
+        std::string what = std::string(shape_name(shape)) + " trajectory";
+        timeit(what.c_str(), reps, ts.size(), [&]{
+            Point p = { 0, 0 };
+            for (double t : ts) { traj.at(t, p); g_sink = p.x + p.y; }
+        });
+
+        std::vector<double> x(ts.size()), y(ts.size());
+        traj.at_batch(ts.data(), ts.size(), x.data(), y.data());
+        for (size_t i = 0; i < ts.size(); ++i) {
+            Point p = { 0, 0 };
+            traj.at(ts[i], p);
+            if (p.x != x[i] || p.y != y[i]) {
+                std::cerr << "Mismatch at t=" << ts[i] << ": lookup (" << p.x << "," << p.y
+                          << "), batch (" << x[i] << "," << y[i] << ")" << std::endl;
+                return 1;
+            }
+        }
+        what += ", batch";
+        timeit(what.c_str(), reps, ts.size(), [&]{
+            traj.at_batch(ts.data(), ts.size(), x.data(), y.data());
+            g_sink = x.back() + y.back();
+        });
+    }
+    return 0;
+}
+
+// A depth frame which looks somewhat like a person in front of a wall, with holes.
+static std::vector<Uint16> fake_depth(int w, int h)
+{
+    std::vector<Uint16> d(w*h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            double dx = (x - w/2) / double(w), dy = (y - h/2) / double(h);
+            Uint16 v = dx*dx + dy*dy < 0.04 ? Uint16(500 + 2000*(dx*dx + dy*dy)) : Uint16(1800 + y);
+            d[y*w + x] = (x*7 + y*13) % 31 == 0 ? 0 : v;
+        }
+    }
+    return d;
+}
+
+static int bench_colormap()
+{
+    std::cout << "depth colormap, 640x480 (per frame):" << std::endl;
+
+    const int w = 640, h = 480;
+    std::vector<Uint16> depth = fake_depth(w, h);
+    depth[0] = 65535;  // The extremes have to survive, too.
+    depth[1] = 1;
+    DepthColormap cm;
+    cm.init(300, 1500);
+
+    std::vector<Uint32> ref(w*h), out(w*h);
+    colormap_depth_scalar(cm, depth.data(), ref.data(), ref.size());
+
+    struct { const char* name; void (*fn)(const DepthColormap&, const Uint16*, Uint32*, size_t); } kernels[] = {
+        { "scalar", colormap_depth_scalar },
+        { "sse2", colormap_depth_sse2 },
+        { "avx2", colormap_depth_avx2 },
+    };
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::fill(out.begin(), out.end(), 0);
+        k.fn(cm, depth.data(), out.data(), out.size());
+        if (out != ref) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        timeit(k.name, 200, 0, [&]{ k.fn(cm, depth.data(), out.data(), out.size()); });
+    }
+    return 0;
+}
+
+static int bench_pointcloud()
+{
+    std::cout << "depth -> point cloud, 640x480 (per frame):" << std::endl;
+
+    const int w = 640, h = 480;
+    std::vector<Uint16> depth = fake_depth(w, h);
+    depth[0] = 65535;
+    Intrinsics in = { w, h, 475.0f, 475.0f, 320.0f, 240.0f, { 0.1f, -0.05f, 0.0f }, { 0.001f, -0.001f } };
+
+    Uint64 t0 = host_us();
+    RayTable rays;
+    rays.init(in);
+    std::cout << "  ray table: " << (host_us() - t0) << " us, once per profile" << std::endl;
+
+    size_t n = size_t(w) * h;
+    std::vector<float> rx(n), ry(n), rz(n), x(n), y(n), z(n);
+    deproject_scalar(rays.x.data(), rays.y.data(), depth.data(), rx.data(), ry.data(), rz.data(), n);
+
+    struct { const char* name; void (*fn)(const float*, const float*, const Uint16*, float*, float*, float*, size_t); } kernels[] = {
+        { "scalar", deproject_scalar },
+        { "sse2", deproject_sse2 },
+        { "avx2", deproject_avx2 },
+        { "neon", deproject_neon },
+    };
+    for (auto& k : kernels) {
+        if ((std::string(k.name) == "avx2" && !cpu_has_avx2())
+#ifndef HAVE_NEON
+            || std::string(k.name) == "neon"
+#endif
+            ) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::fill(z.begin(), z.end(), 0.0f);
+        k.fn(rays.x.data(), rays.y.data(), depth.data(), x.data(), y.data(), z.data(), n);
+        // Same operations in the same order, so they have to agree exactly.
+        if (x != rx || y != ry || z != rz) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        timeit(k.name, 200, 0, [&]{ k.fn(rays.x.data(), rays.y.data(), depth.data(), x.data(), y.data(), z.data(), n); });
+    }
+    return 0;
+}
+
+static int bench_registration()
+{
+    std::cout << "depth -> color registration, 640x480 (per frame):" << std::endl;
+
+    // Roughly an SR300: the color camera is a bit narrower and sits 2.5cm to the side.
+    const int w = 640, h = 480;
+    std::vector<Uint16> depth = fake_depth(w, h);
+    depth[0] = 65535;
+    Intrinsics di = { w, h, 475.0f, 475.0f, 320.0f, 240.0f, { 0.1f, -0.05f, 0.0f }, { 0.001f, -0.001f } };
+    Intrinsics ci = { w, h, 615.0f, 615.0f, 318.0f, 242.0f, { 0.05f, -0.1f, 0.02f }, { 0.0f, 0.0f } };
+    Extrinsics e = { { 1.0f, 0.0f, 0.002f,  0.0f, 1.0f, 0.0f,  -0.002f, 0.0f, 1.0f }, { 0.025f, 0.0f, 0.001f } };
+
+    Uint64 t0 = host_us();
+    RegistrationTable table;
+    table.init(di, ci, e);
+    std::cout << "  table: " << (host_us() - t0) << " us, once per profile" << std::endl;
+
+    size_t n = size_t(w) * h;
+    std::vector<Sint32> ref_target(n), target(n);
+    std::vector<Uint16> ref_z(n), z(n), aligned(n);
+    project_depth_scalar(table, depth.data(), ref_target.data(), ref_z.data(), n);
+
+    struct { const char* name; void (*fn)(const RegistrationTable&, const Uint16*, Sint32*, Uint16*, size_t); } kernels[] = {
+        { "scalar", project_depth_scalar },
+        { "sse2", project_depth_sse2 },
+        { "avx2", project_depth_avx2 },
+    };
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::fill(z.begin(), z.end(), 0);
+        k.fn(table, depth.data(), target.data(), z.data(), n);
+        if (target != ref_target || z != ref_z) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        timeit(k.name, 200, 0, [&]{ k.fn(table, depth.data(), target.data(), z.data(), n); });
+    }
+
+    size_t landed = 0, occluded = 0;
+    timeit("z-buffered splat", 200, 0, [&]{
+        std::fill(aligned.begin(), aligned.end(), 0);
+        landed = splat_depth(target.data(), z.data(), n, aligned.data(), occluded);
+    });
+    std::cout << "  " << landed << " of " << n << " pixels landed, " << occluded << " occluded" << std::endl;
+    return 0;
+}
+
+static int bench_quality()
+{
+    std::cout << "depth quality statistics, 640x480 (per frame):" << std::endl;
+
+    const int w = 640, h = 480;
+    std::vector<Uint16> depth = fake_depth(w, h);
+    depth[0] = 65535;
+    depth[1] = 2047;
+
+    Uint32 ref_hist[DEPTH_BINS] = {}, hist[DEPTH_BINS];
+    depth_histogram_scalar(depth.data(), depth.size(), ref_hist);
+    BlobStats ref_blob, blob;
+    blob_stats_scalar(depth.data(), w, h, 480, 780, ref_blob);
+
+    struct {
+        const char* name;
+        void (*hist)(const Uint16*, size_t, Uint32*);
+        void (*blob)(const Uint16*, int, int, Uint16, Uint16, BlobStats&);
+    } kernels[] = {
+        { "scalar", depth_histogram_scalar, blob_stats_scalar },
+        { "sse2", depth_histogram_sse2, blob_stats_sse2 },
+        { "avx2", depth_histogram_avx2, blob_stats_avx2 },
+    };
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::fill(hist, hist + DEPTH_BINS, 0);
+        k.hist(depth.data(), depth.size(), hist);
+        k.blob(depth.data(), w, h, 480, 780, blob);
+        if (!std::equal(hist, hist + DEPTH_BINS, ref_hist) ||
+            blob.area != ref_blob.area || blob.sum_x != ref_blob.sum_x || blob.sum_y != ref_blob.sum_y) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        std::string what = std::string(k.name) + " histogram";
+        timeit(what.c_str(), 200, 0, [&]{ k.hist(depth.data(), depth.size(), hist); });
+        what = std::string(k.name) + " blob";
+        timeit(what.c_str(), 200, 0, [&]{ k.blob(depth.data(), w, h, 480, 780, blob); });
+    }
+    return 0;
+}
+
+static int bench_depthfilter()
+{
+    std::cout << "depth filter, 640x480 (per frame):" << std::endl;
+
+    // A few noisy frames, so the temporal pass has something to do.
+    const int w = 640, h = 480, frames = 5;
+    size_t n = size_t(w) * h;
+    std::vector<std::vector<Uint16>> depth(frames, fake_depth(w, h));
+    for (int f = 0; f < frames; ++f) {
+        for (size_t i = 0; i < n; ++i) {
+            if (depth[f][i])
+                depth[f][i] = Uint16(depth[f][i] + (i*31 + f*17) % 23 - 11);
+            if ((i*13 + f*7) % 29 == 0)
+                depth[f][i] = 0;
+        }
+    }
+    depth[0][w + 1] = 65535;
+
+    struct {
+        const char* name;
+        void (*spatial)(const Uint16*, Uint16*, int, int);
+        void (*temporal)(const Uint16*, const Uint16*, const Uint16* const*, int, Uint16*, size_t);
+    } kernels[] = {
+        { "scalar", filter_depth_spatial_scalar, filter_depth_temporal_scalar },
+        { "sse2", filter_depth_spatial_sse2, filter_depth_temporal_sse2 },
+        { "avx2", filter_depth_spatial_avx2, filter_depth_temporal_avx2 },
+    };
+    // All frames through the whole filter, the first output being the first spatial pass.
+    auto run = [&](decltype(kernels[0])& k, std::vector<std::vector<Uint16>>& out) {
+        std::vector<std::vector<Uint16>> spatial(frames, std::vector<Uint16>(n));
+        out.assign(frames, std::vector<Uint16>(n));
+        for (int f = 0; f < frames; ++f) {
+            k.spatial(depth[f].data(), spatial[f].data(), w, h);
+            if (f == 0) {
+                out[f] = spatial[f];
+                continue;
+            }
+            const Uint16* ring[4];
+            int ring_n = 0;
+            for (int r = std::max(0, f - 4); r < f; ++r)
+                ring[ring_n++] = spatial[r].data();
+            k.temporal(spatial[f].data(), out[f-1].data(), ring, ring_n, out[f].data(), n);
+        }
+    };
+    std::vector<std::vector<Uint16>> ref, out;
+    run(kernels[0], ref);
+
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        run(k, out);
+        if (out != ref) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        const Uint16* ring[4] = { ref[0].data(), ref[1].data(), ref[2].data(), ref[3].data() };
+        std::string what = std::string(k.name) + " spatial";
+        timeit(what.c_str(), 100, 0, [&]{ k.spatial(depth[1].data(), out[0].data(), w, h); });
+        what = std::string(k.name) + " temporal";
+        timeit(what.c_str(), 100, 0, [&]{ k.temporal(ref[4].data(), ref[3].data(), ring, 4, out[0].data(), n); });
+    }
+    return 0;
+}
+
+static int bench_blink()
+{
+    std::cout << "eye profile, 640x480 BGRA and Y8 (per frame, then per eye region of 130x45):" << std::endl;
+
+    FramePool pool;
+    FramePtr frames[2] = { pool.get(FRAME_BGRA, 640, 480), pool.get(FRAME_Y8, 640, 480) };
+    for (FramePtr& f : frames)
+        for (size_t i = 0; i < f->pixels.size(); ++i)
+            f->pixels[i] = Uint8((i*i*7 + i*13) >> 3);
+
+    struct { const char* name; void (*fn)(const Frame&, int, int, int, int, Uint32*); } kernels[] = {
+        { "scalar", eye_profile_scalar },
+        { "sse2", eye_profile_sse2 },
+        { "avx2", eye_profile_avx2 },
+    };
+    for (FramePtr& f : frames) {
+        // Odd sizes and offsets, so the kernels' leftovers get checked as well.
+        std::vector<Uint32> ref(479), out(479), profile(480);
+        eye_profile_scalar(*f, 3, 1, 637, 479, ref.data());
+        for (auto& k : kernels) {
+            if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+                std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+                continue;
+            }
+            k.fn(*f, 3, 1, 637, 479, out.data());
+            if (out != ref) {
+                std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+                return 1;
+            }
+            std::string what = std::string(k.name) + (f->format == FRAME_Y8 ? " Y8" : " BGRA");
+            timeit(what.c_str(), 200, 0, [&]{ k.fn(*f, 0, 0, 640, 480, profile.data()); });
+            what += " eyes";
+            timeit(what.c_str(), 2000, 0, [&]{ k.fn(*f, 250, 200, 130, 45, profile.data()); });
+        }
+    }
+
+    // Open eyes are a dark band across lighter skin, closed ones a bit of shading.
+    for (FramePtr& f : frames) {
+        int bpp = bytes_per_pixel(f->format);
+        std::vector<Uint32> profile(45);
+        float openness[2];
+        for (int closed = 0; closed < 2; ++closed) {
+            for (int y = 0; y < 45; ++y) {
+                Uint8 v = closed ? Uint8(170 + y/5) : (18 <= y && y < 27 ? 40 : 180);
+                std::memset(f->row<Uint8>(200 + y) + 250*bpp, v, 130*bpp);
+            }
+            eye_profile(*f, 250, 200, 130, 45, profile.data());
+            openness[closed] = eye_openness(profile.data(), 45);
+        }
+        if (openness[0] < 0.5f || openness[1] > 0.1f) {
+            std::cerr << "Eyes open " << openness[0] << " and closed " << openness[1] << " aren't told apart!" << std::endl;
+            return 1;
+        }
+    }
+
+    // At 30 fps: the eyes start out closed during the warmup, then narrow to between
+    // the thresholds, which isn't a blink; the light dims slowly to half the openness,
+    // which the usual openness has to follow; then they blink for frames 130-136,
+    // halfway open in its last frame, and finally stay closed for more than 3 s,
+    // which gets cut off.
+    std::vector<float> seq;
+    auto hold = [&](int frames, float openness){ seq.insert(seq.end(), frames, openness); };
+    hold(5, 0.05f);
+    hold(35, 0.5f);
+    hold(5, 0.35f);
+    hold(15, 0.5f);
+    for (int i = 0; i < 60; ++i)
+        seq.push_back(0.5f - i * 0.25f/60);
+    hold(10, 0.25f);
+    hold(6, 0.02f);
+    hold(1, 0.18f);
+    hold(23, 0.25f);
+    hold(140, 0.02f);
+    hold(30, 0.25f);
+
+    BlinkDetector detector;
+    std::vector<BlinkDetector::Blink> blinks;
+    for (size_t i = 0; i < seq.size(); ++i)
+        if (detector.update(unsigned(i), Sint64(i) * 1000000 / 30, seq[i]))
+            blinks.push_back(detector.last());
+    if (detector.lost())
+        blinks.push_back(detector.last());
+    if (blinks.size() != 2 || blinks[0].cut_off || blinks[0].start_index != 130 || blinks[0].end_index != 136 ||
+        !blinks[1].cut_off || blinks[1].start_index != 160 || detector.blinks() != 1 || detector.cut_off() != 1) {
+        std::cerr << "Expected one blink from frame 130 to 136 and a closure from 160 cut off, got:";
+        for (const BlinkDetector::Blink& b : blinks)
+            std::cerr << " " << b.start_index << "-" << b.end_index << (b.cut_off ? " (cut off)" : "");
+        std::cerr << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int bench_sharpness()
+{
+    std::cout << "sharpness, 640x480 BGRA halved to gray, then the Laplacian over all of it:" << std::endl;
+
+    std::vector<Uint8> bgra(640*480*4);
+    for (size_t i = 0; i < bgra.size(); ++i)
+        bgra[i] = Uint8((i*i*7 + i*13) >> 3);
+
+    struct {
+        const char* name;
+        void (*half)(const Uint8*, int, int, Uint8*);
+        void (*stats)(const Uint8*, int, int, int, int, int, LaplacianStats&);
+    } kernels[] = {
+        { "scalar", gray_half_scalar, laplacian_stats_scalar },
+        { "sse2", gray_half_sse2, laplacian_stats_sse2 },
+        { "avx2", gray_half_avx2, laplacian_stats_avx2 },
+    };
+    // Odd sizes and offsets, so the kernels' leftovers get checked as well.
+    std::vector<Uint8> ref(319*239), gray(320*240);
+    gray_half_scalar(bgra.data(), 638, 478, ref.data());
+    LaplacianStats ref_stats;
+    laplacian_stats_scalar(ref.data(), 319, 1, 2, 315, 235, ref_stats);
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        std::vector<Uint8> out(319*239);
+        k.half(bgra.data(), 638, 478, out.data());
+        LaplacianStats stats;
+        k.stats(out.data(), 319, 1, 2, 315, 235, stats);
+        if (out != ref || stats.n != ref_stats.n || stats.sum != ref_stats.sum || stats.sum_sq != ref_stats.sum_sq) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        std::string what = std::string(k.name) + " halve";
+        timeit(what.c_str(), 500, 0, [&]{ k.half(bgra.data(), 640, 480, gray.data()); });
+        what = std::string(k.name) + " laplacian";
+        timeit(what.c_str(), 2000, 0, [&]{ k.stats(gray.data(), 320, 1, 1, 318, 238, stats); });
+    }
+
+    // A 5x5 box blur of the same image has to score as blurred against it.
+    std::vector<Uint8> blurred(bgra.size());
+    for (int y = 0; y < 480; ++y) {
+        for (int x = 0; x < 640; ++x) {
+            for (int c = 0; c < 4; ++c) {
+                int sum = 0, n = 0;
+                for (int v = std::max(0, y - 2); v <= std::min(479, y + 2); ++v)
+                    for (int u = std::max(0, x - 2); u <= std::min(639, x + 2); ++u, ++n)
+                        sum += bgra[(size_t(v)*640 + u)*4 + c];
+                blurred[(size_t(y)*640 + x)*4 + c] = Uint8(sum / n);
+            }
+        }
+    }
+    LaplacianStats sharp_stats, blurred_stats;
+    gray_half(bgra.data(), 640, 480, gray.data());
+    laplacian_stats(gray.data(), 320, 1, 1, 318, 238, sharp_stats);
+    gray_half(blurred.data(), 640, 480, gray.data());
+    laplacian_stats(gray.data(), 320, 1, 1, 318, 238, blurred_stats);
+if (!(blurred_stats.variance() < SHARPNESS_BLURRED * sharp_stats.variance())) {
+        std::cerr << "  the blurred image scores " << blurred_stats.variance() << " against the sharp one's "
+                  << sharp_stats.variance() << "!" << std::endl;
+        return 1;
+    }
+
+    // The stage also looks for the head in every depth frame: a face-sized oval at
+    // 60 cm in front of a wall.
+    const int w = 640, h = 480;
+    Intrinsics in = { w, h, 475.0f, 475.0f, 320.0f, 240.0f, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } };
+    FramePool pool;
+    FramePtr depth = pool.get(FRAME_DEPTH16, w, h);
+    for (int y = 0; y < h; ++y) {
+        Uint16* row = depth->row<Uint16>(y);
+        for (int x = 0; x < w; ++x) {
+            double dx = (x - 320.0) / 59.0, dy = (y - 240.0) / 83.0;
+            row[x] = dx*dx + dy*dy < 1.0 ? 600 : 1800;
+        }
+    }
+    HeadTracker tracker(in);
+    if (!tracker.update(*depth)) {
+        std::cerr << "  the head wasn't found!" << std::endl;
+        return 1;
+    }
+    timeit("head tracker", 500, 0, [&]{ tracker.update(*depth); });
+    return 0;
+}
+
+static int bench_convert()
+{
+    std::cout << "pixel format conversion, 640x480 (per frame):" << std::endl;
+
+    // Padded pitches, like the SDK's, and all byte values.
+    const int w = 640, h = 480, yuy2_pitch = 2*w + 64, y_pitch = w + 32, bgra_pitch = 4*w;
+    std::vector<Uint8> yuy2(size_t(yuy2_pitch) * h), y(size_t(y_pitch) * h), uv(size_t(y_pitch) * h / 2);
+    std::vector<Uint8>* sources[] = { &yuy2, &y, &uv };
+    for (std::vector<Uint8>* src : sources)
+        for (size_t i = 0; i < src->size(); ++i)
+            (*src)[i] = Uint8((i*i*7 + i*13) >> 3);
+
+    // The scalar kernel against BT.601 itself, over the camera's range: within 1 of it,
+    // and the ends of Y exactly black and white.
+    int worst = 0;
+    for (int yy = 16; yy <= 235; ++yy)
+        for (int u = 16; u <= 240; u += 4)
+            for (int v = 16; v <= 240; v += 4) {
+                Uint8 p[4] = { Uint8(yy), Uint8(u), Uint8(yy), Uint8(v) }, px[8];
+                yuy2_to_bgra_scalar(p, 4, 2, 1, px, 8);
+                double c = 1.164383*(yy - 16), d = u - 128, e = v - 128;
+                double want[3] = { c + 2.017232*d, c - 0.391762*d - 0.812968*e, c + 1.596027*e };
+                for (int k = 0; k < 3; ++k) {
+                    int expect = int(std::floor(std::min(255.0, std::max(0.0, want[k])) + 0.5));
+                    worst = std::max(worst, std::abs(px[k] - expect));
+                }
+                if ((u == 128 && v == 128) && ((yy == 16 && px[1] != 0) || (yy == 235 && px[1] != 255))) {
+                    std::cerr << "  Y " << yy << " isn't " << (yy == 16 ? "black" : "white") << "!" << std::endl;
+                    return 1;
+                }
+            }
+    if (worst > 1) {
+        std::cerr << "  the scalar kernel is off BT.601 by " << worst << "!" << std::endl;
+        return 1;
+    }
+
+    struct {
+        const char* name;
+        void (*yuy2_bgra)(const Uint8*, int, int, int, Uint8*, int);
+        void (*nv12_bgra)(const Uint8*, int, const Uint8*, int, int, int, Uint8*, int);
+    } kernels[] = {
+        { "scalar", yuy2_to_bgra_scalar, nv12_to_bgra_scalar },
+        { "sse2", yuy2_to_bgra_sse2, nv12_to_bgra_sse2 },
+        { "avx2", yuy2_to_bgra_avx2, nv12_to_bgra_avx2 },
+        { "neon", yuy2_to_bgra_neon, nv12_to_bgra_neon },
+    };
+
+    // Checked on a width that isn't a multiple of any kernel's, so the leftovers get checked as well.
+    const int cw = w - 10, ch = h - 2;
+    std::vector<Uint8> ref[2], out(size_t(bgra_pitch) * h);
+    for (std::vector<Uint8>& r : ref)
+        r.assign(out.size(), 0);
+    auto run = [&](decltype(kernels[0])& k, int i, int cw, int ch, Uint8* dst) {
+        if (i == 0)
+            k.yuy2_bgra(yuy2.data(), yuy2_pitch, cw, ch, dst, bgra_pitch);
+        else
+            k.nv12_bgra(y.data(), y_pitch, uv.data(), y_pitch, cw, ch, dst, bgra_pitch);
+    };
+    const char* what[] = { "YUY2 -> BGRA", "NV12 -> BGRA" };
+    for (int i = 0; i < 2; ++i)
+        run(kernels[0], i, cw, ch, ref[i].data());
+
+    for (auto& k : kernels) {
+        if ((std::string(k.name) == "avx2" && !cpu_has_avx2())
+#ifndef HAVE_NEON
+            || std::string(k.name) == "neon"
+#endif
+            ) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        for (int i = 0; i < 2; ++i) {
+            std::fill(out.begin(), out.end(), 0);
+            run(k, i, cw, ch, out.data());
+            if (out != ref[i]) {
+                std::cerr << "  " << k.name << " " << what[i] << " differs from the scalar reference!" << std::endl;
+                return 1;
+            }
+            std::string name = std::string(k.name) + " " + what[i];
+            timeit(name.c_str(), 200, 0, [&]{ run(k, i, w, h, out.data()); });
+        }
+    }
+    return 0;
+}
+
+static int bench_headpose()
+{
+    std::cout << "head pose, 640x480 depth of a flat face turned by 20 degrees, then tilted by 15:" << std::endl;
+
+    // The face as a 15x21 cm oval on the plane z = 600 + k x mm, seen through the
+    // pinhole, in front of a wall, with its outline tilted clockwise by `roll`.
+    const int w = 640, h = 480;
+    Intrinsics in = { w, h, 475.0f, 475.0f, 320.0f, 240.0f, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } };
+    std::vector<Uint16> depth(w*h);
+    auto make_face = [&](double yaw, double roll) {
+        double k = std::tan(yaw / 57.2957795), c = std::cos(roll / 57.2957795), s = std::sin(roll / 57.2957795);
+        for (int y = 0; y < h; ++y) {
+            for (int x = 0; x < w; ++x) {
+                double ix = x - 320.0, iy = y - 240.0;
+                double dx = (ix*c + iy*s) / 59.0, dy = (-ix*s + iy*c) / 83.0;
+                double rx = (x - in.cx) / in.fx;
+                Uint16 d = dx*dx + dy*dy < 1.0 ? Uint16(600.0 / (1.0 - k*rx) + 0.5) : Uint16(1800);
+                depth[y*w + x] = (x*7 + y*13) % 31 == 0 ? 0 : d;
+            }
+        }
+    };
+    make_face(20.0, 0.0);
+
+    struct {
+        const char* name;
+        void (*fn)(const Uint16*, int, const SDL_Rect&, const DepthPlane&, int, FaceMoments&);
+    } kernels[] = {
+        { "scalar", face_moments_scalar },
+        { "sse2", face_moments_sse2 },
+        { "avx2", face_moments_avx2 },
+    };
+    // A tilted gate and an odd region, so the kernels' leftovers get checked as well.
+    SDL_Rect region = { 231, 130, 187, 221 };
+    DepthPlane gate = { 0.3f, -0.1f, 560.0f };
+    FaceMoments ref;
+    face_moments_scalar(depth.data(), w, region, gate, 50, ref);
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        FaceMoments m;
+        k.fn(depth.data(), w, region, gate, 50, m);
+        if (m.n != ref.n || m.su != ref.su || m.sv != ref.sv || m.sz != ref.sz || m.suu != ref.suu ||
+            m.suv != ref.suv || m.suz != ref.suz || m.svv != ref.svv || m.svz != ref.svz || m.szz != ref.szz) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        std::string what = std::string(k.name) + " moments";
+        timeit(what.c_str(), 2000, 0, [&]{ k.fn(depth.data(), w, region, gate, 50, m); });
+    }
+
+    FramePool pool;
+    FramePtr f = pool.get(FRAME_DEPTH16, w, h);
+    HeadPose pose;
+    const double poses[][2] = { { 20.0, 0.0 }, { 0.0, 15.0 }, { -10.0, -15.0 } };
+    for (auto& p : poses) {
+        make_face(p[0], p[1]);
+        std::copy(depth.begin(), depth.end(), f->row<Uint16>(0));
+        HeadPoseEstimator estimator(in);
+        for (int i = 0; i < 5; ++i) {
+            if (!estimator.update(*f, pose)) {
+                std::cerr << "  the face wasn't found!" << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "  yaw " << pose.yaw << ", pitch " << pose.pitch << ", roll " << pose.roll
+                  << ", confidence " << pose.confidence << " (should be " << p[0] << ", 0, " << p[1] << ")" << std::endl;
+        if (std::fabs(pose.yaw - p[0]) > 2.0 || std::fabs(pose.pitch) > 2.0 || std::fabs(pose.roll - p[1]) > 2.0) {
+            std::cerr << "  that's not the face's pose!" << std::endl;
+            return 1;
+        }
+        if (p[1] == 0.0) {
+            timeit("whole frame", 500, 0, [&]{ estimator.update(*f, pose); });
+        }
+    }
+    return 0;
+}
+
+static int bench_pupil()
+{
+    std::cout << "pupil, 640x480 infrared of a dark ellipse in a noisy eye region of 60x40:" << std::endl;
+
+    // A pupil of 5x4 px diameters, off the pixel grid, in front of a lighter iris,
+    // with lashes touching the region's top.
+    const int w = 640, h = 480;
+    const double px = 321.37, py = 241.81;
+    FramePool pool;
+    FramePtr f = pool.get(FRAME_Y8, w, h);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            double dx = (x - px) / 2.5, dy = (y - py) / 2.0;
+            double r2 = dx*dx + dy*dy;
+            int v = r2 < 1.0 ? 20 : r2 < 9.0 ? 90 : 160;
+            if (y < 225 && (x % 9) < 2)
+                v = 15;
+            f->row<Uint8>(y)[x] = Uint8(v + (x*7 + y*13) % 5);
+        }
+    }
+
+    struct {
+        const char* name;
+        void (*min_sum)(const Frame&, int, int, int, int, Uint8&, Uint32&);
+        void (*mask)(const Frame&, int, int, int, int, Uint8, Uint8*);
+    } kernels[] = {
+        { "scalar", eye_min_sum_scalar, dark_mask_scalar },
+        { "sse2", eye_min_sum_sse2, dark_mask_sse2 },
+        { "avx2", eye_min_sum_avx2, dark_mask_avx2 },
+    };
+    // Odd sizes and offsets, so the kernels' leftovers get checked as well.
+    Uint8 ref_min;
+    Uint32 ref_sum;
+    std::vector<Uint8> ref(637*477), out(637*477);
+    eye_min_sum_scalar(*f, 3, 2, 637, 477, ref_min, ref_sum);
+    dark_mask_scalar(*f, 3, 2, 637, 477, 93, ref.data());
+    for (auto& k : kernels) {
+        if (std::string(k.name) == "avx2" && !cpu_has_avx2()) {
+            std::cout << "  " << k.name << ": not supported by this CPU" << std::endl;
+            continue;
+        }
+        Uint8 min;
+        Uint32 sum;
+        k.min_sum(*f, 3, 2, 637, 477, min, sum);
+        k.mask(*f, 3, 2, 637, 477, 93, out.data());
+        if (min != ref_min || sum != ref_sum || out != ref) {
+            std::cerr << "  " << k.name << " differs from the scalar reference!" << std::endl;
+            return 1;
+        }
+        std::string what = std::string(k.name) + " min/sum";
+        timeit(what.c_str(), 5000, 0, [&]{ k.min_sum(*f, 291, 222, 60, 40, min, sum); });
+        what = std::string(k.name) + " mask";
+        timeit(what.c_str(), 5000, 0, [&]{ k.mask(*f, 291, 222, 60, 40, 93, out.data()); });
+    }
+
+    std::vector<Uint8> mask;
+    std::vector<int> labels;
+    Pupil p;
+    if (!find_pupil(*f, 291, 222, 60, 40, 4, 60, mask, labels, p)) {
+        std::cerr << "  the pupil wasn't found!" << std::endl;
+        return 1;
+    }
+    std::cout << "  at " << p.x << "," << p.y << ", " << p.major << "x" << p.minor << " px at "
+              << p.angle << " degrees" << std::endl;
+    if (std::fabs(p.x - px) > 0.3 || std::fabs(p.y - py) > 0.3) {
+        std::cerr << "  that's not where the pupil is!" << std::endl;
+        return 1;
+    }
+    timeit("find pupil", 5000, 0, [&]{ find_pupil(*f, 291, 222, 60, 40, 4, 60, mask, labels, p); });
+    return 0;
+}
+
+static int bench_sprites()
+{
+    const int n = 500, w = 1920, h = 1080;
+    std::cout << "sprites, Mr.Point and " << n - 1 << " distractors on " << w << "x" << h << " (per frame):" << std::endl;
+
+    // What the render thread does for them per frame before drawing anything.
+    Trajectory traj = standard_trajectory(SHAPE_MIN_JERK);
+    StimulusSet stimuli;
+    SpriteBatch batch;
+    double t = 0.0;
+    auto next = [&]{ t = std::fmod(t + 1.0/60.0, traj.duration()); };
+    stimuli.init(SDL_Rect{ 1, 1, 64, 64 }, w, h, true);
+    stimuli.setup(traj, n - 1, 1337);
+    timeit("update and batch", 2000, 0, [&]{
+        stimuli.update(t);
+        batch.begin(nullptr);
+        stimuli.render(batch);
+        next();
+    });
+
+    // And drawing them, into a hidden window without vsync with each of SDL's
+    // renderers we use. Reading back a pixel waits for the GPU to be done.
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+        std::cout << "  drawing: no video (" << SDL_GetError() << ")" << std::endl;
+        return 0;
+    }
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+    const char* drivers[] = { "opengl", "software" };
+    for (const char* driver : drivers) {
+        SDL_SetHint(SDL_HINT_RENDER_DRIVER, driver);
+        SDL_Window* window = SDL_CreateWindow("bench", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, w, h, SDL_WINDOW_HIDDEN);
+        SDL_Renderer* renderer = window ? SDL_CreateRenderer(window, -1, 0) : nullptr;
+        SDL_RendererInfo info;
+        if (!renderer || SDL_GetRendererInfo(renderer, &info) != 0 || std::string(info.name) != driver) {
+            std::cout << "  " << driver << ": not available" << std::endl;
+            if (renderer)
+                SDL_DestroyRenderer(renderer);
+            if (window)
+                SDL_DestroyWindow(window);
+            continue;
+        }
+        {
+            Atlas atlas;
+            SDL_Surface* sprite = SDL_CreateRGBSurface(0, 64, 64, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000);
+            SDL_FillRect(sprite, nullptr, 0xffffffff);
+            int id = atlas.add(sprite);
+            atlas.build(renderer);
+            batch.init(renderer);
+            stimuli.init(atlas.rect(id), w, h, batch.is_gl());
+            stimuli.setup(traj, n - 1, 1337);
+
+            SDL_Rect one = { 0, 0, 1, 1 };
+            Uint32 pixel;
+            std::string what = std::string(driver) + " update, draw and present";
+            double us = timeit(what.c_str(), 300, 0, [&]{
+                stimuli.update(t);
+                SDL_RenderClear(renderer);
+                batch.begin(atlas.texture());
+                stimuli.render(batch);
+                batch.end();
+                SDL_RenderReadPixels(renderer, &one, SDL_PIXELFORMAT_ARGB8888, &pixel, 4);
+                SDL_RenderPresent(renderer);
+                next();
+            });
+            std::cout << "    " << int(100.0 * us / (1e6/60.0) + 0.5) << "% of a 60 Hz frame" << std::endl;
+        }
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+    }
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    return 0;
+}
+
+int run_bench(const std::string& name)
+{
+    struct { const char* name; int (*fn)(); } benches[] = {
+        { "choreography", bench_choreography },
+        { "trajectory", bench_trajectory },
+        { "colormap", bench_colormap },
+        { "pointcloud", bench_pointcloud },
+        { "registration", bench_registration },
+        { "quality", bench_quality },
+        { "depthfilter", bench_depthfilter },
+        { "blink", bench_blink },
+        { "sharpness", bench_sharpness },
+        { "convert", bench_convert },
+        { "headpose", bench_headpose },
+        { "pupil", bench_pupil },
+        { "sprites", bench_sprites },
+    };
+
+    bool found = false;
+    int ret = 0;
+    for (auto& b : benches) {
+        if (name == "all" || name == b.name) {
+            found = true;
+            ret |= b.fn();
+        }
+    }
+    if (!found) {
+        std::cerr << "Unknown benchmark: " << name << ". Available:";
+        for (auto& b : benches)
+            std::cerr << " " << b.name;
+        std::cerr << " all" << std::endl;
+        return 1;
+    }
+    return ret;
+}
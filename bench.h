@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// Micro-benchmarks, run with `--bench NAME` (or `--bench all`) instead of recording.
+// Each checks its fast path against a plain reference before timing anything.
+// Returns the process exit code.
+int run_bench(const std::string& name);
@@ -0,0 +1,288 @@
+#include "blink.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <SDL_cpuinfo.h>
+
+#include "convert.h"
+#include "simd.h"
+
+// Where the eyes are: a band across the face a bit above the head's middle, in millimeters.
+static const float EYES_ABOVE_MM = 15.0f, EYES_W_MM = 120.0f, EYES_H_MM = 40.0f;
+// The eyes are closed below CLOSED times their usual openness, and open again above OPEN.
+static const float CLOSED = 0.6f, OPEN = 0.8f;
+// How much of each open frame goes into the usual openness, and of each closed one,
+// so a lasting drop (lighting, glasses) doesn't stay closed forever.
+static const float BASELINE_GAIN = 0.05f, CLOSED_GAIN = 0.002f;
+// The usual openness starts as the most open of the first frames the eyes are
+// seen in, about half a second's worth, in case they start out closed.
+static const unsigned WARMUP_FRAMES = 15;
+// Eyes closed for longer than this are a closure rather than a blink, or something
+// else changed: it's logged as cut off, and the usual openness starts over.
+static const Sint64 MAX_CLOSED_US = 3000000;
+
+static Uint32 row_scalar(const Uint8* p, int w, FrameFormat format)
+{
+    Uint32 sum = 0;
+    if (format == FRAME_Y8) {
+        for (int i = 0; i < w; ++i)
+            sum += p[i];
+        return sum * 256;
+    }
+    for (int i = 0; i < w; ++i, p += 4)
+        sum += GRAY_WEIGHT_B*p[0] + GRAY_WEIGHT_G*p[1] + GRAY_WEIGHT_R*p[2];
+    return sum;
+}
+
+void eye_profile_scalar(const Frame& image, int x, int y, int w, int h, Uint32* profile)
+{
+    int bpp = bytes_per_pixel(image.format);
+    for (int i = 0; i < h; ++i)
+        profile[i] = row_scalar(image.row<Uint8>(y + i) + x*bpp, w, image.format);
+}
+
+#ifdef HAVE_SSE2
+void eye_profile_sse2(const Frame& image, int x, int y, int w, int h, Uint32* profile)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                           GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0);
+    int bpp = bytes_per_pixel(image.format);
+    Uint32 lanes[4];
+    for (int r = 0; r < h; ++r) {
+        const Uint8* p = image.row<Uint8>(y + r) + x*bpp;
+        __m128i sum = zero;
+        int i = 0;
+        if (image.format == FRAME_Y8) {
+            for (; i + 16 <= w; i += 16)
+                sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+            profile[r] = (lanes[0] + lanes[2]) * 256 + row_scalar(p + i, w - i, image.format);
+        } else {
+            for (; i + 4 <= w; i += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 4*i));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(v, zero), weights));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpackhi_epi8(v, zero), weights));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+            profile[r] = lanes[0] + lanes[1] + lanes[2] + lanes[3] + row_scalar(p + 4*i, w - i, image.format);
+        }
+    }
+}
+#else
+void eye_profile_sse2(const Frame& image, int x, int y, int w, int h, Uint32* profile)
+{
+    eye_profile_scalar(image, x, y, w, h, profile);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void eye_profile_avx2(const Frame& image, int x, int y, int w, int h, Uint32* profile)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weights = _mm256_setr_epi16(GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                              GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                              GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                              GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0);
+    int bpp = bytes_per_pixel(image.format);
+    Uint32 lanes[8];
+    for (int r = 0; r < h; ++r) {
+        const Uint8* p = image.row<Uint8>(y + r) + x*bpp;
+        __m256i sum = zero;
+        int i = 0;
+        if (image.format == FRAME_Y8) {
+            for (; i + 32 <= w; i += 32)
+                sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), zero));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+            profile[r] = (lanes[0] + lanes[2] + lanes[4] + lanes[6]) * 256 + row_scalar(p + i, w - i, image.format);
+        } else {
+            // Unpacking works per 128 bit lane, which doesn't matter for a sum.
+            for (; i + 8 <= w; i += 8) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 4*i));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_unpacklo_epi8(v, zero), weights));
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_unpackhi_epi8(v, zero), weights));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+            Uint32 total = 0;
+            for (int k = 0; k < 8; ++k)
+                total += lanes[k];
+            profile[r] = total + row_scalar(p + 4*i, w - i, image.format);
+        }
+    }
+}
+#else
+void eye_profile_avx2(const Frame& image, int x, int y, int w, int h, Uint32* profile)
+{
+    eye_profile_sse2(image, x, y, w, h, profile);
+}
+#endif
+
+void eye_profile(const Frame& image, int x, int y, int w, int h, Uint32* profile)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        eye_profile_avx2(image, x, y, w, h, profile);
+    else if (SDL_HasSSE2())
+        eye_profile_sse2(image, x, y, w, h, profile);
+    else
+        eye_profile_scalar(image, x, y, w, h, profile);
+}
+
+float eye_openness(const Uint32* profile, int h)
+{
+    if (h < 3)
+        return 0.0f;
+
+    // Smoothed a little, so a single noisy row doesn't count as the dark band.
+    double sum = 0.0, darkest = 1e30;
+    for (int i = 1; i < h - 1; ++i) {
+        double v = 0.25*profile[i-1] + 0.5*profile[i] + 0.25*profile[i+1];
+        sum += v;
+        darkest = std::min(darkest, v);
+    }
+    double mean = sum / (h - 2);
+    return mean > 0.0 ? float((mean - darkest) / mean) : 0.0f;
+}
+
+BlinkDetector::BlinkDetector()
+{
+    reset();
+}
+
+void BlinkDetector::reset()
+{
+    m_baseline = 0.0f;
+    m_warmup = 0;
+    m_closed = false;
+    m_current = m_last = Blink();
+    m_blinks = m_cut_off = m_closed_frames = 0;
+}
+
+bool BlinkDetector::end_blink(bool cut_off)
+{
+    if (!m_closed)
+        return false;
+    m_closed = false;
+    if (cut_off)
+        ++m_cut_off;
+    else
+        ++m_blinks;
+    m_last = m_current;
+    m_last.cut_off = cut_off;
+    return true;
+}
+
+bool BlinkDetector::lost()
+{
+    return end_blink(false);
+}
+
+bool BlinkDetector::update(unsigned index, Sint64 t_us, float openness)
+{
+    if (m_warmup < WARMUP_FRAMES) {
+        ++m_warmup;
+        m_baseline = std::max(m_baseline, openness);
+        return false;
+    }
+
+    bool ended = false;
+    if (m_closed && t_us - m_current.start_us > MAX_CLOSED_US) {
+        // Whatever it is, it's the usual now.
+        ended = end_blink(true);
+        m_baseline = openness;
+    }
+    if (!m_closed && openness < CLOSED * m_baseline) {
+        m_closed = true;
+        m_current.start_index = index;
+        m_current.start_us = t_us;
+    } else if (m_closed && openness > OPEN * m_baseline) {
+        ended = end_blink(false);
+    }
+    if (m_closed) {
+        m_current.end_index = index;
+        m_current.end_us = t_us;
+        ++m_closed_frames;
+    }
+    m_baseline += (m_closed ? CLOSED_GAIN : BASELINE_GAIN) * (openness - m_baseline);
+    return ended;
+}
+
+BlinkStage::BlinkStage(const Intrinsics& depth, const Intrinsics& camera, const Extrinsics& depth_to_camera, Uint32 stream)
+    : Stage("blink", STREAM_DEPTH | stream)
+    , m_camera(camera)
+    , m_extrinsics(depth_to_camera)
+    , m_stream(stream)
+    , m_tracker(depth)
+    , m_first_us(0)
+    , m_latest_us(0)
+{}
+
+void BlinkStage::begin()
+{
+    m_detector.reset();
+    m_first_us = m_latest_us = 0;
+    m_log.open("eyes", "frame,host_us,found,eyes_x,eyes_y,eyes_w,eyes_h,openness,usual_openness,closed");
+    m_blink_log.open("blinks", "start_frame,end_frame,start_us,end_us,duration_ms,cut_off");
+}
+
+void BlinkStage::log_blink()
+{
+    const BlinkDetector::Blink& b = m_detector.last();
+    m_blink_log.row("%u,%u,%lld,%lld,%.1f,%d", b.start_index, b.end_index, (long long)b.start_us,
+                    (long long)b.end_us, 0.001 * (b.end_us - b.start_us), int(b.cut_off));
+}
+
+void BlinkStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    const Frame* image = m_stream == STREAM_IR ? frames.ir.get() : frames.color.get();
+    if (!depth || !image)
+        return;
+    if (!m_first_us)
+        m_first_us = image->host_us;
+    m_latest_us = image->host_us;
+
+    // Where the eyes are in the image.
+    SDL_Rect r = { 0, 0, 0, 0 };
+    if (m_tracker.update(*depth)) {
+        Intrinsics in = m_camera.scaled(image->width, image->height);
+        float u, v, z;
+        m_tracker.in_camera(in, m_extrinsics, u, v, z);
+        v -= in.fy * EYES_ABOVE_MM / z;
+        int w = int(in.fx * EYES_W_MM / z), h = int(in.fy * EYES_H_MM / z);
+        r.x = std::max(0, int(u) - w/2);
+        r.y = std::max(0, int(v) - h/2);
+        r.w = std::min(image->width, int(u) - w/2 + w) - r.x;
+        r.h = std::min(image->height, int(v) - h/2 + h) - r.y;
+    }
+    if (r.w < 8 || r.h < 8) {
+        if (m_detector.lost())
+            log_blink();
+        m_log.row("%u,%lld,0,0,0,0,0,,,", image->index, (long long)image->host_us);
+        return;
+    }
+
+    m_profile.resize(r.h);
+    eye_profile(*image, r.x, r.y, r.w, r.h, m_profile.data());
+    float openness = eye_openness(m_profile.data(), r.h);
+    if (m_detector.update(image->index, image->host_us, openness))
+        log_blink();
+
+    m_log.row("%u,%lld,1,%d,%d,%d,%d,%.4f,%.4f,%d", image->index, (long long)image->host_us,
+              r.x, r.y, r.w, r.h, openness, m_detector.baseline(), int(m_detector.closed()));
+}
+
+void BlinkStage::end()
+{
+    if (m_detector.lost())
+        log_blink();
+    m_log.close();
+    m_blink_log.close();
+
+    double minutes = (m_latest_us - m_first_us) / 60e6;
+    session_meta("blinks", double(m_detector.blinks()));
+    session_meta("blinks_per_minute", minutes > 0.0 ? m_detector.blinks() / minutes : 0.0);
+    session_meta("eyes_closed_frames", double(m_detector.closed_frames()));
+    session_meta("eye_closures_cut_off", double(m_detector.cut_off()));
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+#include "facecrop.h"
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// Sums up each of the `h` rows of the `w`x`h` region at x,y of `image` (BGRA or
+// Y8) into `profile`, as 256 times their gray levels. Uses the best kernel the CPU supports.
+void eye_profile(const Frame& image, int x, int y, int w, int h, Uint32* profile);
+
+// The individual kernels, for testing and benchmarking.
+void eye_profile_scalar(const Frame& image, int x, int y, int w, int h, Uint32* profile);
+void eye_profile_sse2(const Frame& image, int x, int y, int w, int h, Uint32* profile);
+void eye_profile_avx2(const Frame& image, int x, int y, int w, int h, Uint32* profile);
+
+// How open the eyes are, from the vertical intensity profile across them: open
+// eyes are a dark band of iris, pupil and lashes across the lighter skin, closed
+// ones are all eyelid. So it's how much darker the darkest row is than the mean.
+float eye_openness(const Uint32* profile, int h);
+
+// Tells blinks from how open the eyes are per frame (see `eye_openness`).
+//
+// The openness is compared against its own running average while open, so it
+// doesn't depend on the participant or the lighting. That average follows closed
+// eyes too, only slowly, and eyes closed for more than a few seconds are cut off
+// and start it over, so a lasting change can't turn the rest of the session into
+// one blink.
+class BlinkDetector {
+public:
+    struct Blink {
+        unsigned start_index, end_index;  // The first and last closed frame.
+        Sint64 start_us, end_us;
+        bool cut_off;  // Ended for having lasted too long.
+    };
+
+    BlinkDetector();
+    void reset();
+
+    // The openness of frame `index` at `t_us`. Returns true when that ended a blink,
+    // which `last` then is.
+    bool update(unsigned index, Sint64 t_us, float openness);
+    // The eyes couldn't be seen, or there are no more frames: any blink is over as
+    // far as we know. Returns true if one was going on, see `last`.
+    bool lost();
+
+    const Blink& last() const { return m_last; }
+    bool closed() const { return m_closed; }
+    float baseline() const { return m_baseline; }
+    unsigned blinks() const { return m_blinks; }
+    unsigned cut_off() const { return m_cut_off; }
+    unsigned closed_frames() const { return m_closed_frames; }
+
+private:
+    bool end_blink(bool cut_off);
+
+    float m_baseline;  // 0 until the eyes were seen the first time.
+    unsigned m_warmup;  // Frames the eyes were seen in, up to `WARMUP_FRAMES`.
+    bool m_closed;
+    Blink m_current, m_last;
+    unsigned m_blinks, m_cut_off, m_closed_frames;
+};
+
+// Detects blinks and longer eye closures on a worker thread, so that frames without
+// a valid gaze can be left out when building datasets.
+//
+// The eyes are found from the head in the depth stream (see `HeadTracker`), and
+// their openness goes through a `BlinkDetector`. Per frame, the openness goes into
+// `<session>.eyes.csv`, every blink with its start and end into `<session>.blinks.csv`
+// (cut off ones marked), and the number and rate of blinks into the meta.
+class BlinkStage : public Stage {
+public:
+    // `stream` is `STREAM_COLOR` or `STREAM_IR`; `camera` and `depth_to_camera` its calibration.
+    BlinkStage(const Intrinsics& depth, const Intrinsics& camera, const Extrinsics& depth_to_camera, Uint32 stream);
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    // Logs `m_detector.last()`.
+    void log_blink();
+
+    Intrinsics m_camera;
+    Extrinsics m_extrinsics;
+    Uint32 m_stream;
+
+    HeadTracker m_tracker;
+    std::vector<Uint32> m_profile;
+    BlinkDetector m_detector;
+
+    // Of the first and latest frames, for the blink rate.
+    Sint64 m_first_us, m_latest_us;
+
+    SessionLog m_log, m_blink_log;
+};
@@ -0,0 +1,50 @@
+#include "calibration.h"
+
+Intrinsics Intrinsics::scaled(int w, int h) const
+{
+    Intrinsics s = *this;
+    float sx = float(w) / width, sy = float(h) / height;
+    s.width = w;
+    s.height = h;
+    s.fx *= sx;
+    s.cx *= sx;
+    s.fy *= sy;
+    s.cy *= sy;
+    return s;
+}
+
+void Intrinsics::unproject(float u, float v, float& x, float& y) const
+{
+    float x0 = (u - cx) / fx, y0 = (v - cy) / fy;
+
+    // There's no closed form for undoing the distortion, but it's mild enough
+    // for a few fixed-point iterations to converge.
+    x = x0;
+    y = y0;
+    for (int i = 0; i < 8; ++i) {
+        float r2 = x*x + y*y;
+        float radial = 1 + r2*(k[0] + r2*(k[1] + r2*k[2]));
+        float dx = 2*p[0]*x*y + p[1]*(r2 + 2*x*x);
+        float dy = p[0]*(r2 + 2*y*y) + 2*p[1]*x*y;
+        x = (x0 - dx) / radial;
+        y = (y0 - dy) / radial;
+    }
+}
+
+void Intrinsics::project(float x, float y, float z, float& u, float& v) const
+{
+    float xn = x / z, yn = y / z;
+    float r2 = xn*xn + yn*yn;
+    float radial = 1 + r2*(k[0] + r2*(k[1] + r2*k[2]));
+    float xd = xn*radial + 2*p[0]*xn*yn + p[1]*(r2 + 2*xn*xn);
+    float yd = yn*radial + p[0]*(r2 + 2*yn*yn) + 2*p[1]*xn*yn;
+    u = fx*xd + cx;
+    v = fy*yd + cy;
+}
+
+void Extrinsics::apply(float x, float y, float z, float& x2, float& y2, float& z2) const
+{
+    x2 = r[0]*x + r[1]*y + r[2]*z + t[0];
+    y2 = r[3]*x + r[4]*y + r[5]*z + t[1];
+    z2 = r[6]*x + r[7]*y + r[8]*z + t[2];
+}
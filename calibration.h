@@ -0,0 +1,29 @@
+#pragma once
+
+// How a stream's pixels relate to the 3D world, as the SDK's calibration tells.
+
+// The pinhole model in pixels, plus Brown-Conrady distortion: radial `k`, tangential `p`.
+// Camera coordinates have x right, y down and z forward.
+struct Intrinsics {
+    int width, height;
+    float fx, fy, cx, cy;
+    float k[3], p[2];
+
+    // The same camera at another resolution, e.g. for a different stream profile.
+    Intrinsics scaled(int w, int h) const;
+
+    // The undistorted ray through pixel u,v as x,y at z = 1.
+    void unproject(float u, float v, float& x, float& y) const;
+
+    // The other way around: where the point x,y,z (z > 0) ends up in the image, distortion and all.
+    void project(float x, float y, float z, float& u, float& v) const;
+};
+
+// A rigid transform from one camera's coordinates into another's: p' = r p + t,
+// with `r` row-major and `t` in meters.
+struct Extrinsics {
+    float r[9];
+    float t[3];
+
+    void apply(float x, float y, float z, float& x2, float& y2, float& z2) const;
+};
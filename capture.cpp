@@ -0,0 +1,395 @@
+#include "capture.h"
+
+#ifndef NO_REALSENSE
+
+#include <atomic>
+#include <codecvt>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <locale>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL.h>
+
+#include <pxcsensemanager.h>
+
+#include "clocksync.h"
+#include "convert.h"
+#include "counters.h"
+#include "frames.h"
+#include "histogram.h"
+#include "latency.h"
+#include "preview.h"
+#include "session.h"
+#include "stage.h"
+#include "timing.h"
+#include "verify.h"
+
+// As global so we can use atexit.
+static PXCSenseManager *g_sm = nullptr;
+
+// What we ask the SDK for, see `init_realsense`.
+static const int WIDTH = 640, HEIGHT = 480, FPS = 30;
+
+static std::atomic<bool> g_capturing(false);
+static std::thread g_capture_thread;
+
+// Only ever touched by the capture thread while it runs.
+static ClockSync g_clock;
+static SessionLog g_clock_log;
+
+// Between frames arriving, and from a frame arriving until we release it again.
+static Histogram g_interval_ms(0.1, 1000);
+static Histogram g_work_ms(0.01, 2000);
+static Uint64 g_dropped0;
+
+// Where our copies of the frames come from.
+static FramePool g_pool;
+
+// Who else gets them, and which streams between them all.
+static std::vector<Stage*> g_stages;
+static Uint32 g_stage_streams = 0;
+
+// Shows an error for failed SDK calls, see `verify.h`.
+static bool pxc_verify(pxcStatus ret, std::string msg)
+{
+    if (ret < PXC_STATUS_NO_ERROR) {
+        show_error("RealSense Error", "RealSense error #" + std::to_string(ret) + ": " + msg);
+        return false;
+    }
+    if (ret > PXC_STATUS_NO_ERROR)
+        show_error("RealSense Error", "RealSense warning #" + std::to_string(ret) + ": " + msg);
+    return true;
+}
+
+bool init_realsense(bool record, bool ir)
+{
+    // Initialize RealSense
+    if ((g_sm = PXCSenseManager::CreateInstance()) == nullptr) {
+        show_error("RealSense Error", "Unable to create the SenseManager.");
+        return false;
+    }
+    std::atexit([](){ g_sm->Release(); });
+
+    // Sets file recording or playback
+    if (record) {
+        std::string utf8path = session_path(".rssdk");
+        std::cout << "Recording to " << utf8path << std::endl;
+
+        // Damn you RealSense!
+        std::wstring path = std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(utf8path);
+        if (!pxc_verify(g_sm->QueryCaptureManager()->SetFileName(path.c_str(), true), "Setting filename for recording."))
+            return false;
+    }
+
+    // Chooses what streams we want to capture.
+    if (!pxc_verify(g_sm->EnableStream(PXCCapture::STREAM_TYPE_COLOR, WIDTH, HEIGHT, FPS), "Enabling RGB stream."))
+        return false;
+    if (!pxc_verify(g_sm->EnableStream(PXCCapture::STREAM_TYPE_DEPTH, WIDTH, HEIGHT, FPS), "Enabling D stream. Yup Alex, can't get the D!"))
+        return false;
+    if (ir && !pxc_verify(g_sm->EnableStream(PXCCapture::STREAM_TYPE_IR, WIDTH, HEIGHT, FPS), "Enabling IR stream."))
+        return false;
+
+    return pxc_verify(g_sm->Init(), "Initialize the capture.");
+}
+
+bool capture_ready()
+{
+    return g_sm != nullptr;
+}
+
+// The SDK's name for one of our `STREAM_*`.
+static PXCCapture::StreamType pxc_stream(Uint32 stream)
+{
+    return stream == STREAM_COLOR ? PXCCapture::STREAM_TYPE_COLOR :
+           stream == STREAM_DEPTH ? PXCCapture::STREAM_TYPE_DEPTH :
+                                    PXCCapture::STREAM_TYPE_IR;
+}
+
+// The SDK's calibration of `stream`, false if it has none.
+static bool query_calibration(PXCCapture::Device* device, PXCCapture::StreamType stream,
+                              PXCCalibration::StreamCalibration& c, PXCCalibration::StreamTransform& t)
+{
+    PXCProjection* projection = device->CreateProjection();
+    if (!projection)
+        return false;
+    PXCCalibration* calibration = projection->QueryInstance<PXCCalibration>();
+    bool ok = calibration && calibration->QueryStreamProjectionParameters(stream, &c, &t) >= PXC_STATUS_NO_ERROR;
+    projection->Release();
+    return ok;
+}
+
+bool capture_intrinsics(Uint32 stream, Intrinsics& out)
+{
+    PXCCapture::Device* device = g_sm ? g_sm->QueryCaptureManager()->QueryDevice() : nullptr;
+    if (!device)
+        return false;
+
+    out.width = WIDTH;
+    out.height = HEIGHT;
+    out.k[0] = out.k[1] = out.k[2] = out.p[0] = out.p[1] = 0.0f;
+
+    // The proper calibration, distortion and all.
+    PXCCalibration::StreamCalibration c;
+    PXCCalibration::StreamTransform t;
+    if (query_calibration(device, pxc_stream(stream), c, t)) {
+        out.fx = c.focalLength.x;
+        out.fy = c.focalLength.y;
+        out.cx = c.principalPoint.x;
+        out.cy = c.principalPoint.y;
+        for (int i = 0; i < 3; ++i)
+            out.k[i] = c.radialDistortion[i];
+        for (int i = 0; i < 2; ++i)
+            out.p[i] = c.tangentialDistortion[i];
+        return true;
+    }
+    if (stream != STREAM_DEPTH && stream != STREAM_IR)
+        return false;
+
+    // Good enough to go on with, the distortion's small anyway. Infrared comes
+    // from the depth camera itself.
+    PXCPointF32 f = device->QueryDepthFocalLength();
+    PXCPointF32 c0 = device->QueryDepthPrincipalPoint();
+    out.fx = f.x;
+    out.fy = f.y;
+    out.cx = c0.x;
+    out.cy = c0.y;
+    return f.x > 0.0f && f.y > 0.0f;
+}
+
+bool capture_extrinsics(Uint32 from, Uint32 to, Extrinsics& out)
+{
+    PXCCapture::Device* device = g_sm ? g_sm->QueryCaptureManager()->QueryDevice() : nullptr;
+    if (!device)
+        return false;
+
+    // Each stream's transform takes its camera's coordinates into the device's
+    // common ones, as p' = rotation p + translation, in millimeters.
+    PXCCalibration::StreamCalibration c;
+    PXCCalibration::StreamTransform a, b;
+    if (!query_calibration(device, pxc_stream(from), c, a) || !query_calibration(device, pxc_stream(to), c, b))
+        return false;
+
+    // So from `from` to `to` it's b.rotation^T (a.rotation p + a.translation - b.translation).
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            float r = 0.0f;
+            for (int k = 0; k < 3; ++k)
+                r += b.rotation[k][i] * a.rotation[k][j];
+            out.r[i*3 + j] = r;
+        }
+        float t = 0.0f;
+        for (int k = 0; k < 3; ++k)
+            t += b.rotation[k][i] * (a.translation[k] - b.translation[k]);
+        out.t[i] = 0.001f * t;
+    }
+    return true;
+}
+
+void capture_add_stage(Stage* stage)
+{
+    g_stages.push_back(stage);
+    g_stage_streams |= stage->streams();
+}
+
+// Hands the color image to the latency calibration, if it's running.
+static void observe_latency(PXCCapture::Sample* sample, Uint64 t_us)
+{
+    if (!latency_calibrating() || !sample || !sample->color)
+        return;
+
+    PXCImage::ImageInfo info = sample->color->QueryInfo();
+    PXCImage::ImageData data;
+    if (sample->color->AcquireAccess(PXCImage::ACCESS_READ, PXCImage::PIXEL_FORMAT_RGB32, &data) < PXC_STATUS_NO_ERROR)
+        return;
+    latency_observe(data.planes[0], data.pitches[0], info.width, info.height, t_us);
+    sample->color->ReleaseAccess(&data);
+}
+
+// Copies `img` into a frame from the pool, converted to `format`. Null on failure.
+static FramePtr copy_image(PXCImage* img, FrameFormat format, unsigned index, Sint64 device_us, Sint64 t_us)
+{
+    if (!img)
+        return nullptr;
+
+    PXCImage::PixelFormat pxc_format =
+        format == FRAME_BGRA ? PXCImage::PIXEL_FORMAT_RGB32 :
+        format == FRAME_DEPTH16 ? PXCImage::PIXEL_FORMAT_DEPTH :
+                                  PXCImage::PIXEL_FORMAT_Y8;
+
+    // Color in the camera's own YUY2 or NV12 we convert ourselves, which is several
+    // times faster than having the SDK do it, see `convert.h`.
+    PXCImage::ImageInfo info = img->QueryInfo();
+    bool native = format == FRAME_BGRA && (info.format == PXCImage::PIXEL_FORMAT_YUY2 ||
+                                           info.format == PXCImage::PIXEL_FORMAT_NV12);
+    if (native)
+        pxc_format = info.format;
+
+    PXCImage::ImageData data;
+    if (img->AcquireAccess(PXCImage::ACCESS_READ, pxc_format, &data) < PXC_STATUS_NO_ERROR)
+        return nullptr;
+
+    FramePtr f = g_pool.get(format, info.width, info.height);
+    f->index = index;
+    f->device_us = device_us;
+    f->host_us = t_us;
+    if (native && pxc_format == PXCImage::PIXEL_FORMAT_YUY2) {
+        yuy2_to_bgra(data.planes[0], data.pitches[0], info.width, info.height, f->row<Uint8>(0), f->stride);
+    } else if (native) {
+        nv12_to_bgra(data.planes[0], data.pitches[0], data.planes[1], data.pitches[1], info.width, info.height,
+                     f->row<Uint8>(0), f->stride);
+    } else {
+        for (int y = 0; y < info.height; ++y)
+            std::memcpy(f->row<Uint8>(y), data.planes[0] + y*data.pitches[0], f->stride);
+    }
+
+    img->ReleaseAccess(&data);
+    return f;
+}
+
+static void capture_loop()
+{
+    unsigned frame = 0;
+    Sint64 last_arrival_us = 0, last_device_us = 0;
+
+    // Only record when we should be recording, duh!
+    while (g_capturing) {
+        // It seems that acquiring frames is necessary for the recording to record anything!
+        // I tried just idling in a MessageBox and it didn't work.
+
+        // Waits until new frame is available and locks it for application processing.
+        if (!pxc_verify(g_sm->AcquireFrame(true), "Acquiring frame"))
+            break;  // TODO: Apparently one should recover from PXC_STATUS_STREAM_CONFIG_CHANGED?
+        Sint64 arrival_us = Sint64(host_us());
+        if (last_arrival_us)
+            g_interval_ms.add(0.001 * (arrival_us - last_arrival_us));
+        last_arrival_us = arrival_us;
+        PXCCapture::Sample* sample = g_sm->QuerySample();
+
+        // The device's timestamps are in 100ns units. Both streams are synced,
+        // so either of them is good for relating the device's clock to ours.
+        PXCImage* img = sample ? (sample->color ? sample->color : sample->depth) : nullptr;
+        Sint64 t_us = arrival_us, device_us = 0;
+        if (img) {
+            device_us = img->QueryTimeStamp() / 10;
+            g_clock.add(device_us, arrival_us);
+            if (g_clock.valid())
+                t_us = g_clock.to_host(device_us);
+            g_clock_log.row("%u,%lld,%lld,%lld", frame, (long long)device_us, (long long)arrival_us, (long long)t_us);
+
+            // The device's clock tells whether frames went missing in between.
+            double frames = (device_us - last_device_us) * FPS * 1e-6;
+            if (last_device_us && frames > 1.5)
+                count(g_counters.dropped_frames, Uint64(frames + 0.5) - 1);
+            last_device_us = device_us;
+        }
+        if (sample && sample->color)
+            count(g_counters.color_frames);
+        if (sample && sample->depth)
+            count(g_counters.depth_frames);
+
+        observe_latency(sample, Uint64(t_us));
+
+        // One copy per stream, shared by everyone who wants it.
+        if (sample) {
+            bool preview = preview_wants(frame);
+            FrameSet frames;
+            if (preview || (g_stage_streams & STREAM_COLOR))
+                frames.color = copy_image(sample->color, FRAME_BGRA, frame, device_us, t_us);
+            if (preview || (g_stage_streams & STREAM_DEPTH))
+                frames.depth = copy_image(sample->depth, FRAME_DEPTH16, frame, device_us, t_us);
+            if (g_stage_streams & STREAM_IR)
+                frames.ir = copy_image(sample->ir, FRAME_Y8, frame, device_us, t_us);
+
+            if (preview)
+                preview_publish(frames.color, frames.depth);
+            for (Stage* stage : g_stages) {
+                FrameSet wanted;
+                if (stage->streams() & STREAM_COLOR)
+                    wanted.color = frames.color;
+                if (stage->streams() & STREAM_DEPTH)
+                    wanted.depth = frames.depth;
+                if (stage->streams() & STREAM_IR)
+                    wanted.ir = frames.ir;
+                stage->push(wanted);
+            }
+        }
+        ++frame;
+        g_counters.frames_in_flight.store(int(g_pool.allocated() - g_pool.available()), std::memory_order_relaxed);
+
+        // Done working with the frame.
+        g_work_ms.add(0.001 * (Sint64(host_us()) - arrival_us));
+        g_sm->ReleaseFrame();
+    }
+}
+
+void capture_start()
+{
+    if (g_capturing || !g_sm)
+        return;
+
+    g_clock.reset();
+    g_interval_ms.clear();
+    g_work_ms.clear();
+    g_dropped0 = g_counters.dropped_frames;
+    g_clock_log.open("clock", "frame,device_us,arrival_us,host_us");
+    for (Stage* stage : g_stages)
+        stage->start();
+
+    g_capturing = true;
+    g_capture_thread = std::thread(capture_loop);
+}
+
+void capture_stop()
+{
+    g_capturing = false;
+    if (!g_capture_thread.joinable())
+        return;
+    g_capture_thread.join();
+    for (Stage* stage : g_stages)
+        stage->stop();
+
+    // The final clock model, for mapping any device timestamp of this session to host time:
+    // host_us = clock_host0_us + clock_offset_us + (device_us - clock_device0_us) * (1 + 1e-6*clock_drift_ppm)
+    if (g_clock.valid()) {
+        session_meta("clock_device0_us", std::to_string((long long)g_clock.device0()));
+        session_meta("clock_host0_us", std::to_string((long long)g_clock.host0()));
+        session_meta("clock_offset_us", g_clock.offset_us());
+        session_meta("clock_drift_ppm", g_clock.drift_ppm());
+    }
+    g_clock_log.close();
+
+    std::cout << "Capture interval [ms]: " << g_interval_ms.summary() << "\n"
+              << "Capture work per frame [ms]: " << g_work_ms.summary() << std::endl;
+    session_meta("capture_frames", double(g_work_ms.count()));
+    session_meta("capture_dropped_frames", double(g_counters.dropped_frames - g_dropped0));
+    session_meta("capture_interval_ms_p50", g_interval_ms.percentile(50));
+    session_meta("capture_interval_ms_max", g_interval_ms.max());
+    session_meta("capture_work_ms_p50", g_work_ms.percentile(50));
+    session_meta("capture_work_ms_p99", g_work_ms.percentile(99));
+}
+
+#else
+
+// Without the SDK there's never a camera, so capturing never starts and nothing
+// has to be handed to the stages.
+
+#include "verify.h"
+
+bool init_realsense(bool, bool)
+{
+    show_error("RealSense Error", "Built without the RealSense SDK, run with --no-camera.");
+    return false;
+}
+
+bool capture_ready() { return false; }
+void capture_start() {}
+void capture_stop() {}
+bool capture_intrinsics(Uint32, Intrinsics&) { return false; }
+bool capture_extrinsics(Uint32, Uint32, Extrinsics&) { return false; }
+void capture_add_stage(Stage*) {}
+
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+
+// The RealSense SDK stays behind these functions, so nothing else includes its
+// headers. Built with `NO_REALSENSE`, there's no SDK at all and no camera to be
+// found, which is enough for `--no-camera`.
+
+class Stage;
+
+// Gets the SDK ready for capturing what we need.
+// That's color and depth, and infrared too when `ir` is set.
+// When `record` is set, the SDK records everything into the session's `.rssdk` file.
+bool init_realsense(bool record, bool ir);
+
+// Whether `init_realsense` succeeded.
+bool capture_ready();
+
+// A separate thread for acquiring frames, otherwise we're LAGGY.
+// While it runs, it keeps the device clock in sync with `host_us` (see `clocksync.h`),
+// logs the mapping per frame into the session's `clock.csv` and the final model into its meta.
+// Stopping prints the frame intervals and the time spent per frame, and writes them into the meta.
+// Both do nothing without `init_realsense`.
+void capture_start();
+void capture_stop();
+
+// The calibration of one of the streams `init_realsense` enabled (`STREAM_COLOR`,
+// `STREAM_DEPTH` or `STREAM_IR` of `stage.h`), at the resolution it was enabled at.
+// Falls back to the device's bare focal length and principal point when the SDK
+// can't do better.
+bool capture_intrinsics(Uint32 stream, Intrinsics& out);
+
+// How to get from the camera of stream `from` to the one of `to`. False when the
+// SDK has no calibration for either of them.
+bool capture_extrinsics(Uint32 from, Uint32 to, Extrinsics& out);
+
+// Has the capture thread hand every frame's streams that `stage` wants to it while
+// capturing. `capture_start` starts the stages and `capture_stop` stops them again.
+// `stage` must outlive capturing; add them before `capture_start`.
+void capture_add_stage(Stage* stage);
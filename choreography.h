@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+
+// The "storylines" Mr.Point follows, as tables of keyframes which are checked at
+// compile-time. `trajectory.h` turns them into the path he's actually drawn along.
+
+// Positions are relative screen-coordinates, 0 being top/left and 1 being bottom/right.
+struct Point { double x, y; };
+
+// At time `t` (seconds), Mr.Point is at `x`,`y` and moves on in a straight line to the next one.
+struct Keyframe { double t, x, y; };
+
+inline double lerp(double t, double x0, double x1, double t0, double t1) { return x0 + (t - t0) / (t1 - t0) * (x1 - x0); }
+
+// Move along the screen border once.
+constexpr Keyframe BORDER_SWEEP[] = {
+    {  0, 0.01, 0.01 },
+    {  3, 0.99, 0.01 },
+    {  5, 0.99, 0.99 },
+    {  8, 0.01, 0.99 },
+    { 10, 0.01, 0.01 },
+};
+
+// Then zig-zag just like regular reading.
+constexpr Keyframe HORIZONTAL_ZIGZAG[] = {
+    {  0, 0.01, 0.01 }, {  4, 0.99, 0.01 },
+    {  5, 0.01, 0.20 }, {  9, 0.99, 0.20 },
+    { 10, 0.01, 0.40 }, { 14, 0.99, 0.40 },
+    { 15, 0.01, 0.60 }, { 19, 0.99, 0.60 },
+    { 20, 0.01, 0.80 }, { 24, 0.99, 0.80 },
+    { 25, 0.01, 0.99 }, { 29, 0.99, 0.99 },
+    { 30, 0.01, 0.01 },
+};
+
+// Then zig-zag vertically.
+constexpr Keyframe VERTICAL_ZIGZAG[] = {
+    {  0, 0.01, 0.01 }, {  4, 0.01, 0.99 },
+    {  5, 0.20, 0.01 }, {  9, 0.20, 0.99 },
+    { 10, 0.40, 0.01 }, { 14, 0.40, 0.99 },
+    { 15, 0.60, 0.01 }, { 19, 0.60, 0.99 },
+    { 20, 0.80, 0.01 }, { 24, 0.80, 0.99 },
+    { 25, 0.99, 0.01 }, { 29, 0.99, 0.99 },
+    { 30, 0.01, 0.01 },
+};
+
+// Compile-time checks, C++11-constexpr style so MSVC 2015 can do them too.
+namespace keyframes {
+    template<size_t N>
+    constexpr bool monotonic(const Keyframe (&k)[N], size_t i = 1) {
+        return i >= N || (k[i-1].t < k[i].t && monotonic(k, i + 1));
+    }
+
+    constexpr bool unit(double v) { return 0.0 <= v && v <= 1.0; }
+
+    template<size_t N>
+    constexpr bool on_screen(const Keyframe (&k)[N], size_t i = 0) {
+        return i >= N || (unit(k[i].x) && unit(k[i].y) && on_screen(k, i + 1));
+    }
+
+    template<size_t N>
+    constexpr double duration(const Keyframe (&k)[N]) { return k[N-1].t - k[0].t; }
+
+    template<size_t N, size_t M>
+    constexpr bool continues(const Keyframe (&a)[N], const Keyframe (&b)[M]) {
+        return a[N-1].x == b[0].x && a[N-1].y == b[0].y;
+    }
+}
+
+#define CHECK_KEYFRAMES(k) \
+    static_assert(keyframes::monotonic(k), #k ": keyframe times must be strictly increasing"); \
+    static_assert(keyframes::on_screen(k), #k ": keyframes must lie within [0,1]x[0,1]"); \
+    static_assert(k[0].t == 0, #k ": keyframes must start at t=0")
+
+CHECK_KEYFRAMES(BORDER_SWEEP);
+CHECK_KEYFRAMES(HORIZONTAL_ZIGZAG);
+CHECK_KEYFRAMES(VERTICAL_ZIGZAG);
+
+static_assert(keyframes::continues(BORDER_SWEEP, HORIZONTAL_ZIGZAG), "Mr.Point mustn't jump between paradigms");
+static_assert(keyframes::continues(HORIZONTAL_ZIGZAG, VERTICAL_ZIGZAG), "Mr.Point mustn't jump between paradigms");
+
+// When each paradigm ends within the standard choreography.
+constexpr double BORDER_SWEEP_END = keyframes::duration(BORDER_SWEEP);
+constexpr double HORIZONTAL_ZIGZAG_END = BORDER_SWEEP_END + keyframes::duration(HORIZONTAL_ZIGZAG);
+constexpr double STANDARD_DURATION = HORIZONTAL_ZIGZAG_END + keyframes::duration(VERTICAL_ZIGZAG);
+static_assert(STANDARD_DURATION == 70, "The standard choreography is supposed to take 70 seconds");
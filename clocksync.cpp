@@ -0,0 +1,99 @@
+#include "clocksync.h"
+
+#include <algorithm>
+
+// At 30 fps that's about half a minute, long enough to see drift and short enough to follow it.
+static const size_t WINDOW = 1024;
+static const size_t MIN_PAIRS = 16;
+
+ClockSync::ClockSync()
+{
+    reset();
+}
+
+void ClockSync::reset()
+{
+    m_window.clear();
+    m_window.reserve(WINDOW);
+    m_scratch.reserve(WINDOW);
+    m_next = m_seen = 0;
+    m_device0 = m_host0 = 0;
+    m_offset = 0.0;
+    m_scale = 1.0;
+}
+
+void ClockSync::add(Sint64 device_us, Sint64 host_us)
+{
+    // Everything is kept relative to the first pair so that doubles keep microsecond precision.
+    if (m_seen == 0) {
+        m_device0 = device_us;
+        m_host0 = host_us;
+    }
+
+    Pair p = { double(device_us - m_device0), double(host_us - m_host0) };
+    if (m_window.size() < WINDOW)
+        m_window.push_back(p);
+    else
+        m_window[m_next] = p;
+    m_next = (m_next + 1) % WINDOW;
+    ++m_seen;
+
+    fit();
+}
+
+bool ClockSync::valid() const
+{
+    return m_window.size() >= MIN_PAIRS;
+}
+
+Sint64 ClockSync::to_host(Sint64 device_us) const
+{
+    return m_host0 + Sint64(m_offset + double(device_us - m_device0) * m_scale);
+}
+
+// Least-squares fit of h = a + b*d over the given pairs, with d centered for stability.
+template<typename It>
+static void linfit(It begin, It end, double& a, double& b)
+{
+    double n = 0, md = 0, mh = 0;
+    for (It it = begin; it != end; ++it) {
+        md += it->d;
+        mh += it->h;
+        ++n;
+    }
+    md /= n;
+    mh /= n;
+
+    double sdd = 0, sdh = 0;
+    for (It it = begin; it != end; ++it) {
+        sdd += (it->d - md) * (it->d - md);
+        sdh += (it->d - md) * (it->h - mh);
+    }
+
+    // With (almost) no spread in device time, there's no way to tell the slope.
+    b = sdd > 1.0 ? sdh / sdd : 1.0;
+    a = mh - b*md;
+}
+
+void ClockSync::fit()
+{
+    if (!valid())
+        return;
+
+    double a, b;
+    linfit(m_window.begin(), m_window.end(), a, b);
+
+    // Keep only the pairs with the least delay, and fit again to those.
+    struct ByResidual {
+        double a, b;
+        bool operator()(const Pair& x, const Pair& y) const { return x.h - (a + b*x.d) < y.h - (a + b*y.d); }
+    } by_residual = { a, b };
+
+    m_scratch.assign(m_window.begin(), m_window.end());
+    std::vector<Pair>::iterator quarter = m_scratch.begin() + m_scratch.size()/4;
+    std::nth_element(m_scratch.begin(), quarter, m_scratch.end(), by_residual);
+    linfit(m_scratch.begin(), quarter, a, b);
+
+    m_offset = a;
+    m_scale = b;
+}
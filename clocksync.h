@@ -0,0 +1,45 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+#include <vector>
+
+// Relates the camera's own timestamps to our host clock (`host_us`).
+//
+// Every frame gives us a pair (device time, host arrival time). The arrival is
+// always later than the "true" host time by some transport and scheduling delay
+// which is mostly small but sometimes huge. So we fit the line
+//   host = host0 + offset + (device - device0) * (1 + drift)
+// over a sliding window, first to all pairs, then again to only the quarter of
+// pairs with the smallest residuals. That hugs the lower envelope of the delays
+// and ignores the spikes. The constant part of the delay can't be observed from
+// timestamps alone, `--calibrate-latency` measures the whole pipeline for that.
+class ClockSync {
+public:
+    ClockSync();
+
+    void reset();
+    void add(Sint64 device_us, Sint64 host_us);
+
+    // Whether we've seen enough pairs for `to_host` to be any good.
+    bool valid() const;
+    Sint64 to_host(Sint64 device_us) const;
+
+    // The model, in the form described above.
+    Sint64 device0() const { return m_device0; }
+    Sint64 host0() const { return m_host0; }
+    double offset_us() const { return m_offset; }
+    double drift_ppm() const { return (m_scale - 1.0) * 1e6; }
+
+private:
+    void fit();
+
+    struct Pair { double d, h; };
+    std::vector<Pair> m_window;
+    std::vector<Pair> m_scratch;
+    size_t m_next;
+    size_t m_seen;
+
+    Sint64 m_device0, m_host0;
+    double m_offset, m_scale;
+};
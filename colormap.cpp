@@ -0,0 +1,129 @@
+#include "colormap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+void DepthColormap::init(Uint16 near, Uint16 far)
+{
+    near_mm = near;
+    far_mm = std::max<Uint16>(far, near + 1);
+    // Keep the range small enough for the 16 bit math not to overflow.
+    int range = std::min(far_mm - near_mm, 32767);
+    scale = Uint16(254 * 65536 / (range + 1));
+
+    lut[0] = 0xFF000000;
+    for (int i = 1; i < 256; ++i) {
+        // Hue from red (near) to blue (far), full saturation and value.
+        double h = 4.0 * (i - 1) / 254.0;
+        double f = h - std::floor(h);
+        Uint8 up = Uint8(255 * f), down = Uint8(255 * (1.0 - f));
+        Uint8 r, g, b;
+        switch (int(h)) {
+        case 0: r = 255; g = up; b = 0; break;
+        case 1: r = down; g = 255; b = 0; break;
+        case 2: r = 0; g = 255; b = up; break;
+        case 3: r = 0; g = down; b = 255; break;
+        default: r = 0; g = 0; b = 255; break;
+        }
+        lut[i] = 0xFF000000 | (Uint32(r) << 16) | (Uint32(g) << 8) | b;
+    }
+}
+
+static inline Uint8 depth_index(const DepthColormap& cm, Uint16 d)
+{
+    if (d == 0)
+        return 0;
+    int v = d > cm.near_mm ? d - cm.near_mm : 0;
+    v = std::min(v, std::min(cm.far_mm - cm.near_mm, 32767));
+    return Uint8(1 + ((v * cm.scale) >> 16));
+}
+
+void colormap_depth_scalar(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        argb[i] = cm.lut[depth_index(cm, depth[i])];
+}
+
+#ifdef HAVE_SSE2
+// The index math for 8 pixels at once, exactly as `depth_index`.
+static inline __m128i depth_index_sse2(__m128i d, __m128i near, __m128i range, __m128i scale, __m128i one)
+{
+    __m128i v = _mm_subs_epu16(d, near);
+    v = _mm_sub_epi16(v, _mm_subs_epu16(v, range));  // Unsigned min, which SSE2 lacks.
+    __m128i idx = _mm_add_epi16(_mm_mulhi_epu16(v, scale), one);
+    // No depth becomes index 0.
+    return _mm_andnot_si128(_mm_cmpeq_epi16(d, _mm_setzero_si128()), idx);
+}
+
+void colormap_depth_sse2(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n)
+{
+    const __m128i near = _mm_set1_epi16(short(cm.near_mm));
+    const __m128i range = _mm_set1_epi16(short(std::min(cm.far_mm - cm.near_mm, 32767)));
+    const __m128i scale = _mm_set1_epi16(short(cm.scale));
+    const __m128i one = _mm_set1_epi16(1);
+
+    // SSE2 has no gather, so the indices are computed in bulk and looked up one by one.
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(depth + i));
+        Uint16 idx[8];
+        _mm_storeu_si128((__m128i*)idx, depth_index_sse2(d, near, range, scale, one));
+        for (int k = 0; k < 8; ++k)
+            argb[i + k] = cm.lut[idx[k]];
+    }
+    colormap_depth_scalar(cm, depth + i, argb + i, n - i);
+}
+#else
+void colormap_depth_sse2(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n)
+{
+    colormap_depth_scalar(cm, depth, argb, n);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2
+void colormap_depth_avx2(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n)
+{
+    const __m256i near = _mm256_set1_epi16(short(cm.near_mm));
+    const __m256i range = _mm256_set1_epi16(short(std::min(cm.far_mm - cm.near_mm, 32767)));
+    const __m256i scale = _mm256_set1_epi16(short(cm.scale));
+    const __m256i one = _mm256_set1_epi16(1);
+    const int* lut = reinterpret_cast<const int*>(cm.lut);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(depth + i));
+        __m256i v = _mm256_min_epu16(_mm256_subs_epu16(d, near), range);
+        __m256i idx = _mm256_add_epi16(_mm256_mulhi_epu16(v, scale), one);
+        idx = _mm256_andnot_si256(_mm256_cmpeq_epi16(d, _mm256_setzero_si256()), idx);
+
+        // Widen to 32 bit indices, 8 per gather.
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(idx));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(idx, 1));
+        _mm256_storeu_si256((__m256i*)(argb + i), _mm256_i32gather_epi32(lut, lo, 4));
+        _mm256_storeu_si256((__m256i*)(argb + i + 8), _mm256_i32gather_epi32(lut, hi, 4));
+    }
+    colormap_depth_scalar(cm, depth + i, argb + i, n - i);
+}
+#else
+void colormap_depth_avx2(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n)
+{
+    colormap_depth_sse2(cm, depth, argb, n);
+}
+#endif
+
+void colormap_depth(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n)
+{
+    static const bool avx2 = cpu_has_avx2();
+    static const bool sse2 = SDL_HasSSE2() == SDL_TRUE;
+    if (avx2)
+        colormap_depth_avx2(cm, depth, argb, n);
+    else if (sse2)
+        colormap_depth_sse2(cm, depth, argb, n);
+    else
+        colormap_depth_scalar(cm, depth, argb, n);
+}
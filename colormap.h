@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include <SDL_stdinc.h>
+
+// Turns 16 bit depth (mm) into ARGB8888 colors for looking at.
+// Depths from `near` to `far` go from red over green to blue through a 256
+// entry table, closer and farther are clamped, and 0 (no depth) is black.
+struct DepthColormap {
+    Uint16 near_mm, far_mm;
+    Uint16 scale;      // Maps [0, far-near] to [0, 254] via `(v * scale) >> 16`.
+    Uint32 lut[256];   // lut[0] is for "no depth".
+
+    void init(Uint16 near_mm, Uint16 far_mm);
+};
+
+// Colormaps `n` pixels, using the best kernel the CPU supports.
+void colormap_depth(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n);
+
+// The individual kernels, for testing and benchmarking.
+void colormap_depth_scalar(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n);
+void colormap_depth_sse2(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n);
+void colormap_depth_avx2(const DepthColormap& cm, const Uint16* depth, Uint32* argb, size_t n);
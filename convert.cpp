@@ -0,0 +1,310 @@
+#include "convert.h"
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+// BT.601 in 13 bit fixed point. The inputs, less their offsets, go in 7 bits up
+// so that keeping the high 16 bits of each product, like _mm_mulhi_epi16 does,
+// leaves 4 bits of fraction and everything fits 16 bit lanes. Y 235 is 255.
+static const int COEF_Y = 9539, COEF_RV = 13075, COEF_GU = 3209, COEF_GV = 6660, COEF_BU = 16525;
+static const int ROUND = 8, SHIFT = 4;
+
+static inline Uint8 clamp8(int v)
+{
+    return Uint8(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// The high half of a 16 by 16 bit product, rounding down like the SIMD ones.
+static inline int mulhi(int a, int b)
+{
+    return (a*b) >> 16;
+}
+
+static inline void yuv_pixel(int y, int u, int v, Uint8* out)
+{
+    int c = mulhi((y - 16) << 7, COEF_Y) + ROUND, d = (u - 128) << 7, e = (v - 128) << 7;
+    out[0] = clamp8((c + mulhi(d, COEF_BU)) >> SHIFT);
+    out[1] = clamp8((c - mulhi(d, COEF_GU) - mulhi(e, COEF_GV)) >> SHIFT);
+    out[2] = clamp8((c + mulhi(e, COEF_RV)) >> SHIFT);
+    out[3] = 255;
+}
+
+// The scalar rows, from pixel `from` on, which the other kernels finish their rows with.
+
+static void yuy2_to_bgra_row(const Uint8* src, Uint8* dst, int from, int width)
+{
+    for (int i = from; i < width; i += 2) {
+        const Uint8* p = src + 2*i;
+        yuv_pixel(p[0], p[1], p[3], dst + 4*i);
+        yuv_pixel(p[2], p[1], p[3], dst + 4*i + 4);
+    }
+}
+
+static void nv12_to_bgra_row(const Uint8* y, const Uint8* uv, Uint8* dst, int from, int width)
+{
+    for (int i = from; i < width; i += 2) {
+        yuv_pixel(y[i], uv[i], uv[i+1], dst + 4*i);
+        yuv_pixel(y[i+1], uv[i], uv[i+1], dst + 4*i + 4);
+    }
+}
+
+void yuy2_to_bgra_scalar(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    for (int r = 0; r < height; ++r)
+        yuy2_to_bgra_row(src + r*src_pitch, dst + r*dst_pitch, 0, width);
+}
+
+void nv12_to_bgra_scalar(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                         Uint8* dst, int dst_pitch)
+{
+    for (int r = 0; r < height; ++r)
+        nv12_to_bgra_row(y + r*y_pitch, uv + r/2*uv_pitch, dst + r*dst_pitch, 0, width);
+}
+
+#ifdef HAVE_SSE2
+// 8 pixels from their Y and U V U V ... in 16 bits each.
+static inline void yuv_to_bgra_sse2(__m128i y, __m128i uv, Uint8* dst)
+{
+    // Each U V pair is shared by two pixels, which is a 32 bit lane.
+    __m128i u = _mm_and_si128(uv, _mm_set1_epi32(0xffff));
+    __m128i v = _mm_srli_epi32(uv, 16);
+    u = _mm_slli_epi16(_mm_sub_epi16(_mm_or_si128(u, _mm_slli_epi32(u, 16)), _mm_set1_epi16(128)), 7);
+    v = _mm_slli_epi16(_mm_sub_epi16(_mm_or_si128(v, _mm_slli_epi32(v, 16)), _mm_set1_epi16(128)), 7);
+    __m128i c = _mm_add_epi16(_mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), 7),
+                                              _mm_set1_epi16(COEF_Y)),
+                              _mm_set1_epi16(ROUND));
+
+    __m128i b = _mm_srai_epi16(_mm_add_epi16(c, _mm_mulhi_epi16(u, _mm_set1_epi16(COEF_BU))), SHIFT);
+    __m128i g = _mm_srai_epi16(_mm_sub_epi16(_mm_sub_epi16(c, _mm_mulhi_epi16(u, _mm_set1_epi16(COEF_GU))),
+                                             _mm_mulhi_epi16(v, _mm_set1_epi16(COEF_GV))), SHIFT);
+    __m128i r = _mm_srai_epi16(_mm_add_epi16(c, _mm_mulhi_epi16(v, _mm_set1_epi16(COEF_RV))), SHIFT);
+
+    __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+    __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_set1_epi8(-1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi16(bg, ra));
+}
+
+void yuy2_to_bgra_sse2(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    const __m128i low = _mm_set1_epi16(0xff);
+    for (int r = 0; r < height; ++r) {
+        const Uint8* s = src + r*src_pitch;
+        Uint8* d = dst + r*dst_pitch;
+        int i = 0;
+        for (; i + 8 <= width; i += 8) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 2*i));
+            yuv_to_bgra_sse2(_mm_and_si128(p, low), _mm_srli_epi16(p, 8), d + 4*i);
+        }
+        yuy2_to_bgra_row(s, d, i, width);
+    }
+}
+
+void nv12_to_bgra_sse2(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch)
+{
+    const __m128i zero = _mm_setzero_si128();
+    for (int r = 0; r < height; ++r) {
+        const Uint8* sy = y + r*y_pitch;
+        const Uint8* suv = uv + r/2*uv_pitch;
+        Uint8* d = dst + r*dst_pitch;
+        int i = 0;
+        for (; i + 8 <= width; i += 8) {
+            __m128i py = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(sy + i)), zero);
+            __m128i puv = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(suv + i)), zero);
+            yuv_to_bgra_sse2(py, puv, d + 4*i);
+        }
+        nv12_to_bgra_row(sy, suv, d, i, width);
+    }
+}
+
+#else
+void yuy2_to_bgra_sse2(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    yuy2_to_bgra_scalar(src, src_pitch, width, height, dst, dst_pitch);
+}
+
+void nv12_to_bgra_sse2(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch)
+{
+    nv12_to_bgra_scalar(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+}
+
+#endif
+
+#ifdef HAVE_AVX2
+// 16 pixels, 0-7 in the low 128 bit lane and 8-15 in the high one, like `yuv_to_bgra_sse2`.
+TARGET_AVX2 static inline void yuv_to_bgra_avx2(__m256i y, __m256i uv, Uint8* dst)
+{
+    __m256i u = _mm256_and_si256(uv, _mm256_set1_epi32(0xffff));
+    __m256i v = _mm256_srli_epi32(uv, 16);
+    u = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_or_si256(u, _mm256_slli_epi32(u, 16)), _mm256_set1_epi16(128)), 7);
+    v = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_or_si256(v, _mm256_slli_epi32(v, 16)), _mm256_set1_epi16(128)), 7);
+    __m256i c = _mm256_add_epi16(_mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), 7),
+                                                    _mm256_set1_epi16(COEF_Y)),
+                                 _mm256_set1_epi16(ROUND));
+
+    __m256i b = _mm256_srai_epi16(_mm256_add_epi16(c, _mm256_mulhi_epi16(u, _mm256_set1_epi16(COEF_BU))), SHIFT);
+    __m256i g = _mm256_srai_epi16(_mm256_sub_epi16(_mm256_sub_epi16(c, _mm256_mulhi_epi16(u, _mm256_set1_epi16(COEF_GU))),
+                                                   _mm256_mulhi_epi16(v, _mm256_set1_epi16(COEF_GV))), SHIFT);
+    __m256i r = _mm256_srai_epi16(_mm256_add_epi16(c, _mm256_mulhi_epi16(v, _mm256_set1_epi16(COEF_RV))), SHIFT);
+
+    // Interleaving works per lane as well, which leaves pixels 0-3 8-11 and 4-7 12-15.
+    __m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+    __m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_set1_epi8(-1));
+    __m256i lo = _mm256_unpacklo_epi16(bg, ra), hi = _mm256_unpackhi_epi16(bg, ra);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+TARGET_AVX2 void yuy2_to_bgra_avx2(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    const __m256i low = _mm256_set1_epi16(0xff);
+    for (int r = 0; r < height; ++r) {
+        const Uint8* s = src + r*src_pitch;
+        Uint8* d = dst + r*dst_pitch;
+        int i = 0;
+        for (; i + 16 <= width; i += 16) {
+            __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 2*i));
+            yuv_to_bgra_avx2(_mm256_and_si256(p, low), _mm256_srli_epi16(p, 8), d + 4*i);
+        }
+        yuy2_to_bgra_row(s, d, i, width);
+    }
+}
+
+TARGET_AVX2 void nv12_to_bgra_avx2(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                                   Uint8* dst, int dst_pitch)
+{
+    for (int r = 0; r < height; ++r) {
+        const Uint8* sy = y + r*y_pitch;
+        const Uint8* suv = uv + r/2*uv_pitch;
+        Uint8* d = dst + r*dst_pitch;
+        int i = 0;
+        for (; i + 16 <= width; i += 16) {
+            __m256i py = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(sy + i)));
+            __m256i puv = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(suv + i)));
+            yuv_to_bgra_avx2(py, puv, d + 4*i);
+        }
+        nv12_to_bgra_row(sy, suv, d, i, width);
+    }
+}
+
+#else
+void yuy2_to_bgra_avx2(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    yuy2_to_bgra_sse2(src, src_pitch, width, height, dst, dst_pitch);
+}
+
+void nv12_to_bgra_avx2(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch)
+{
+    nv12_to_bgra_sse2(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+}
+
+#endif
+
+#ifdef HAVE_NEON
+// 16 pixels, from their even and odd Y and the U and V they share. vqdmulh doubles
+// the product, so the inputs go only 6 bits up for the same high halves.
+static inline void yuv_to_bgra_neon(uint8x8_t y_even, uint8x8_t y_odd, uint8x8_t u8, uint8x8_t v8, Uint8* dst)
+{
+    int16x8_t u = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u8)), vdupq_n_s16(128)), 6);
+    int16x8_t v = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v8)), vdupq_n_s16(128)), 6);
+    int16x8_t bu = vqdmulhq_n_s16(u, COEF_BU), rv = vqdmulhq_n_s16(v, COEF_RV);
+    int16x8_t guv = vaddq_s16(vqdmulhq_n_s16(u, COEF_GU), vqdmulhq_n_s16(v, COEF_GV));
+
+    uint8x8_t b[2], g[2], r[2];
+    uint8x8_t ys[2] = { y_even, y_odd };
+    for (int k = 0; k < 2; ++k) {
+        int16x8_t c = vshlq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(ys[k])), vdupq_n_s16(16)), 6);
+        c = vaddq_s16(vqdmulhq_n_s16(c, COEF_Y), vdupq_n_s16(ROUND));
+        b[k] = vqshrun_n_s16(vaddq_s16(c, bu), SHIFT);
+        g[k] = vqshrun_n_s16(vsubq_s16(c, guv), SHIFT);
+        r[k] = vqshrun_n_s16(vaddq_s16(c, rv), SHIFT);
+    }
+
+    uint8x8x2_t bz = vzip_u8(b[0], b[1]), gz = vzip_u8(g[0], g[1]), rz = vzip_u8(r[0], r[1]);
+    uint8x8_t a = vdup_n_u8(255);
+    for (int k = 0; k < 2; ++k) {
+        uint8x8x4_t px = { { bz.val[k], gz.val[k], rz.val[k], a } };
+        vst4_u8(dst + 32*k, px);
+    }
+}
+
+void yuy2_to_bgra_neon(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    for (int r = 0; r < height; ++r) {
+        const Uint8* s = src + r*src_pitch;
+        Uint8* d = dst + r*dst_pitch;
+        int i = 0;
+        for (; i + 16 <= width; i += 16) {
+            uint8x8x4_t p = vld4_u8(s + 2*i);  // Y0, U, Y1, V of 8 pairs.
+            yuv_to_bgra_neon(p.val[0], p.val[2], p.val[1], p.val[3], d + 4*i);
+        }
+        yuy2_to_bgra_row(s, d, i, width);
+    }
+}
+
+void nv12_to_bgra_neon(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch)
+{
+    for (int r = 0; r < height; ++r) {
+        const Uint8* sy = y + r*y_pitch;
+        const Uint8* suv = uv + r/2*uv_pitch;
+        Uint8* d = dst + r*dst_pitch;
+        int i = 0;
+        for (; i + 16 <= width; i += 16) {
+            uint8x8x2_t py = vld2_u8(sy + i), puv = vld2_u8(suv + i);
+            yuv_to_bgra_neon(py.val[0], py.val[1], puv.val[0], puv.val[1], d + 4*i);
+        }
+        nv12_to_bgra_row(sy, suv, d, i, width);
+    }
+}
+
+#else
+void yuy2_to_bgra_neon(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+    yuy2_to_bgra_scalar(src, src_pitch, width, height, dst, dst_pitch);
+}
+
+void nv12_to_bgra_neon(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch)
+{
+    nv12_to_bgra_scalar(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+}
+
+#endif
+
+// On ARM there's always NEON, everywhere else the best of AVX2, SSE2 and scalar.
+
+void yuy2_to_bgra(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch)
+{
+#if defined(HAVE_NEON)
+    yuy2_to_bgra_neon(src, src_pitch, width, height, dst, dst_pitch);
+#else
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        yuy2_to_bgra_avx2(src, src_pitch, width, height, dst, dst_pitch);
+    else if (SDL_HasSSE2())
+        yuy2_to_bgra_sse2(src, src_pitch, width, height, dst, dst_pitch);
+    else
+        yuy2_to_bgra_scalar(src, src_pitch, width, height, dst, dst_pitch);
+#endif
+}
+
+void nv12_to_bgra(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                  Uint8* dst, int dst_pitch)
+{
+#if defined(HAVE_NEON)
+    nv12_to_bgra_neon(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+#else
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        nv12_to_bgra_avx2(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+    else if (SDL_HasSSE2())
+        nv12_to_bgra_sse2(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+    else
+        nv12_to_bgra_scalar(y, y_pitch, uv, uv_pitch, width, height, dst, dst_pitch);
+#endif
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+// Converts the color camera's native pixel formats into ours, so the SDK doesn't
+// have to: to BGRA (`FRAME_BGRA`, the SDK's RGB32).
+//
+// YUY2 and NV12 are BT.601 with Y in 16..235, as the camera delivers them, and
+// come out full range. Widths need to be even, and NV12's heights too. Pitches are
+// in bytes. Each function uses the best kernel the CPU supports.
+
+void yuy2_to_bgra(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch);
+void nv12_to_bgra(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                  Uint8* dst, int dst_pitch);
+
+// Gray as GRAY_WEIGHT_R R + GRAY_WEIGHT_G G + GRAY_WEIGHT_B B, which is 256 times
+// the luma (0.30 R + 0.59 G + 0.11 B). The stages that look at gray fold it into
+// their own passes over the BGRA frame.
+static const int GRAY_WEIGHT_R = 77, GRAY_WEIGHT_G = 150, GRAY_WEIGHT_B = 29;
+
+// The individual kernels, for testing and benchmarking.
+void yuy2_to_bgra_scalar(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch);
+void yuy2_to_bgra_sse2(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch);
+void yuy2_to_bgra_avx2(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch);
+void yuy2_to_bgra_neon(const Uint8* src, int src_pitch, int width, int height, Uint8* dst, int dst_pitch);
+void nv12_to_bgra_scalar(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                         Uint8* dst, int dst_pitch);
+void nv12_to_bgra_sse2(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch);
+void nv12_to_bgra_avx2(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch);
+void nv12_to_bgra_neon(const Uint8* y, int y_pitch, const Uint8* uv, int uv_pitch, int width, int height,
+                       Uint8* dst, int dst_pitch);
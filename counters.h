@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+
+#include <SDL_stdinc.h>
+
+// Counters the pipeline's threads bump as they go, for the `PerfHud` to read a few
+// times a second. They're relaxed atomics: nobody ever waits on them, and a
+// reader seeing a count a frame late doesn't matter.
+struct PipelineCounters {
+    // Acquired by the capture thread, per stream.
+    std::atomic<Uint64> color_frames;
+    std::atomic<Uint64> depth_frames;
+    // Frames missing between the device's timestamps.
+    std::atomic<Uint64> dropped_frames;
+    // Our copies of frames that aren't back in their pool yet, see `frames.h`.
+    std::atomic<int> frames_in_flight;
+    // Frames waiting for pipeline stages, and dropped because a stage fell behind, see `stage.h`.
+    std::atomic<int> stage_queued;
+    std::atomic<Uint64> stage_dropped;
+    // Of those queued, the ones waiting for stages that never drop any, because
+    // they write the recording. More than `RECORDING_QUEUED_WARN` (a second's
+    // worth) is more than a disk hiccup, the disk can't keep up.
+    std::atomic<int> recording_queued;
+    // What's wrong with the participant's position right now (`QUALITY_*` flags),
+    // -1 while nobody's watching it. See `quality.h`.
+    std::atomic<int> quality_flags;
+    // Written by us through `SessionLog`, the SDK's recording not included.
+    std::atomic<Uint64> bytes_logged;
+    // The SDK's recording so far, and the free space on the sessions' disk (-1
+    // while unknown), in bytes, see `session_watch_start`.
+    std::atomic<long long> recording_bytes;
+    std::atomic<long long> disk_free;
+    // The stimulus display's frame rate, and frame times in microseconds, over
+    // the last quarter of a second or so, see `RenderStats`.
+    std::atomic<Uint32> render_fps_x10;
+    std::atomic<Uint32> render_p50_us, render_p99_us, render_max_us;
+
+    PipelineCounters()
+        : color_frames(0)
+        , depth_frames(0)
+        , dropped_frames(0)
+        , frames_in_flight(0)
+        , stage_queued(0)
+        , stage_dropped(0)
+        , recording_queued(0)
+        , quality_flags(-1)
+        , bytes_logged(0)
+        , recording_bytes(0)
+        , disk_free(-1)
+        , render_fps_x10(0)
+        , render_p50_us(0)
+        , render_p99_us(0)
+        , render_max_us(0)
+    {}
+};
+
+extern PipelineCounters g_counters;
+
+static const int RECORDING_QUEUED_WARN = 30;
+
+inline void count(std::atomic<Uint64>& counter, Uint64 n = 1)
+{
+    counter.fetch_add(n, std::memory_order_relaxed);
+}
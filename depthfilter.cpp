@@ -0,0 +1,391 @@
+#include "depthfilter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+// How far a neighbour may be from a pixel to be averaged with it, and how many
+// neighbours it takes to fill a hole.
+static const int SPATIAL_DELTA_MM = 15;
+static const int HOLE_MIN = 4;
+// How much a pixel may jump between frames before its average starts over, and
+// how much of each new frame goes into the average, out of 256.
+static const int TEMPORAL_DELTA_MM = 20;
+static const int ALPHA = 102;
+// A pixel missing now keeps its value if it was there in PERSIST of the last RING frames.
+static const int RING = 4, PERSIST = 2;
+
+// The vectorized kernels do exactly the same operations, so that all of them
+// agree to the bit.
+static inline Uint16 spatial_pixel(const Uint16* r0, const Uint16* r1, const Uint16* r2, int x)
+{
+    Uint16 c = r1[x];
+    Uint16 n[8] = { r0[x-1], r0[x], r0[x+1], r1[x-1], r1[x+1], r2[x-1], r2[x], r2[x+1] };
+
+    // A hole goes by the farthest neighbour.
+    Uint16 far = 0;
+    for (int i = 0; i < 8; ++i)
+        far = std::max(far, n[i]);
+    int ref = c ? c : far;
+
+    Uint32 sum = c;
+    int count = c ? 1 : 0;
+    for (int i = 0; i < 8; ++i) {
+        if (n[i] && std::abs(int(n[i]) - ref) <= SPATIAL_DELTA_MM) {
+            sum += n[i];
+            ++count;
+        }
+    }
+    if (!c && count < HOLE_MIN)
+        return 0;
+    return Uint16(float(sum) / float(count) + 0.5f);
+}
+
+// Pixels `x0` to the last but one of row `y`.
+static void spatial_row(const Uint16* in, Uint16* out, int w, int y, int x0)
+{
+    const Uint16* r1 = in + size_t(y)*w;
+    for (int x = x0; x < w - 1; ++x)
+        out[size_t(y)*w + x] = spatial_pixel(r1 - w, r1, r1 + w, x);
+    out[size_t(y)*w] = r1[0];
+    out[size_t(y)*w + w - 1] = r1[w - 1];
+}
+
+// The first and last rows, and everything if there's no inside.
+static bool spatial_border(const Uint16* in, Uint16* out, int w, int h)
+{
+    if (w < 3 || h < 3) {
+        std::memcpy(out, in, size_t(w)*h*sizeof(Uint16));
+        return false;
+    }
+    std::memcpy(out, in, w*sizeof(Uint16));
+    std::memcpy(out + size_t(h - 1)*w, in + size_t(h - 1)*w, w*sizeof(Uint16));
+    return true;
+}
+
+void filter_depth_spatial_scalar(const Uint16* in, Uint16* out, int w, int h)
+{
+    if (!spatial_border(in, out, w, h))
+        return;
+    for (int y = 1; y < h - 1; ++y)
+        spatial_row(in, out, w, y, 1);
+}
+
+#ifdef HAVE_SSE2
+void filter_depth_spatial_sse2(const Uint16* in, Uint16* out, int w, int h)
+{
+    if (!spatial_border(in, out, w, h))
+        return;
+
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1), all = _mm_set1_epi16(-1);
+    const __m128i delta = _mm_set1_epi16(SPATIAL_DELTA_MM), hole_min = _mm_set1_epi16(HOLE_MIN - 1);
+    // SSE2 only has signed 16 bit maximums and packing, so shift into that range and back.
+    const __m128i flip = _mm_set1_epi16(-32768), bias = _mm_set1_epi32(32768);
+    const __m128 half = _mm_set1_ps(0.5f);
+
+    for (int y = 1; y < h - 1; ++y) {
+        const Uint16* r1 = in + size_t(y)*w;
+        const Uint16* r0 = r1 - w;
+        const Uint16* r2 = r1 + w;
+        int x = 1;
+        for (; x + 8 <= w - 1; x += 8) {
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x));
+            __m128i n[8] = {
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x - 1)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + x + 1)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x - 1)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + x + 1)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x - 1)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + x + 1)),
+            };
+
+            __m128i far = _mm_xor_si128(n[0], flip);
+            for (int i = 1; i < 8; ++i)
+                far = _mm_max_epi16(far, _mm_xor_si128(n[i], flip));
+            far = _mm_xor_si128(far, flip);
+            __m128i hole = _mm_cmpeq_epi16(c, zero);
+            __m128i ref = _mm_or_si128(_mm_and_si128(hole, far), _mm_andnot_si128(hole, c));
+
+            __m128i count = _mm_andnot_si128(hole, one);
+            __m128i sum_lo = _mm_unpacklo_epi16(c, zero), sum_hi = _mm_unpackhi_epi16(c, zero);
+            for (int i = 0; i < 8; ++i) {
+                __m128i diff = _mm_or_si128(_mm_subs_epu16(n[i], ref), _mm_subs_epu16(ref, n[i]));
+                __m128i near = _mm_andnot_si128(_mm_cmpeq_epi16(n[i], zero), _mm_cmpeq_epi16(_mm_subs_epu16(diff, delta), zero));
+                __m128i v = _mm_and_si128(n[i], near);
+                sum_lo = _mm_add_epi32(sum_lo, _mm_unpacklo_epi16(v, zero));
+                sum_hi = _mm_add_epi32(sum_hi, _mm_unpackhi_epi16(v, zero));
+                count = _mm_sub_epi16(count, near);
+            }
+
+            __m128i ok = _mm_or_si128(_mm_andnot_si128(hole, all), _mm_cmpgt_epi16(count, hole_min));
+            __m128 mean_lo = _mm_add_ps(_mm_div_ps(_mm_cvtepi32_ps(sum_lo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(count, zero))), half);
+            __m128 mean_hi = _mm_add_ps(_mm_div_ps(_mm_cvtepi32_ps(sum_hi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(count, zero))), half);
+            __m128i mean = _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(mean_lo), bias), _mm_sub_epi32(_mm_cvttps_epi32(mean_hi), bias));
+            mean = _mm_xor_si128(mean, flip);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + size_t(y)*w + x), _mm_and_si128(mean, ok));
+        }
+        spatial_row(in, out, w, y, x);
+    }
+}
+#else
+void filter_depth_spatial_sse2(const Uint16* in, Uint16* out, int w, int h)
+{
+    filter_depth_spatial_scalar(in, out, w, h);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void filter_depth_spatial_avx2(const Uint16* in, Uint16* out, int w, int h)
+{
+    if (!spatial_border(in, out, w, h))
+        return;
+
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1), all = _mm256_set1_epi16(-1);
+    const __m256i delta = _mm256_set1_epi16(SPATIAL_DELTA_MM), hole_min = _mm256_set1_epi16(HOLE_MIN - 1);
+    const __m256 half = _mm256_set1_ps(0.5f);
+
+    for (int y = 1; y < h - 1; ++y) {
+        const Uint16* r1 = in + size_t(y)*w;
+        const Uint16* r0 = r1 - w;
+        const Uint16* r2 = r1 + w;
+        int x = 1;
+        for (; x + 16 <= w - 1; x += 16) {
+            __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x));
+            __m256i n[8] = {
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x - 1)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + x + 1)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x - 1)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + x + 1)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x - 1)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r2 + x + 1)),
+            };
+
+            __m256i far = n[0];
+            for (int i = 1; i < 8; ++i)
+                far = _mm256_max_epu16(far, n[i]);
+            __m256i hole = _mm256_cmpeq_epi16(c, zero);
+            __m256i ref = _mm256_blendv_epi8(c, far, hole);
+
+            __m256i count = _mm256_andnot_si256(hole, one);
+            __m256i sum_lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(c));
+            __m256i sum_hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(c, 1));
+            for (int i = 0; i < 8; ++i) {
+                __m256i diff = _mm256_or_si256(_mm256_subs_epu16(n[i], ref), _mm256_subs_epu16(ref, n[i]));
+                __m256i near = _mm256_andnot_si256(_mm256_cmpeq_epi16(n[i], zero), _mm256_cmpeq_epi16(_mm256_subs_epu16(diff, delta), zero));
+                __m256i v = _mm256_and_si256(n[i], near);
+                sum_lo = _mm256_add_epi32(sum_lo, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+                sum_hi = _mm256_add_epi32(sum_hi, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+                count = _mm256_sub_epi16(count, near);
+            }
+
+            __m256i ok = _mm256_or_si256(_mm256_andnot_si256(hole, all), _mm256_cmpgt_epi16(count, hole_min));
+            __m256 count_lo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(count)));
+            __m256 count_hi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(count, 1)));
+            __m256i mean_lo = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_div_ps(_mm256_cvtepi32_ps(sum_lo), count_lo), half));
+            __m256i mean_hi = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_div_ps(_mm256_cvtepi32_ps(sum_hi), count_hi), half));
+            // Packing works per 128 bit lane, so the halves need putting back in order.
+            __m256i mean = _mm256_permute4x64_epi64(_mm256_packus_epi32(mean_lo, mean_hi), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + size_t(y)*w + x), _mm256_and_si256(mean, ok));
+        }
+        spatial_row(in, out, w, y, x);
+    }
+}
+#else
+void filter_depth_spatial_avx2(const Uint16* in, Uint16* out, int w, int h)
+{
+    filter_depth_spatial_sse2(in, out, w, h);
+}
+#endif
+
+// Pixels `begin` to `end`.
+static void temporal_range(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i) {
+        int xi = x[i], p = prev[i];
+        if (xi && p && std::abs(xi - p) <= TEMPORAL_DELTA_MM) {
+            out[i] = Uint16(p + (((xi - p)*ALPHA + 128) >> 8));
+        } else if (xi) {
+            out[i] = Uint16(xi);
+        } else {
+            int seen = 0;
+            for (int k = 0; k < ring_n; ++k)
+                seen += ring[k][i] != 0;
+            out[i] = seen >= PERSIST ? Uint16(p) : 0;
+        }
+    }
+}
+
+void filter_depth_temporal_scalar(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n)
+{
+    temporal_range(x, prev, ring, ring_n, out, 0, n);
+}
+
+// The average's step is d*ALPHA/256, rounded. `madd` gets that in one go from d
+// interleaved with 1s, and ALPHA interleaved with the 128 for rounding.
+#ifdef HAVE_SSE2
+void filter_depth_temporal_sse2(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+    const __m128i delta = _mm_set1_epi16(TEMPORAL_DELTA_MM);
+    const __m128i alpha = _mm_set1_epi32((128 << 16) | ALPHA);
+    // Held if it was missing in at most this many of the ring's frames.
+    const __m128i held_max = _mm_set1_epi16(Sint16(ring_n - PERSIST + 1));
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i pv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        __m128i missing = _mm_cmpeq_epi16(xv, zero);
+
+        __m128i diff = _mm_or_si128(_mm_subs_epu16(xv, pv), _mm_subs_epu16(pv, xv));
+        __m128i close = _mm_andnot_si128(_mm_or_si128(missing, _mm_cmpeq_epi16(pv, zero)), _mm_cmpeq_epi16(_mm_subs_epu16(diff, delta), zero));
+        __m128i d = _mm_sub_epi16(xv, pv);
+        __m128i step_lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(d, one), alpha), 8);
+        __m128i step_hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(d, one), alpha), 8);
+        __m128i average = _mm_add_epi16(pv, _mm_packs_epi32(step_lo, step_hi));
+
+        // Most pixels aren't missing, and then the ring needn't be read at all.
+        __m128i held = zero;
+        if (_mm_movemask_epi8(missing)) {
+            __m128i gone = zero;
+            for (int k = 0; k < ring_n; ++k)
+                gone = _mm_sub_epi16(gone, _mm_cmpeq_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ring[k] + i)), zero));
+            held = _mm_and_si128(pv, _mm_cmpgt_epi16(held_max, gone));
+        }
+
+        __m128i other = _mm_or_si128(_mm_and_si128(missing, held), _mm_andnot_si128(missing, xv));
+        __m128i result = _mm_or_si128(_mm_and_si128(close, average), _mm_andnot_si128(close, other));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    temporal_range(x, prev, ring, ring_n, out, i, n);
+}
+#else
+void filter_depth_temporal_sse2(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n)
+{
+    filter_depth_temporal_scalar(x, prev, ring, ring_n, out, n);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void filter_depth_temporal_avx2(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1);
+    const __m256i delta = _mm256_set1_epi16(TEMPORAL_DELTA_MM);
+    const __m256i alpha = _mm256_set1_epi32((128 << 16) | ALPHA);
+    const __m256i held_max = _mm256_set1_epi16(Sint16(ring_n - PERSIST + 1));
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+        __m256i pv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev + i));
+        __m256i missing = _mm256_cmpeq_epi16(xv, zero);
+
+        __m256i diff = _mm256_or_si256(_mm256_subs_epu16(xv, pv), _mm256_subs_epu16(pv, xv));
+        __m256i close = _mm256_andnot_si256(_mm256_or_si256(missing, _mm256_cmpeq_epi16(pv, zero)), _mm256_cmpeq_epi16(_mm256_subs_epu16(diff, delta), zero));
+        // Unpacking and packing both work per 128 bit lane, so the order comes out right.
+        __m256i d = _mm256_sub_epi16(xv, pv);
+        __m256i step_lo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(d, one), alpha), 8);
+        __m256i step_hi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(d, one), alpha), 8);
+        __m256i average = _mm256_add_epi16(pv, _mm256_packs_epi32(step_lo, step_hi));
+
+        __m256i held = zero;
+        if (_mm256_movemask_epi8(missing)) {
+            __m256i gone = zero;
+            for (int k = 0; k < ring_n; ++k)
+                gone = _mm256_sub_epi16(gone, _mm256_cmpeq_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ring[k] + i)), zero));
+            held = _mm256_and_si256(pv, _mm256_cmpgt_epi16(held_max, gone));
+        }
+
+        __m256i other = _mm256_blendv_epi8(xv, held, missing);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_blendv_epi8(other, average, close));
+    }
+    temporal_range(x, prev, ring, ring_n, out, i, n);
+}
+#else
+void filter_depth_temporal_avx2(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n)
+{
+    filter_depth_temporal_sse2(x, prev, ring, ring_n, out, n);
+}
+#endif
+
+void filter_depth_spatial(const Uint16* in, Uint16* out, int w, int h)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        filter_depth_spatial_avx2(in, out, w, h);
+    else if (SDL_HasSSE2())
+        filter_depth_spatial_sse2(in, out, w, h);
+    else
+        filter_depth_spatial_scalar(in, out, w, h);
+}
+
+void filter_depth_temporal(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        filter_depth_temporal_avx2(x, prev, ring, ring_n, out, n);
+    else if (SDL_HasSSE2())
+        filter_depth_temporal_sse2(x, prev, ring, ring_n, out, n);
+    else
+        filter_depth_temporal_scalar(x, prev, ring, ring_n, out, n);
+}
+
+DepthFilterStage::DepthFilterStage()
+    : Stage("depthfilter", STREAM_DEPTH, 0)
+{}
+
+void DepthFilterStage::begin()
+{
+    m_ring.clear();
+    m_filtered.reset();
+    m_stream.open("filtered_depth");
+}
+
+void DepthFilterStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    if (!depth)
+        return;
+    int w = depth->width, h = depth->height;
+
+    FramePtr spatial = m_pool.get(FRAME_DEPTH16, w, h);
+    filter_depth_spatial(depth->row<Uint16>(0), spatial->row<Uint16>(0), w, h);
+
+    FramePtr out = m_pool.get(FRAME_DEPTH16, w, h);
+    out->index = spatial->index = depth->index;
+    out->device_us = spatial->device_us = depth->device_us;
+    out->host_us = spatial->host_us = depth->host_us;
+    if (m_filtered && m_filtered->width == w && m_filtered->height == h) {
+        const Uint16* ring[RING];
+        int ring_n = 0;
+        for (const FramePtr& f : m_ring)
+            ring[ring_n++] = f->row<Uint16>(0);
+        filter_depth_temporal(spatial->row<Uint16>(0), m_filtered->row<Uint16>(0), ring, ring_n, out->row<Uint16>(0), size_t(w) * h);
+    } else {
+        // Nothing to average with yet.
+        m_ring.clear();
+        std::memcpy(out->pixels.data(), spatial->pixels.data(), out->pixels.size());
+    }
+
+    m_ring.push_back(spatial);
+    if (m_ring.size() > size_t(RING))
+        m_ring.pop_front();
+    m_filtered = out;
+    m_stream.write(*m_filtered);
+}
+
+void DepthFilterStage::end()
+{
+    m_stream.close();
+    // Back into the pool with them.
+    m_ring.clear();
+    m_filtered.reset();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+
+#include <SDL_stdinc.h>
+
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// Takes out the depth stream's flicker and fills its small holes, e.g. around the
+// eyes and glasses, in two passes:
+//
+// Spatially, each pixel becomes the mean of its 3x3 neighbourhood, counting only
+// the neighbours within a few millimeters of it, so that edges stay edges. A hole
+// is filled from its neighbours within a few millimeters of the farthest one, if
+// there are enough of them, so foreground doesn't grow into the background.
+//
+// Temporally, each pixel follows the spatially filtered frames with an exponential
+// moving average, which starts over when the depth jumps, so moving doesn't smear.
+// A pixel missing now keeps its last value if it was there in enough of the
+// previous few frames.
+
+// Spatial pass of a `w`x`h` frame from `in` into `out`, using the best kernel the
+// CPU supports. The outermost pixels are copied as they are.
+void filter_depth_spatial(const Uint16* in, Uint16* out, int w, int h);
+
+// Temporal pass of `n` pixels: `x` being the newest spatially filtered ones, `prev`
+// the last output and `ring` the `ring_n` previous spatially filtered frames. Uses
+// the best kernel the CPU supports.
+void filter_depth_temporal(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n);
+
+// The individual kernels, for testing and benchmarking.
+void filter_depth_spatial_scalar(const Uint16* in, Uint16* out, int w, int h);
+void filter_depth_spatial_sse2(const Uint16* in, Uint16* out, int w, int h);
+void filter_depth_spatial_avx2(const Uint16* in, Uint16* out, int w, int h);
+void filter_depth_temporal_scalar(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n);
+void filter_depth_temporal_sse2(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n);
+void filter_depth_temporal_avx2(const Uint16* x, const Uint16* prev, const Uint16* const* ring, int ring_n, Uint16* out, size_t n);
+
+// Filters every depth frame on a worker thread into `<session>.filtered_depth.frames`
+// (see `SessionStream`), next to the SDK's recording of the raw ones. It's a
+// recording, and the temporal filter assumes consecutive frames, so none are dropped.
+class DepthFilterStage : public Stage {
+public:
+    DepthFilterStage();
+
+    // Worker thread: the newest filtered frame, null before the first.
+    const FramePtr& filtered() const { return m_filtered; }
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    FramePool m_pool;
+    // The last few spatially filtered frames, newest at the back.
+    std::deque<FramePtr> m_ring;
+    FramePtr m_filtered;
+
+    SessionStream m_stream;
+};
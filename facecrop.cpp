@@ -0,0 +1,209 @@
+#include "facecrop.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Depths considered at all, and the histogram for finding the nearest blob.
+static const int MIN_MM = 200, MAX_MM = 2000, BIN_MM = 25;
+static const int BINS = (MAX_MM - MIN_MM) / BIN_MM;
+// Only every STEP-th pixel of every STEP-th row is looked at, which is plenty for finding a head.
+static const int STEP = 4;
+// How many of those it takes for a blob, a bit less than a hand's worth at arm's length.
+static const int MIN_SAMPLES = 20;
+// How deep a head is, and how tall, in millimeters.
+static const int HEAD_DEPTH_MM = 200;
+static const float HEAD_HEIGHT_MM = 250.0f;
+// The crop: the face plus some margin for moving about, in millimeters.
+static const float CROP_W_MM = 200.0f, CROP_H_MM = 250.0f;
+// How much of a new position is taken over per frame.
+static const float SMOOTHING = 0.5f;
+
+HeadTracker::HeadTracker(const Intrinsics& depth)
+    : m_intrinsics(depth)
+    , m_width(depth.width)
+    , m_height(depth.height)
+    , m_tracking(false)
+    , m_u(0.0f)
+    , m_v(0.0f)
+    , m_z(0.0f)
+{}
+
+bool HeadTracker::update(const Frame& depth)
+{
+    int w = m_width = depth.width, h = m_height = depth.height;
+    float fy = m_intrinsics.fy * h / m_intrinsics.height;
+
+    // Where to look: around the head if we have it, everywhere otherwise. A head
+    // doesn't move more than its own size between frames.
+    int x0 = 0, y0 = 0, x1 = w, y1 = h;
+    if (m_tracking) {
+        int r = int(1.5f * fy * HEAD_HEIGHT_MM / m_z);
+        x0 = std::max(0, int(m_u) - r);
+        x1 = std::min(w, int(m_u) + r);
+        y0 = std::max(0, int(m_v) - r);
+        y1 = std::min(h, int(m_v) + r);
+    }
+
+    // The nearest depth there's enough of.
+    int hist[BINS] = { 0 };
+    for (int y = y0; y < y1; y += STEP) {
+        const Uint16* row = depth.row<Uint16>(y);
+        for (int x = x0; x < x1; x += STEP) {
+            int d = row[x];
+            if (d >= MIN_MM && d < MAX_MM)
+                ++hist[(d - MIN_MM) / BIN_MM];
+        }
+    }
+    int bin = 0;
+    while (bin < BINS && hist[bin] < MIN_SAMPLES)
+        ++bin;
+    if (bin == BINS) {
+        m_tracking = false;
+        return false;
+    }
+    int near_mm = MIN_MM + bin*BIN_MM, far_mm = near_mm + HEAD_DEPTH_MM;
+
+    // The head is the top of that blob, as tall as a head is at that distance.
+    int top = -1;
+    for (int y = y0; y < y1 && top < 0; y += STEP) {
+        const Uint16* row = depth.row<Uint16>(y);
+        int n = 0;
+        for (int x = x0; x < x1; x += STEP)
+            n += row[x] >= near_mm && row[x] < far_mm;
+        if (n >= 2)
+            top = y;
+    }
+    if (top < 0) {
+        m_tracking = false;
+        return false;
+    }
+    int bottom = std::min(y1, top + int(fy * HEAD_HEIGHT_MM / (near_mm + 0.5f*HEAD_DEPTH_MM)));
+
+    long long sum_x = 0, sum_z = 0;
+    int n = 0;
+    for (int y = top; y < bottom; y += STEP) {
+        const Uint16* row = depth.row<Uint16>(y);
+        for (int x = x0; x < x1; x += STEP) {
+            if (row[x] >= near_mm && row[x] < far_mm) {
+                sum_x += x;
+                sum_z += row[x];
+                ++n;
+            }
+        }
+    }
+    if (n < MIN_SAMPLES / 2) {
+        m_tracking = false;
+        return false;
+    }
+
+    float u = float(sum_x) / n, z = float(sum_z) / n;
+    float v = top + 0.5f * fy * HEAD_HEIGHT_MM / z;
+    if (m_tracking) {
+        m_u += SMOOTHING * (u - m_u);
+        m_v += SMOOTHING * (v - m_v);
+        m_z += SMOOTHING * (z - m_z);
+    } else {
+        m_u = u;
+        m_v = v;
+        m_z = z;
+    }
+    m_tracking = true;
+    return true;
+}
+
+void HeadTracker::in_camera(const Intrinsics& camera, const Extrinsics& depth_to_camera, float& u, float& v, float& z) const
+{
+    float x, y, cx, cy, cz;
+    m_intrinsics.scaled(m_width, m_height).unproject(m_u, m_v, x, y);
+    depth_to_camera.apply(0.001f*m_z*x, 0.001f*m_z*y, 0.001f*m_z, cx, cy, cz);
+    camera.project(cx, cy, cz, u, v);
+    z = 1000.0f * cz;
+}
+
+FaceCropStage::FaceCropStage(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color,
+                             int keyframe_interval, bool ir)
+    : Stage("facecrop", STREAM_COLOR | STREAM_DEPTH | (ir ? STREAM_IR : 0), 0)
+    , m_depth(depth)
+    , m_color(color)
+    , m_extrinsics(depth_to_color)
+    , m_keyframe_interval(keyframe_interval)
+    , m_tracker(depth)
+    , m_frames(0)
+{}
+
+void FaceCropStage::begin()
+{
+    m_frames = 0;
+    m_log.open("face", "frame,host_us,keyframe,found,head_z_mm,"
+                       "depth_x,depth_y,depth_w,depth_h,color_x,color_y,color_w,color_h");
+    m_color_stream.open("face_color");
+    m_depth_stream.open("face_depth");
+    if (streams() & STREAM_IR)
+        m_ir_stream.open("face_ir");
+}
+
+SDL_Rect FaceCropStage::crop(const Intrinsics& camera, float u, float v, float z, int w, int h) const
+{
+    float sx = float(w) / camera.width, sy = float(h) / camera.height;
+    SDL_Rect r;
+    r.w = std::min(w, int(std::ceil(sx * camera.fx * CROP_W_MM / z)));
+    r.h = std::min(h, int(std::ceil(sy * camera.fy * CROP_H_MM / z)));
+    // Moved inside the frame rather than cut off, so it's always the same size at the same distance.
+    r.x = std::max(0, std::min(w - r.w, int(u - 0.5f*r.w)));
+    r.y = std::max(0, std::min(h - r.h, int(v - 0.5f*r.h)));
+    return r;
+}
+
+void FaceCropStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    const Frame* color = frames.color.get();
+    if (!depth || !color)
+        return;
+
+    bool found = m_tracker.update(*depth);
+    bool keyframe = !found || (m_keyframe_interval > 0 && m_frames % m_keyframe_interval == 0);
+    ++m_frames;
+
+    SDL_Rect d = { 0, 0, depth->width, depth->height };
+    SDL_Rect c = { 0, 0, color->width, color->height };
+    float z = found ? m_tracker.z() : 0.0f;
+    if (found) {
+        d = crop(m_depth, m_tracker.u(), m_tracker.v(), z, depth->width, depth->height);
+
+        // Where the head is as the color camera sees it.
+        Intrinsics in = m_color.scaled(color->width, color->height);
+        float cu, cv, cz;
+        m_tracker.in_camera(in, m_extrinsics, cu, cv, cz);
+        c = crop(in, cu, cv, cz, color->width, color->height);
+    }
+    m_log.row("%u,%lld,%d,%d,%.0f,%d,%d,%d,%d,%d,%d,%d,%d", depth->index, (long long)depth->host_us,
+              int(keyframe), int(found), z, d.x, d.y, d.w, d.h, c.x, c.y, c.w, c.h);
+
+    if (keyframe) {
+        m_color_stream.write(*color);
+        m_depth_stream.write(*depth);
+    } else {
+        m_color_stream.write(*color, c.x, c.y, c.w, c.h);
+        m_depth_stream.write(*depth, d.x, d.y, d.w, d.h);
+    }
+
+    const Frame* ir = frames.ir.get();
+    if (ir && m_ir_stream.is_open()) {
+        if (keyframe) {
+            m_ir_stream.write(*ir);
+        } else {
+            float sx = float(ir->width) / depth->width, sy = float(ir->height) / depth->height;
+            SDL_Rect i = crop(m_depth, sx * m_tracker.u(), sy * m_tracker.v(), z, ir->width, ir->height);
+            m_ir_stream.write(*ir, i.x, i.y, i.w, i.h);
+        }
+    }
+}
+
+void FaceCropStage::end()
+{
+    m_log.close();
+    m_color_stream.close();
+    m_depth_stream.close();
+    m_ir_stream.close();
+}
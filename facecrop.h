@@ -0,0 +1,69 @@
+#pragma once
+
+#include <SDL_rect.h>
+
+#include "calibration.h"
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// Finds the participant's head in depth frames: the nearest blob in front of the
+// camera, and the top of it. Once found, it only searches around where the head
+// was last, and smooths the head's position from frame to frame.
+class HeadTracker {
+public:
+    explicit HeadTracker(const Intrinsics& depth);
+
+    // Looks for the head in `depth`, returns whether it's there.
+    bool update(const Frame& depth);
+
+    // Where the middle of the head is, in depth pixels, and how far, in millimeters.
+    // Only meaningful after `update` found it.
+    float u() const { return m_u; }
+    float v() const { return m_v; }
+    float z() const { return m_z; }
+
+    // The same as another camera sees it: `camera` being its intrinsics at the size
+    // of its frames, `depth_to_camera` how to get there from the depth camera.
+    void in_camera(const Intrinsics& camera, const Extrinsics& depth_to_camera, float& u, float& v, float& z) const;
+
+private:
+    Intrinsics m_intrinsics;
+    int m_width, m_height;  // Of the last depth frame.
+    bool m_tracking;
+    float m_u, m_v, m_z;
+};
+
+// Instead of whole frames, stores only the participant's face from the color and
+// depth streams: `<session>.face_color.frames` and `<session>.face_depth.frames`
+// (see `SessionStream`), the crops' positions in `<session>.face.csv`. With `ir`,
+// the infrared stream's too, into `<session>.face_ir.frames`, cropped where depth
+// is as it's the same camera. Every `keyframe_interval` frames (0 for never), and
+// whenever the head is lost, the whole frames are stored instead.
+//
+// As the crops are the recording, it never drops frames: if the disk can't keep
+// up, they queue up and the HUD says so.
+class FaceCropStage : public Stage {
+public:
+    FaceCropStage(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color,
+                  int keyframe_interval, bool ir);
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    // The crop around a head `z` mm away at u,v of `camera`, inside a `w`x`h` frame.
+    SDL_Rect crop(const Intrinsics& camera, float u, float v, float z, int w, int h) const;
+
+    Intrinsics m_depth, m_color;
+    Extrinsics m_extrinsics;
+    int m_keyframe_interval;
+
+    HeadTracker m_tracker;
+    unsigned m_frames;
+
+    SessionLog m_log;
+    SessionStream m_color_stream, m_depth_stream, m_ir_stream;
+};
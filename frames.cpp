@@ -0,0 +1,74 @@
+#include "frames.h"
+
+int bytes_per_pixel(FrameFormat format)
+{
+    switch (format) {
+    case FRAME_BGRA: return 4;
+    case FRAME_DEPTH16: return 2;
+    case FRAME_Y8: return 1;
+    }
+    return 4;
+}
+
+// Keep this many frames around at most, anything beyond is freed when returned.
+static const size_t MAX_FREE = 64;
+
+FramePool::Shared::~Shared()
+{
+    for (Frame* f : free)
+        delete f;
+}
+
+FramePool::FramePool()
+    : m_shared(std::make_shared<Shared>())
+{
+    m_shared->allocated = 0;
+}
+
+FramePtr FramePool::get(FrameFormat format, int w, int h)
+{
+    Frame* f = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_shared->mutex);
+        if (!m_shared->free.empty()) {
+            f = m_shared->free.back();
+            m_shared->free.pop_back();
+        } else {
+            ++m_shared->allocated;
+        }
+    }
+    if (!f)
+        f = new Frame;
+
+    f->format = format;
+    f->width = w;
+    f->height = h;
+    f->stride = size_t(w) * bytes_per_pixel(format);
+    f->index = 0;
+    f->device_us = f->host_us = 0;
+    f->pixels.resize(f->stride * h);  // Only ever allocates the first time a buffer gets this big.
+
+    // The deleter keeps the pool's insides alive for as long as any frame is out.
+    std::shared_ptr<Shared> shared = m_shared;
+    return FramePtr(f, [shared](Frame* f){
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        if (shared->free.size() < MAX_FREE) {
+            shared->free.push_back(f);
+        } else {
+            --shared->allocated;
+            delete f;
+        }
+    });
+}
+
+size_t FramePool::available() const
+{
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    return m_shared->free.size();
+}
+
+size_t FramePool::allocated() const
+{
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    return m_shared->allocated;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <SDL_stdinc.h>
+
+// Our own copies of camera frames, for everything that wants to look at them
+// outside the capture thread. The SDK's images have to be released quickly,
+// so the capture thread copies what's needed into a `Frame` from a `FramePool`.
+
+enum FrameFormat {
+    FRAME_BGRA,     // 8 bits per channel, as the SDK's PIXEL_FORMAT_RGB32.
+    FRAME_DEPTH16,  // Millimeters, 0 meaning no measurement.
+    FRAME_Y8,       // 8 bit gray, e.g. infrared.
+};
+
+int bytes_per_pixel(FrameFormat format);
+
+struct Frame {
+    FrameFormat format;
+    int width, height;
+    size_t stride;        // Bytes from one row to the next.
+    unsigned index;       // Counts frames since capturing started.
+    Sint64 device_us;     // The camera's timestamp.
+    Sint64 host_us;       // The same, mapped to `host_us()`, see `clocksync.h`.
+    std::vector<Uint8> pixels;
+
+    template<typename T> T* row(int y) { return reinterpret_cast<T*>(pixels.data() + y*stride); }
+    template<typename T> const T* row(int y) const { return reinterpret_cast<const T*>(pixels.data() + y*stride); }
+};
+
+typedef std::shared_ptr<Frame> FramePtr;
+
+// Recycles frames so that steady-state capturing doesn't allocate. A frame goes
+// back into the pool when the last `FramePtr` to it is dropped, which may well
+// be after the pool itself is gone.
+class FramePool {
+public:
+    FramePool();
+
+    // A frame with room for `w`x`h` pixels of `format`; its contents are garbage.
+    FramePtr get(FrameFormat format, int w, int h);
+
+    // How many frames are waiting for reuse, and how many there are in all, in
+    // use or waiting. Only so many are kept for reuse, the rest are freed once back.
+    size_t available() const;
+    size_t allocated() const;
+
+private:
+    struct Shared {
+        std::mutex mutex;
+        std::vector<Frame*> free;
+        size_t allocated;  // Alive, out or in `free`.
+        ~Shared();
+    };
+    std::shared_ptr<Shared> m_shared;
+};
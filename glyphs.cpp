@@ -0,0 +1,122 @@
+#include "glyphs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "atlas.h"
+#include "spritebatch.h"
+
+GlyphFont::GlyphFont()
+    : m_atlas(nullptr)
+    , m_ascent(0)
+    , m_line_skip(0)
+{}
+
+bool GlyphFont::init(TTF_Font* font, Atlas& atlas)
+{
+    m_atlas = &atlas;
+    m_ascent = TTF_FontAscent(font);
+    m_line_skip = TTF_FontLineSkip(font);
+
+    SDL_Color white = { 255, 255, 255, 255 };
+    int indices[COUNT];
+    for (int i = 0; i < COUNT; ++i) {
+        Uint16 ch = Uint16(FIRST + i);
+        Glyph& g = m_glyphs[i];
+        int maxx, miny;
+        if (TTF_GlyphMetrics(font, ch, &g.minx, &maxx, &miny, &g.maxy, &g.advance) != 0)
+            return false;
+
+        // Same placement as SDL_ttf's own string rendering: the bitmap starts at
+        // `minx` right of the pen and `maxy` above the baseline.
+        g.sprite = -1;
+        if (maxx > g.minx && g.maxy > miny) {
+            g.sprite = atlas.add(TTF_RenderGlyph_Blended(font, ch, white));
+            if (g.sprite < 0)
+                return false;
+        }
+        indices[i] = TTF_GlyphIsProvided(font, ch);
+    }
+
+    // SDL_ttf wants the font's glyph indices for kerning, and does a FreeType lookup
+    // per call, so get all pairs over with now.
+    m_kerning.assign(COUNT*COUNT, 0);
+    bool any = false;
+    if (TTF_GetFontKerning(font)) {
+        for (int a = 0; a < COUNT; ++a) {
+            for (int b = 0; b < COUNT; ++b) {
+                int k = indices[a] && indices[b] ? TTF_GetFontKerningSize(font, indices[a], indices[b]) : 0;
+                m_kerning[a*COUNT + b] = Sint8(std::max(-128, std::min(127, k)));
+                any = any || k != 0;
+            }
+        }
+    }
+    if (!any)
+        m_kerning.clear();
+    return true;
+}
+
+bool GlyphFont::load(const char* path, int size, Atlas& atlas)
+{
+    static std::mutex ttf_mutex;
+    std::lock_guard<std::mutex> lock(ttf_mutex);
+
+    TTF_Font* font = TTF_OpenFont(path, size);
+    if (!font)
+        return false;
+    bool ok = init(font, atlas);
+    TTF_CloseFont(font);
+    return ok;
+}
+
+void GlyphFont::size(const char* text, int* w, int* h) const
+{
+    int line = 0, widest = 0, lines = 1, prev = -1;
+    for (const char* p = text; *p; ++p) {
+        if (*p == '\n') {
+            line = 0;
+            prev = -1;
+            ++lines;
+            continue;
+        }
+        int i = index(*p);
+        if (prev >= 0)
+            line += kerning(prev, i);
+        line += m_glyphs[i].advance;
+        widest = std::max(widest, line);
+        prev = i;
+    }
+    if (w)
+        *w = widest;
+    if (h)
+        *h = lines * m_line_skip;
+}
+
+void GlyphFont::draw(SpriteBatch& batch, const char* text, float x, float y, SDL_Color c, int depth) const
+{
+    x = std::floor(x);
+    y = std::floor(y);
+
+    float pen = x;
+    int prev = -1;
+    for (const char* p = text; *p; ++p) {
+        if (*p == '\n') {
+            pen = x;
+            y += m_line_skip;
+            prev = -1;
+            continue;
+        }
+        int i = index(*p);
+        if (prev >= 0)
+            pen += kerning(prev, i);
+
+        const Glyph& g = m_glyphs[i];
+        if (g.sprite >= 0) {
+            const SDL_Rect& src = m_atlas->rect(g.sprite);
+            batch.add(src, pen + g.minx, y + m_ascent - g.maxy, float(src.w), float(src.h), c, depth);
+        }
+        pen += g.advance;
+        prev = i;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+class Atlas;
+class SpriteBatch;
+
+// Text drawn from glyphs that were rasterized once into an `Atlas`, so text that
+// changes every frame (countdowns, timers, stats, ...) costs a few quads in the
+// frame's `SpriteBatch` and never any rasterizing or texture uploads.
+//
+// Covers printable ASCII, everything else is drawn as '?'. Glyphs are white and
+// tinted by the color they're drawn with. One `GlyphFont` per font and size.
+class GlyphFont {
+public:
+    GlyphFont();
+
+    // Rasterizes the glyphs of `font` into `atlas`, which needs a `build` before drawing.
+    // `font` isn't needed anymore afterwards.
+    bool init(TTF_Font* font, Atlas& atlas);
+
+    // Opens the font at `path` in `size`, `init`s from it and closes it again. SDL_ttf
+    // isn't thread-safe, this is, as long as it's the only way fonts are used.
+    bool load(const char* path, int size, Atlas& atlas);
+
+    int line_height() const { return m_line_skip; }
+
+    // Size in pixels of `text` as `draw` would lay it out.
+    void size(const char* text, int* w, int* h) const;
+
+    // Adds `text` to `batch` with its top-left corner at x,y, snapped to whole pixels
+    // so the glyphs stay crisp. '\n' starts a new line.
+    void draw(SpriteBatch& batch, const char* text, float x, float y, SDL_Color c, int depth = 0) const;
+
+private:
+    static const int FIRST = 32, LAST = 126, COUNT = LAST - FIRST + 1;
+
+    struct Glyph {
+        int sprite;  // -1 for blanks like ' '.
+        int minx, maxy, advance;
+    };
+
+    static int index(char ch) { return ch >= FIRST && ch <= LAST ? ch - FIRST : '?' - FIRST; }
+    int kerning(int prev, int i) const { return m_kerning.empty() ? 0 : m_kerning[prev*COUNT + i]; }
+
+    const Atlas* m_atlas;
+    int m_ascent, m_line_skip;
+    Glyph m_glyphs[COUNT];
+    // COUNT x COUNT, looked up by [prev*COUNT + next]. Empty when the font has no kerning.
+    std::vector<Sint8> m_kerning;
+};
@@ -0,0 +1,485 @@
+#include "headpose.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+// About how big a face is, and the region around the head's middle that's searched
+// for it, in millimeters. The region is well bigger than the face, so it's the
+// depth gate that cuts out the face's outline: its longest axis is the face's,
+// not the region's, and that's what roll comes from.
+static const float FACE_W_MM = 150.0f, FACE_H_MM = 200.0f;
+static const float REGION_W_MM = 260.0f, REGION_H_MM = 320.0f;
+// Without a previous fit, pixels within BAND_MM of the head's depth count, with
+// one, pixels within TOL_MM of its plane: a nose sticks out less than that.
+static const int BAND_MM = 100, TOL_MM = 50;
+// Steeper planes are clamped, at that point the face is seen edge-on anyway.
+static const float MAX_SLOPE = 5.0f;  // mm per pixel
+// Below this many pixels there's no face to fit.
+static const Uint32 MIN_POINTS = 200;
+// Only fits at least this confident are started from in the next frame.
+static const float MIN_CONFIDENCE = 0.2f;
+static const float DEGREES = 57.2957795f;
+
+// The gate is compared in 1/256 mm, which is fine enough for the slopes and keeps
+// any 16 bit depth in 32 bits.
+static const int FIXED_SHIFT = 8;
+
+struct Gate {
+    Sint32 a, b, c, tol;
+    int z0;
+};
+
+static Gate fixed_gate(const DepthPlane& plane, const SDL_Rect& region, int tol_mm)
+{
+    Gate g;
+    g.a = Sint32(std::floor(plane.a * (1 << FIXED_SHIFT) + 0.5f));
+    g.b = Sint32(std::floor(plane.b * (1 << FIXED_SHIFT) + 0.5f));
+    g.c = Sint32(std::floor(plane.c * (1 << FIXED_SHIFT) + 0.5f));
+    g.tol = tol_mm << FIXED_SHIFT;
+    g.z0 = int(plane.c + plane.a * (region.x + region.w/2) + plane.b * (region.y + region.h/2));
+    return g;
+}
+
+static void start_moments(const SDL_Rect& region, int z0, FaceMoments& out)
+{
+    out.x0 = region.x;
+    out.y0 = region.y;
+    out.z0 = z0;
+    out.n = 0;
+    out.su = out.sv = out.sz = 0;
+    out.suu = out.suv = out.suz = out.svv = out.svz = out.szz = 0;
+}
+
+// Adds a row's sums, with the row's v.
+static void add_row(FaceMoments& out, Sint64 v, Sint64 n, Sint64 su, Sint64 sz, Sint64 suu, Sint64 suz, Sint64 szz)
+{
+    out.n += Uint32(n);
+    out.su += su;
+    out.sv += v * n;
+    out.sz += sz;
+    out.suu += suu;
+    out.suv += v * su;
+    out.suz += suz;
+    out.svv += v * v * n;
+    out.svz += v * sz;
+    out.szz += szz;
+}
+
+// Pixels `from` to `w` of a region's row, `p` being the gate at its first pixel.
+static void row_scalar(const Uint16* row, int from, int w, Sint32 p, const Gate& g,
+                       Sint64& n, Sint64& su, Sint64& sz, Sint64& suu, Sint64& suz, Sint64& szz)
+{
+    for (int i = from; i < w; ++i) {
+        Sint32 diff = (Sint32(row[i]) << FIXED_SHIFT) - (p + g.a*i);
+        if (diff > -g.tol && diff < g.tol) {
+            Sint64 z = row[i] - g.z0;
+            ++n;
+            su += i;
+            sz += z;
+            suu += i*i;
+            suz += i*z;
+            szz += z*z;
+        }
+    }
+}
+
+static Sint32 row_gate(const Gate& g, const SDL_Rect& region, int y)
+{
+    return g.c + g.a*region.x + g.b*y;
+}
+
+void face_moments_scalar(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                         FaceMoments& out)
+{
+    Gate g = fixed_gate(gate, region, tol_mm);
+    start_moments(region, g.z0, out);
+    for (int y = region.y; y < region.y + region.h; ++y) {
+        const Uint16* row = depth + size_t(y) * width + region.x;
+        Sint64 n = 0, su = 0, sz = 0, suu = 0, suz = 0, szz = 0;
+        row_scalar(row, 0, region.w, row_gate(g, region, y), g, n, su, sz, suu, suz, szz);
+        add_row(out, y - region.y, n, su, sz, suu, suz, szz);
+    }
+}
+
+#ifdef HAVE_SSE2
+void face_moments_sse2(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                       FaceMoments& out)
+{
+    Gate g = fixed_gate(gate, region, tol_mm);
+    start_moments(region, g.z0, out);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i lo_tol = _mm_set1_epi32(-g.tol), hi_tol = _mm_set1_epi32(g.tol);
+    const __m128i step_a = _mm_set1_epi32(8 * g.a), step_u = _mm_set1_epi16(8);
+    const __m128i z0 = _mm_set1_epi16(Sint16(g.z0));
+    Sint32 lanes[4];
+    Sint16 counts[8];
+    for (int y = region.y; y < region.y + region.h; ++y) {
+        const Uint16* row = depth + size_t(y) * width + region.x;
+        Sint32 p0 = row_gate(g, region, y);
+        __m128i p_lo = _mm_setr_epi32(p0, p0 + g.a, p0 + 2*g.a, p0 + 3*g.a);
+        __m128i p_hi = _mm_add_epi32(p_lo, _mm_set1_epi32(4 * g.a));
+        __m128i u = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+        // In 32 bits per row, which is plenty for a row of a face.
+        __m128i n = zero, su = zero, sz = zero, suu = zero, suz = zero, szz = zero;
+        int i = 0;
+        for (; i + 8 <= region.w; i += 8) {
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+            __m128i diff_lo = _mm_sub_epi32(_mm_slli_epi32(_mm_unpacklo_epi16(d, zero), FIXED_SHIFT), p_lo);
+            __m128i diff_hi = _mm_sub_epi32(_mm_slli_epi32(_mm_unpackhi_epi16(d, zero), FIXED_SHIFT), p_hi);
+            __m128i in_lo = _mm_and_si128(_mm_cmpgt_epi32(diff_lo, lo_tol), _mm_cmplt_epi32(diff_lo, hi_tol));
+            __m128i in_hi = _mm_and_si128(_mm_cmpgt_epi32(diff_hi, lo_tol), _mm_cmplt_epi32(diff_hi, hi_tol));
+            __m128i in = _mm_packs_epi32(in_lo, in_hi);
+
+            __m128i um = _mm_and_si128(u, in);
+            __m128i zm = _mm_and_si128(_mm_sub_epi16(d, z0), in);
+            n = _mm_sub_epi16(n, in);
+            su = _mm_add_epi32(su, _mm_madd_epi16(um, ones));
+            sz = _mm_add_epi32(sz, _mm_madd_epi16(zm, ones));
+            suu = _mm_add_epi32(suu, _mm_madd_epi16(um, um));
+            suz = _mm_add_epi32(suz, _mm_madd_epi16(um, zm));
+            szz = _mm_add_epi32(szz, _mm_madd_epi16(zm, zm));
+
+            p_lo = _mm_add_epi32(p_lo, step_a);
+            p_hi = _mm_add_epi32(p_hi, step_a);
+            u = _mm_add_epi16(u, step_u);
+        }
+
+        Sint64 sums[6] = { 0 };
+        __m128i vecs[5] = { su, sz, suu, suz, szz };
+        for (int k = 0; k < 5; ++k) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vecs[k]);
+            sums[k + 1] = Sint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(counts), n);
+        for (int k = 0; k < 8; ++k)
+            sums[0] += counts[k];
+        row_scalar(row, i, region.w, p0, g, sums[0], sums[1], sums[2], sums[3], sums[4], sums[5]);
+        add_row(out, y - region.y, sums[0], sums[1], sums[2], sums[3], sums[4], sums[5]);
+    }
+}
+#else
+void face_moments_sse2(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                       FaceMoments& out)
+{
+    face_moments_scalar(depth, width, region, gate, tol_mm, out);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void face_moments_avx2(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                                   FaceMoments& out)
+{
+    Gate g = fixed_gate(gate, region, tol_mm);
+    start_moments(region, g.z0, out);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i lo_tol = _mm256_set1_epi32(-g.tol), hi_tol = _mm256_set1_epi32(g.tol);
+    const __m256i step_a = _mm256_set1_epi32(16 * g.a), step_u = _mm256_set1_epi16(16);
+    const __m256i z0 = _mm256_set1_epi16(Sint16(g.z0));
+    Sint32 lanes[8];
+    Sint16 counts[16];
+    for (int y = region.y; y < region.y + region.h; ++y) {
+        const Uint16* row = depth + size_t(y) * width + region.x;
+        Sint32 p0 = row_gate(g, region, y);
+        // Unpacking to 32 bits works per 128 bit lane, so the low halves are pixels
+        // 0-3 and 8-11, the high ones 4-7 and 12-15. Packing back restores the order.
+        __m256i p_lo = _mm256_setr_epi32(p0, p0 + g.a, p0 + 2*g.a, p0 + 3*g.a,
+                                         p0 + 8*g.a, p0 + 9*g.a, p0 + 10*g.a, p0 + 11*g.a);
+        __m256i p_hi = _mm256_add_epi32(p_lo, _mm256_set1_epi32(4 * g.a));
+        __m256i u = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        __m256i n = zero, su = zero, sz = zero, suu = zero, suz = zero, szz = zero;
+        int i = 0;
+        for (; i + 16 <= region.w; i += 16) {
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+            __m256i diff_lo = _mm256_sub_epi32(_mm256_slli_epi32(_mm256_unpacklo_epi16(d, zero), FIXED_SHIFT), p_lo);
+            __m256i diff_hi = _mm256_sub_epi32(_mm256_slli_epi32(_mm256_unpackhi_epi16(d, zero), FIXED_SHIFT), p_hi);
+            __m256i in_lo = _mm256_and_si256(_mm256_cmpgt_epi32(diff_lo, lo_tol), _mm256_cmpgt_epi32(hi_tol, diff_lo));
+            __m256i in_hi = _mm256_and_si256(_mm256_cmpgt_epi32(diff_hi, lo_tol), _mm256_cmpgt_epi32(hi_tol, diff_hi));
+            __m256i in = _mm256_packs_epi32(in_lo, in_hi);
+
+            __m256i um = _mm256_and_si256(u, in);
+            __m256i zm = _mm256_and_si256(_mm256_sub_epi16(d, z0), in);
+            n = _mm256_sub_epi16(n, in);
+            su = _mm256_add_epi32(su, _mm256_madd_epi16(um, ones));
+            sz = _mm256_add_epi32(sz, _mm256_madd_epi16(zm, ones));
+            suu = _mm256_add_epi32(suu, _mm256_madd_epi16(um, um));
+            suz = _mm256_add_epi32(suz, _mm256_madd_epi16(um, zm));
+            szz = _mm256_add_epi32(szz, _mm256_madd_epi16(zm, zm));
+
+            p_lo = _mm256_add_epi32(p_lo, step_a);
+            p_hi = _mm256_add_epi32(p_hi, step_a);
+            u = _mm256_add_epi16(u, step_u);
+        }
+
+        Sint64 sums[6] = { 0 };
+        __m256i vecs[5] = { su, sz, suu, suz, szz };
+        for (int k = 0; k < 5; ++k) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), vecs[k]);
+            for (int j = 0; j < 8; ++j)
+                sums[k + 1] += lanes[j];
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), n);
+        for (int k = 0; k < 16; ++k)
+            sums[0] += counts[k];
+        row_scalar(row, i, region.w, p0, g, sums[0], sums[1], sums[2], sums[3], sums[4], sums[5]);
+        add_row(out, y - region.y, sums[0], sums[1], sums[2], sums[3], sums[4], sums[5]);
+    }
+}
+#else
+void face_moments_avx2(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                       FaceMoments& out)
+{
+    face_moments_sse2(depth, width, region, gate, tol_mm, out);
+}
+#endif
+
+void face_moments(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                  FaceMoments& out)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        face_moments_avx2(depth, width, region, gate, tol_mm, out);
+    else if (SDL_HasSSE2())
+        face_moments_sse2(depth, width, region, gate, tol_mm, out);
+    else
+        face_moments_scalar(depth, width, region, gate, tol_mm, out);
+}
+
+// Diagonalizes the symmetric `a` with Jacobi rotations, which it accumulates into
+// `v`. Started from the previous frame's axes, `a` is nearly diagonal already.
+static void jacobi(double a[3][3], double v[3][3])
+{
+    static const int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+    for (int sweep = 0; sweep < 10; ++sweep) {
+        double off = a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+        double diag = a[0][0]*a[0][0] + a[1][1]*a[1][1] + a[2][2]*a[2][2];
+        if (off <= 1e-18 * diag)
+            return;
+        for (auto& pq : pairs) {
+            int p = pq[0], q = pq[1];
+            if (a[p][q] == 0.0)
+                continue;
+            double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+            double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta*theta + 1.0));
+            double c = 1.0 / std::sqrt(t*t + 1.0), s = t * c;
+            for (int k = 0; k < 3; ++k) {
+                double akp = a[k][p], akq = a[k][q];
+                a[k][p] = c*akp - s*akq;
+                a[k][q] = s*akp + c*akq;
+            }
+            for (int k = 0; k < 3; ++k) {
+                double apk = a[p][k], aqk = a[q][k];
+                a[p][k] = c*apk - s*aqk;
+                a[q][k] = s*apk + c*aqk;
+            }
+            for (int k = 0; k < 3; ++k) {
+                double vkp = v[k][p], vkq = v[k][q];
+                v[k][p] = c*vkp - s*vkq;
+                v[k][q] = s*vkp + c*vkq;
+            }
+        }
+    }
+}
+
+static void set_identity(double m[3][3])
+{
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            m[i][j] = i == j ? 1.0 : 0.0;
+}
+
+HeadPoseEstimator::HeadPoseEstimator(const Intrinsics& depth)
+    : m_intrinsics(depth)
+    , m_tracker(depth)
+    , m_warm(false)
+    , m_head_z(0.0f)
+{
+    m_plane.a = m_plane.b = m_plane.c = 0.0f;
+    set_identity(m_axes);
+}
+
+bool HeadPoseEstimator::update(const Frame& depth, HeadPose& pose)
+{
+    if (!m_tracker.update(depth)) {
+        m_warm = false;
+        return false;
+    }
+
+    Intrinsics in = m_intrinsics.scaled(depth.width, depth.height);
+    float head_z = m_tracker.z();
+    int w = int(in.fx * REGION_W_MM / head_z), h = int(in.fy * REGION_H_MM / head_z);
+    SDL_Rect region;
+    region.x = std::max(0, int(m_tracker.u()) - w/2);
+    region.y = std::max(0, int(m_tracker.v()) - h/2);
+    region.w = std::min(depth.width, int(m_tracker.u()) - w/2 + w) - region.x;
+    region.h = std::min(depth.height, int(m_tracker.v()) - h/2 + h) - region.y;
+    if (region.w < 8 || region.h < 8) {
+        m_warm = false;
+        return false;
+    }
+
+    // Around the last plane, moved along with the head, or around the head's depth.
+    DepthPlane gate = { 0.0f, 0.0f, head_z };
+    int tol = BAND_MM;
+    if (m_warm) {
+        gate = m_plane;
+        gate.c += head_z - m_head_z;
+        tol = TOL_MM;
+    }
+    FaceMoments m;
+    face_moments(depth.row<Uint16>(0), depth.width, region, gate, tol, m);
+    if (m.n < MIN_POINTS) {
+        m_warm = false;
+        return false;
+    }
+
+    // The covariance of u, v and z.
+    double n = m.n, mu = m.su / n, mv = m.sv / n, mz = m.sz / n;
+    double cov[3][3];
+    cov[0][0] = m.suu / n - mu*mu;
+    cov[0][1] = cov[1][0] = m.suv / n - mu*mv;
+    cov[0][2] = cov[2][0] = m.suz / n - mu*mz;
+    cov[1][1] = m.svv / n - mv*mv;
+    cov[1][2] = cov[2][1] = m.svz / n - mv*mz;
+    cov[2][2] = m.szz / n - mz*mz;
+
+    // The plane through them, for gating the next frame.
+    double u0 = mu + m.x0, v0 = mv + m.y0, z0 = mz + m.z0;
+    double det = cov[0][0]*cov[1][1] - cov[0][1]*cov[0][1];
+    double a = 0.0, b = 0.0;
+    if (det > 0.0) {
+        a = (cov[0][2]*cov[1][1] - cov[1][2]*cov[0][1]) / det;
+        b = (cov[1][2]*cov[0][0] - cov[0][2]*cov[0][1]) / det;
+    }
+    a = std::max(-double(MAX_SLOPE), std::min(double(MAX_SLOPE), a));
+    b = std::max(-double(MAX_SLOPE), std::min(double(MAX_SLOPE), b));
+
+    // Into millimeters around the middle of the face, where x = (u - cx) z / fx
+    // and so on is close enough to linear over a face.
+    float rx, ry;
+    in.unproject(float(u0), float(v0), rx, ry);
+    double j[3][3] = {
+        { z0 / in.fx, 0.0, rx },
+        { 0.0, z0 / in.fy, ry },
+        { 0.0, 0.0, 1.0 },
+    };
+    double jc[3][3], metric[3][3];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 3; ++c)
+            jc[r][c] = j[r][0]*cov[0][c] + j[r][1]*cov[1][c] + j[r][2]*cov[2][c];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 3; ++c)
+            metric[r][c] = jc[r][0]*j[c][0] + jc[r][1]*j[c][1] + jc[r][2]*j[c][2];
+
+    // Its principal axes, starting from the last ones: a = vᵀ metric v.
+    double v[3][3], av[3][3], diag[3][3];
+    if (m_warm)
+        std::copy(&m_axes[0][0], &m_axes[0][0] + 9, &v[0][0]);
+    else
+        set_identity(v);
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 3; ++c)
+            av[r][c] = metric[r][0]*v[0][c] + metric[r][1]*v[1][c] + metric[r][2]*v[2][c];
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 3; ++c)
+            diag[r][c] = v[0][r]*av[0][c] + v[1][r]*av[1][c] + v[2][r]*av[2][c];
+    jacobi(diag, v);
+
+    // The face is flattest along where it points, and longest up and down.
+    int order[3] = { 0, 1, 2 };
+    std::sort(order, order + 3, [&](int x, int y) { return diag[x][x] < diag[y][y]; });
+    double lz = diag[order[0]][order[0]], lx = diag[order[1]][order[1]];
+    double hz[3], hy[3], hx[3];
+    for (int k = 0; k < 3; ++k) {
+        hz[k] = v[k][order[0]];
+        hy[k] = v[k][order[2]];
+    }
+    double sz = hz[2] < 0.0 ? -1.0 : 1.0, sy = hy[1] < 0.0 ? -1.0 : 1.0;
+    for (int k = 0; k < 3; ++k) {
+        hz[k] *= sz;
+        hy[k] *= sy;
+    }
+    hx[0] = hy[1]*hz[2] - hy[2]*hz[1];
+    hx[1] = hy[2]*hz[0] - hy[0]*hz[2];
+    hx[2] = hy[0]*hz[1] - hy[1]*hz[0];
+    for (int k = 0; k < 3; ++k) {
+        m_axes[k][0] = hx[k];
+        m_axes[k][1] = hy[k];
+        m_axes[k][2] = hz[k];
+    }
+
+    pose.t[0] = float(rx * z0);
+    pose.t[1] = float(ry * z0);
+    pose.t[2] = float(z0);
+    for (int r = 0; r < 3; ++r)
+        for (int c = 0; c < 3; ++c)
+            pose.r[3*r + c] = float(m_axes[r][c]);
+    pose.yaw = float(DEGREES * std::atan2(-hz[0], hz[2]));
+    pose.pitch = float(DEGREES * std::atan2(hz[1], std::sqrt(hz[0]*hz[0] + hz[2]*hz[2])));
+    pose.roll = float(DEGREES * std::atan2(-hy[0], hy[1]));
+    pose.points = m.n;
+
+    // How much of a face's worth of pixels fit, an oval of the face's size.
+    double face = 0.785 * (in.fx * FACE_W_MM / head_z) * (in.fy * FACE_H_MM / head_z);
+    double fill = n / face;
+    double flatness = lx > 0.0 ? 1.0 - lz / lx : 0.0;
+    pose.confidence = float(std::max(0.0, std::min(1.0, fill)) * std::max(0.0, std::min(1.0, flatness)));
+
+    m_plane.a = float(a);
+    m_plane.b = float(b);
+    m_plane.c = float(z0 - a*u0 - b*v0);
+    m_head_z = head_z;
+    m_warm = pose.confidence >= MIN_CONFIDENCE;
+    return true;
+}
+
+HeadPoseStage::HeadPoseStage(const Intrinsics& depth)
+    : Stage("headpose", STREAM_DEPTH)
+    , m_depth(depth)
+    , m_estimator(depth)
+    , m_found_frames(0)
+    , m_confident_frames(0)
+{}
+
+void HeadPoseStage::begin()
+{
+    m_estimator = HeadPoseEstimator(m_depth);
+    m_found_frames = m_confident_frames = 0;
+    m_log.open("headpose", "frame,host_us,found,x_mm,y_mm,z_mm,yaw_deg,pitch_deg,roll_deg,"
+                           "r00,r01,r02,r10,r11,r12,r20,r21,r22,confidence,points");
+}
+
+void HeadPoseStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    if (!depth)
+        return;
+
+    HeadPose pose;
+    if (!m_estimator.update(*depth, pose)) {
+        m_log.row("%u,%lld,0,,,,,,,,,,,,,,,,0,0", depth->index, (long long)depth->host_us);
+        return;
+    }
+    ++m_found_frames;
+    if (pose.confidence >= MIN_CONFIDENCE)
+        ++m_confident_frames;
+
+    const float* r = pose.r;
+    m_log.row("%u,%lld,1,%.1f,%.1f,%.1f,%.2f,%.2f,%.2f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%u",
+              depth->index, (long long)depth->host_us, pose.t[0], pose.t[1], pose.t[2], pose.yaw, pose.pitch, pose.roll,
+              r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], pose.confidence, pose.points);
+}
+
+void HeadPoseStage::end()
+{
+    m_log.close();
+    session_meta("headpose_frames", double(m_found_frames));
+    session_meta("headpose_confident_frames", double(m_confident_frames));
+}
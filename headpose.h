@@ -0,0 +1,99 @@
+#pragma once
+
+#include <SDL_rect.h>
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+#include "facecrop.h"
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// A plane in depth pixels: z = a u + b v + c millimeters at pixel u,v.
+struct DepthPlane {
+    float a, b, c;
+};
+
+// The moments of the pixels of a region close to a plane, for fitting a plane to
+// them: u and v relative to the region's corner, z to `z0`.
+struct FaceMoments {
+    int x0, y0, z0;
+    Uint32 n;
+    Sint64 su, sv, sz;
+    Sint64 suu, suv, suz, svv, svz, szz;
+};
+
+// Of the pixels in `region` of the `width` wide `depth` that are less than `tol_mm`
+// in front of or behind `gate`. Uses the best kernel the CPU supports.
+void face_moments(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                  FaceMoments& out);
+
+// The individual kernels, for testing and benchmarking.
+void face_moments_scalar(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                         FaceMoments& out);
+void face_moments_sse2(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                       FaceMoments& out);
+void face_moments_avx2(const Uint16* depth, int width, const SDL_Rect& region, const DepthPlane& gate, int tol_mm,
+                       FaceMoments& out);
+
+// Where the head is and where it faces, in the depth camera's coordinates.
+struct HeadPose {
+    float t[3];  // The face's middle, in millimeters.
+    // The head's axes as columns: x to the participant's left as the camera sees
+    // it, y down the face, z out of the back of the head. The identity when
+    // facing the camera upright.
+    float r[9];
+    // The same as angles in degrees: yaw is positive when the face turns towards
+    // the image's right, pitch when it turns up, roll when the head tilts clockwise
+    // in the image.
+    float yaw, pitch, roll;
+    // 0 (nothing useful) to 1, from how much of a face's worth of pixels fits the
+    // plane and how flat it is.
+    float confidence;
+    Uint32 points;
+};
+
+// Estimates the head's pose from depth frames by fitting a plane to the face: its
+// normal is where the face points, its longest axis is up and down the face. The
+// pixels are searched in a region well bigger than a face, so that the face's
+// outline, as cut out by the depth, is what decides that axis.
+//
+// The head is found with `HeadTracker`. Each frame starts from the previous one's
+// fit: only pixels near the previous frame's plane count, which leaves out hair,
+// shoulders and hands in front of the face, and the principal axes are refined
+// from the previous ones, which takes a sweep or two.
+class HeadPoseEstimator {
+public:
+    explicit HeadPoseEstimator(const Intrinsics& depth);
+
+    // Returns whether the head was found, with its pose in `pose`.
+    bool update(const Frame& depth, HeadPose& pose);
+
+private:
+    Intrinsics m_intrinsics;
+    HeadTracker m_tracker;
+
+    bool m_warm;
+    DepthPlane m_plane;
+    float m_head_z;  // The tracker's, when `m_plane` was fit.
+    double m_axes[3][3];  // Columns, by the face's width, height and depth.
+};
+
+// Estimates the head's pose for every depth frame on a worker thread, into
+// `<session>.headpose.csv`, with how many frames had one in the meta.
+class HeadPoseStage : public Stage {
+public:
+    explicit HeadPoseStage(const Intrinsics& depth);
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    Intrinsics m_depth;
+    HeadPoseEstimator m_estimator;
+    unsigned m_found_frames, m_confident_frames;
+
+    SessionLog m_log;
+};
@@ -0,0 +1,58 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <sstream>
+
+Histogram::Histogram(double bin_width, int nbins)
+    : m_width(bin_width)
+    , m_bins(nbins)
+{
+    clear();
+}
+
+void Histogram::clear()
+{
+    std::fill(m_bins.begin(), m_bins.end(), 0);
+    m_count = 0;
+    m_sum = m_max = 0.0;
+}
+
+void Histogram::add(double v)
+{
+    size_t i = v <= 0.0 ? 0 : std::min(size_t(v / m_width), m_bins.size() - 1);
+    ++m_bins[i];
+    ++m_count;
+    m_sum += v;
+    m_max = std::max(m_max, v);
+}
+
+double Histogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0.0;
+
+    size_t target = size_t(p / 100.0 * (m_count - 1));
+    size_t seen = 0;
+    for (size_t i = 0; i < m_bins.size(); ++i) {
+        seen += m_bins[i];
+        if (seen > target)
+            return std::min((i + 0.5) * m_width, m_max);
+    }
+    return m_max;
+}
+
+std::string Histogram::summary() const
+{
+    std::ostringstream ss;
+    ss.precision(3);
+    ss << "n=" << m_count << " mean=" << mean() << " p50=" << percentile(50)
+       << " p95=" << percentile(95) << " p99=" << percentile(99) << " max=" << m_max;
+    return ss.str();
+}
+
+void Histogram::write(SessionLog& log, const char* name) const
+{
+    for (size_t i = 0; i < m_bins.size(); ++i)
+        if (m_bins[i])
+            log.row("%s,%g,%u", name, i * m_width, unsigned(m_bins[i]));
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "session.h"
+
+// Fixed-width bins from 0 up to `bin_width * nbins`, with everything beyond
+// going into the last bin. Cheap enough to add to every frame.
+class Histogram {
+public:
+    Histogram(double bin_width, int nbins);
+
+    void clear();
+    void add(double v);
+
+    size_t count() const { return m_count; }
+    double mean() const { return m_count ? m_sum / m_count : 0.0; }
+    double max() const { return m_max; }
+
+    // The `p`-th percentile (0-100), to the resolution of a bin.
+    double percentile(double p) const;
+
+    // "n=.. mean=.. p50=.. p95=.. p99=.. max=..", for printing.
+    std::string summary() const;
+
+    // One row per non-empty bin: `name,bin_start,count`.
+    void write(SessionLog& log, const char* name) const;
+
+private:
+    double m_width;
+    std::vector<size_t> m_bins;
+    size_t m_count;
+    double m_sum, m_max;
+};
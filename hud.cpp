@@ -0,0 +1,117 @@
+#include "hud.h"
+
+#include <cstdio>
+
+#include "counters.h"
+#include "glyphs.h"
+#include "quality.h"
+#include "spritebatch.h"
+
+static const Uint64 REFRESH_US = 250000;
+
+PerfHud::PerfHud()
+    : m_font(nullptr)
+    , m_visible(false)
+    , m_last_refresh(0)
+    , m_color(0)
+    , m_depth(0)
+    , m_bytes(0)
+    , m_recording_bytes(0)
+{}
+
+void PerfHud::init(const GlyphFont* font)
+{
+    m_font = font;
+}
+
+void PerfHud::update(Uint64 now_us)
+{
+    // Hidden, it costs nothing, and starts over when shown again.
+    if (!m_visible) {
+        m_last_refresh = 0;
+        return;
+    }
+    if (now_us - m_last_refresh >= REFRESH_US)
+        refresh(now_us);
+}
+
+void PerfHud::refresh(Uint64 now_us)
+{
+    double dt = 1e-6 * (now_us - m_last_refresh);
+    bool first = m_last_refresh == 0;
+    m_last_refresh = now_us;
+
+    Uint64 color = g_counters.color_frames, depth = g_counters.depth_frames;
+    Uint64 bytes = g_counters.bytes_logged;
+    long long recording = g_counters.recording_bytes, disk_free = g_counters.disk_free;
+
+    // Nothing to take rates over yet, but the deltas start from here.
+    if (!first) {
+        double written = double(bytes - m_bytes) + double(recording - m_recording_bytes);
+        char buf[512];
+        std::sprintf(buf,
+            "render %.1f fps, frame p50 %.1f p99 %.1f max %.1f ms\n"
+            "capture color %.1f fps, depth %.1f fps, dropped %llu\n"
+            "frames in flight %d, queued for processing %d, dropped %llu\n"
+            "writing %.1f MB/s, %.1f GB free",
+            0.1 * g_counters.render_fps_x10, 0.001 * g_counters.render_p50_us, 0.001 * g_counters.render_p99_us, 0.001 * g_counters.render_max_us,
+            (color - m_color) / dt, (depth - m_depth) / dt, (unsigned long long)g_counters.dropped_frames.load(),
+            g_counters.frames_in_flight.load(), g_counters.stage_queued.load(), (unsigned long long)g_counters.stage_dropped.load(),
+            1e-6 * written / dt, disk_free < 0 ? 0.0 : 1e-9 * disk_free);
+        m_text = buf;
+        int behind = g_counters.recording_queued;
+        if (behind > RECORDING_QUEUED_WARN)
+            m_text += "\nwarning: writing the recording falls behind, " + std::to_string(behind) + " frames queued";
+        int quality = g_counters.quality_flags;
+        if (quality >= 0)
+            m_text += "\nparticipant " + quality_text(Uint32(quality));
+    }
+
+    m_color = color;
+    m_depth = depth;
+    m_bytes = bytes;
+    m_recording_bytes = recording;
+}
+
+void PerfHud::size(int* w, int* h) const
+{
+    m_font->size(m_text.c_str(), w, h);
+}
+
+void PerfHud::render(SpriteBatch& batch, float x, float y) const
+{
+    if (!m_visible || !m_font)
+        return;
+
+    // Dimmed, and over everything else.
+    SDL_Color gray = { 160, 160, 160, 255 };
+    m_font->draw(batch, m_text.c_str(), x, y, gray, 2);
+}
+
+RenderStats::RenderStats()
+    : m_last_present(0)
+    , m_last_publish(0)
+    , m_interval_ms(0.1, 1000)
+{}
+
+void RenderStats::presented(Uint64 now_us)
+{
+    if (m_last_present)
+        m_interval_ms.add(0.001 * (now_us - m_last_present));
+    m_last_present = now_us;
+
+    if (!m_last_publish) {
+        m_last_publish = now_us;
+        return;
+    }
+    if (now_us - m_last_publish < REFRESH_US)
+        return;
+
+    double dt = 1e-6 * (now_us - m_last_publish);
+    m_last_publish = now_us;
+    g_counters.render_fps_x10 = Uint32(10 * m_interval_ms.count() / dt + 0.5);
+    g_counters.render_p50_us = Uint32(1000 * m_interval_ms.percentile(50));
+    g_counters.render_p99_us = Uint32(1000 * m_interval_ms.percentile(99));
+    g_counters.render_max_us = Uint32(1000 * m_interval_ms.max());
+    m_interval_ms.clear();
+}
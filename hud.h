@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+
+#include <SDL.h>
+
+#include "histogram.h"
+
+class GlyphFont;
+class SpriteBatch;
+
+// A few lines of text telling the operator how the pipeline is doing: render
+// rate and frame-time percentiles, capture rate per stream, dropped frames,
+// queue depths, how fast the session is written and how much disk is left.
+//
+// It all comes from `g_counters`, so the HUD can be on any thread's window
+// (see `operator.h`). The text is only redone a few times a second, and drawn
+// from a `GlyphFont` as part of the frame's batch.
+class PerfHud {
+public:
+    PerfHud();
+
+    void init(const GlyphFont* font);
+
+    bool visible() const { return m_visible; }
+    void show(bool on) { m_visible = on; }
+    void toggle() { m_visible = !m_visible; }
+
+    // Call once per frame of whichever window it's on.
+    void update(Uint64 now_us);
+
+    // The text's size, and drawing it with its top-left corner at x,y.
+    void size(int* w, int* h) const;
+    void render(SpriteBatch& batch, float x, float y) const;
+
+private:
+    void refresh(Uint64 now_us);
+
+    const GlyphFont* m_font;
+    bool m_visible;
+    std::string m_text;
+
+    Uint64 m_last_refresh;
+
+    // The counters at the last refresh.
+    Uint64 m_color, m_depth, m_bytes;
+    long long m_recording_bytes;
+};
+
+// Frame rate and frame-time percentiles of the thread presenting the stimuli,
+// published into `g_counters` a few times a second.
+class RenderStats {
+public:
+    RenderStats();
+
+    // Call once per frame, right after presenting it.
+    void presented(Uint64 now_us);
+
+private:
+    Uint64 m_last_present, m_last_publish;
+    Histogram m_interval_ms;
+};
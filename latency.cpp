@@ -0,0 +1,252 @@
+#include "latency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include <SDL_cpuinfo.h>
+
+#include "session.h"
+#include "simd.h"
+
+// How long a flash stays on screen, and the range of gaps between flash onsets.
+static const Uint64 FLASH_US = 150000;
+static const Uint64 GAP_MIN_US = 600000;
+static const Uint64 GAP_MAX_US = 1000000;
+// The largest latency we look for, which can be longer than the gaps, and how far
+// a detection may be off the latency most detections agree on to be matched.
+static const Uint64 LATENCY_MAX_US = 1500000;
+static const Uint64 MATCH_US = 50000;
+
+// A pixel channel counts as lit when it's at least this bright.
+static const Uint8 BRIGHT = 160;
+
+static std::atomic<bool> g_calibrating(false);
+static std::vector<Uint64> g_schedule;
+
+// Onsets as seen by us (presented) and by the camera (detected), in host time.
+static std::mutex g_mutex;
+static std::vector<Uint64> g_presented;
+static std::vector<Uint64> g_detected;
+static bool g_was_flash = false;
+
+// Camera-side state, only touched by the capture thread.
+static double g_lo = 1.0, g_hi = 0.0;
+static bool g_cam_lit = false;
+
+static std::string latency_file()
+{
+    return pref_path() + "latency.txt";
+}
+
+// Counts the color bytes (i.e. skipping alpha) of `n` BGRA pixels which are >= `thr`.
+static Uint64 count_bright_scalar(const Uint8* px, int n, Uint8 thr)
+{
+    Uint64 count = 0;
+    for (int i = 0; i < n; ++i, px += 4)
+        count += (px[0] >= thr) + (px[1] >= thr) + (px[2] >= thr);
+    return count;
+}
+
+#ifdef HAVE_SSE2
+static Uint64 count_bright_sse2(const Uint8* px, int n, Uint8 thr)
+{
+    const __m128i vthr = _mm_set1_epi8((char)thr);
+    const __m128i color = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i zero = _mm_setzero_si128();
+
+    Uint64 count = 0;
+    int i = 0;
+    while (n - i >= 4) {
+        // Per-byte counters, so we need to sum them up before they overflow.
+        int chunk = std::min((n - i) / 4, 255);
+        __m128i acc = zero;
+        for (int k = 0; k < chunk; ++k, i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(px + 4*i));
+            // Unsigned v >= thr  <=>  max(v, thr) == v. Gives 0xFF, i.e. -1, where true.
+            __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, vthr), v);
+            acc = _mm_sub_epi8(acc, _mm_and_si128(ge, color));
+        }
+        __m128i sad = _mm_sad_epu8(acc, zero);
+        count += _mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+    }
+    return count + count_bright_scalar(px + 4*i, n - i, thr);
+}
+#endif
+
+static Uint64 count_bright(const Uint8* px, int n, Uint8 thr)
+{
+#ifdef HAVE_SSE2
+    static const bool sse2 = SDL_HasSSE2() == SDL_TRUE;
+    if (sse2)
+        return count_bright_sse2(px, n, thr);
+#endif
+    return count_bright_scalar(px, n, thr);
+}
+
+void latency_begin(Uint64 start_us, int nflashes)
+{
+    std::mt19937 rng(1337);
+    std::uniform_int_distribution<Uint64> gap(GAP_MIN_US, GAP_MAX_US);
+
+    g_schedule.clear();
+    Uint64 t = start_us + 1000000;
+    for (int i = 0; i < nflashes; ++i, t += gap(rng))
+        g_schedule.push_back(t);
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_presented.clear();
+    g_detected.clear();
+    g_was_flash = false;
+    g_lo = 1.0; g_hi = 0.0;
+    g_cam_lit = false;
+    g_calibrating = true;
+}
+
+bool latency_calibrating()
+{
+    return g_calibrating;
+}
+
+bool latency_flash(Uint64 t_us)
+{
+    // The schedule is sorted, so find the last onset before `t_us`.
+    auto it = std::upper_bound(g_schedule.begin(), g_schedule.end(), t_us);
+    return it != g_schedule.begin() && t_us - *(it - 1) < FLASH_US;
+}
+
+void latency_presented(bool flash, Uint64 t_us)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+    if (flash && !g_was_flash)
+        g_presented.push_back(t_us);
+    g_was_flash = flash;
+}
+
+bool latency_done(Uint64 t_us)
+{
+    return g_schedule.empty() || t_us > g_schedule.back() + LATENCY_MAX_US;
+}
+
+void latency_observe(const Uint8* bgra, int pitch, int w, int h, Uint64 t_us)
+{
+    if (!g_calibrating)
+        return;
+
+    // Every 4th row is plenty to tell a white screen from a black one.
+    Uint64 lit = 0, total = 0;
+    for (int y = 0; y < h; y += 4) {
+        lit += count_bright(bgra + y*pitch, w, BRIGHT);
+        total += 3*w;
+    }
+    double frac = total ? double(lit) / total : 0.0;
+
+    // We don't know how much of the image the screen covers, so track the
+    // darkest and brightest we've seen and use the middle as a threshold.
+    g_lo = std::min(g_lo, frac);
+    g_hi = std::max(g_hi, frac);
+    if (g_hi - g_lo < 0.02)
+        return;
+
+    double mid = 0.5*(g_lo + g_hi);
+    bool lit_now = g_cam_lit ? frac > 0.8*mid : frac > mid;  // A bit of hysteresis.
+    if (lit_now && !g_cam_lit) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_detected.push_back(t_us);
+    }
+    g_cam_lit = lit_now;
+}
+
+double latency_finish()
+{
+    g_calibrating = false;
+
+    std::vector<double> lat;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+
+        // Every presentation up to LATENCY_MAX_US before a detection could be its
+        // own. Paired up right, they all share about the same latency; paired with
+        // an earlier flash, they're off by the gaps in between, which are jittered
+        // and so don't agree with each other. So the latency is the one the most
+        // pairs are within MATCH_US of.
+        std::vector<Uint64> pairs;
+        for (Uint64 d : g_detected)
+            for (Uint64 p : g_presented)
+                if (p <= d && d - p <= LATENCY_MAX_US)
+                    pairs.push_back(d - p);
+        std::sort(pairs.begin(), pairs.end());
+        Uint64 best = 0;
+        size_t best_n = 0;
+        for (size_t i = 0, j = 0; i < pairs.size(); ++i) {
+            while (pairs[i] - pairs[j] > 2*MATCH_US)
+                ++j;
+            if (i - j + 1 > best_n) {
+                best_n = i - j + 1;
+                best = (pairs[i] + pairs[j]) / 2;
+            }
+        }
+
+        // Then each detection with the presentation closest to that, if it's close
+        // enough. A presentation only counts once, a flicker right after isn't another flash.
+        std::vector<bool> matched(g_presented.size(), false);
+        for (Uint64 d : g_detected) {
+            Uint64 off = MATCH_US + 1;
+            size_t match = 0;
+            for (size_t i = 0; i < g_presented.size() && g_presented[i] <= d; ++i) {
+                Uint64 l = d - g_presented[i], o = l > best ? l - best : best - l;
+                if (o < off) {
+                    off = o;
+                    match = i;
+                }
+            }
+            if (off <= MATCH_US && !matched[match]) {
+                matched[match] = true;
+                lat.push_back(0.001*(d - g_presented[match]));
+            }
+        }
+        std::cout << "Latency calibration: presented " << g_presented.size()
+                  << " flashes, detected " << g_detected.size()
+                  << ", matched " << lat.size() << "." << std::endl;
+    }
+
+    if (lat.size() < 5) {
+        std::cout << "Too few flashes matched, is the camera pointing at the screen?" << std::endl;
+        return -1.0;
+    }
+
+    std::sort(lat.begin(), lat.end());
+    double mean = 0.0, var = 0.0;
+    for (double l : lat)
+        mean += l;
+    mean /= lat.size();
+    for (double l : lat)
+        var += (l - mean)*(l - mean);
+    double sd = std::sqrt(var / lat.size());
+    double median = lat[lat.size()/2];
+    double p95 = lat[std::min(lat.size() - 1, size_t(0.95*lat.size()))];
+
+    std::cout << "Display->camera latency [ms]: median " << median << ", mean " << mean
+              << ", sd " << sd << ", min " << lat.front() << ", p95 " << p95
+              << ", max " << lat.back() << std::endl;
+
+    std::ofstream f(latency_file());
+    f << median << " median_ms\n" << mean << " mean_ms\n" << sd << " sd_ms\n"
+      << lat.front() << " min_ms\n" << p95 << " p95_ms\n" << lat.back() << " max_ms\n"
+      << lat.size() << " count\n" << now() << " measured\n";
+    return median;
+}
+
+double latency_load_ms()
+{
+    std::ifstream f(latency_file());
+    double median = -1.0;
+    if (!(f >> median))
+        return -1.0;
+    return median;
+}
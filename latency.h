@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+// Measures the end-to-end latency between us presenting a frame and the camera
+// seeing it. For this, the camera has to look at the screen while we flash it
+// white at jittered intervals; the jitter is what makes matching a detected
+// flash to the presented one unambiguous, even when the latency is longer than
+// the time between flashes (see `latency_finish`). The result is saved in the
+// pref-path and written into the meta file of every following session.
+
+// Schedules `nflashes` flashes, the first one a second after `start_us`.
+void latency_begin(Uint64 start_us, int nflashes);
+bool latency_calibrating();
+
+// Render thread: whether the frame presented around `t_us` should be a flash.
+bool latency_flash(Uint64 t_us);
+// Render thread: call right after presenting, with what was shown.
+void latency_presented(bool flash, Uint64 t_us);
+// Whether the last flash is over and the camera had time to see it.
+bool latency_done(Uint64 t_us);
+
+// Capture thread: looks for flashes in a BGRA frame captured at `t_us`.
+void latency_observe(const Uint8* bgra, int pitch, int w, int h, Uint64 t_us);
+
+// Matches presentations to detections by the latency most of them agree on,
+// prints the distribution and saves it.
+// Returns the median latency in milliseconds, or a negative value on failure.
+double latency_finish();
+
+// The median latency saved by the last calibration, negative if there's none.
+double latency_load_ms();
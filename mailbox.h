@@ -0,0 +1,19 @@
+#pragma once
+
+#include <atomic>
+
+#include <SDL_stdinc.h>
+
+// Hands flags from one thread to another without either of them ever waiting:
+// posting ORs them in, taking swaps them all out at once. A flag posted again
+// before it was taken is only delivered once.
+class Mailbox {
+public:
+    Mailbox() : m_flags(0) {}
+
+    void post(Uint32 flags) { m_flags.fetch_or(flags, std::memory_order_release); }
+    Uint32 take() { return m_flags.exchange(0, std::memory_order_acquire); }
+
+private:
+    std::atomic<Uint32> m_flags;
+};
@@ -1,52 +1,105 @@
-#include <codecvt>
 #include <cstdlib>
-#include <ctime>
 #include <iostream>
-#include <locale>
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <SDL_image.h>
 
-#include <pxcsensemanager.h>
-
-// Some cleanup helpers.
-auto surf_deleter = [](SDL_Surface* s){ SDL_FreeSurface(s); };
-auto tex_deleter = [](SDL_Texture* t){ SDL_DestroyTexture(t); };
+#include "atlas.h"
+#include "bench.h"
+#include "blink.h"
+#include "capture.h"
+#include "choreography.h"
+#include "depthfilter.h"
+#include "facecrop.h"
+#include "glyphs.h"
+#include "headpose.h"
+#include "hud.h"
+#include "latency.h"
+#include "mailbox.h"
+#include "operator.h"
+#include "options.h"
+#include "pacer.h"
+#include "pointcloud.h"
+#include "registration.h"
+#include "preview.h"
+#include "pupil.h"
+#include "quality.h"
+#include "session.h"
+#include "sharpness.h"
+#include "spritebatch.h"
+#include "stimuli.h"
+#include "timing.h"
+#include "trajectory.h"
+#include "verify.h"
 
 // As global so we can use atexit.
-PXCSenseManager *g_sm = nullptr;
 SDL_Window *g_window = nullptr;
+SDL_Window *g_operator_window = nullptr;
 SDL_Renderer *g_renderer = nullptr;
-TTF_Font *g_font = nullptr;
 
 enum {
     TEXT_INSTRUCTION = 0,
     TEXT_START,
     TEXT_QUIT,
     TEXT_FILE,
+    TEXT_CALIBRATE,
     TEXT_COUNT
 };
-std::unique_ptr<SDL_Texture, decltype(tex_deleter)> g_texts[TEXT_COUNT] = { nullptr };
+const char* g_texts[TEXT_COUNT] = {
+    "Follow the green dot with your eyes.",
+    "Press any key to start.",
+    "Press any key to quit.",
+    "Recording into the ~User/AppData/Roaming/...",
+    "Point the camera at the screen, this measures its latency.",
+};
+
+// Everything on screen is a sprite in this atlas, and a frame is drawn as one batch of them.
+// That includes the glyphs of `g_text`, so any text can be drawn without rasterizing it.
+Atlas g_atlas;
+SpriteBatch g_sprites;
+GlyphFont g_text;
+GlyphFont g_small_text;
+
+// What the main thread's event handling tells the render thread.
+enum {
+    CMD_ADVANCE = 1 << 0,
+    CMD_TOGGLE_HUD = 1 << 1,
+    CMD_QUIT = 1 << 2,
+};
+Mailbox g_commands;
 
-// Makes our error-checking life a little easier.
-bool pxc_verify(pxcStatus ret, std::string msg);
-bool sdl_verify(int ret, std::string msg);
-bool ttf_verify(int ret, std::string msg);
-bool init_realsense();
-std::unique_ptr<SDL_Texture, decltype(tex_deleter)> mktxt(const char* txt);
+// Everything from creating the renderer to quitting, on its own thread.
+// Returns what `main` should.
+static int render_loop(const Options& opt);
 
+// Writes the trajectory sampled at `hz` into the session, for labelling frames offline.
+void write_ground_truth(const Trajectory& traj, int hz);
+
+// Adds `txt` to this frame's batch, centered on x,y.
 // x,y are relative screen coordinates, 0 being top/left and 1 being bottom/right.
 // w,h are screen resolution.
-void rendermid(SDL_Texture* tex, double x, double y, int w, int h);
-
-double lerp(double t, double x0, double x1, double t0, double t1) { return x0 + (t - t0) / (t1 - t0) * (x1 - x0); };
+void rendermid(const char* txt, double x, double y, int w, int h);
 
 int main(int argc, char **argv)
 {
+    Options opt;
+    if (!parse_options(argc, argv, opt))
+        return 1;
+    if (!opt.bench.empty())
+        return run_bench(opt.bench);
+
+    // Without a display, SDL's dummy video driver gives us a window to render into
+    // that nobody sees, and there may be no sound card either.
+    if (opt.headless) {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    }
+
     if (!sdl_verify(SDL_Init(SDL_INIT_EVERYTHING), "initializing SDL"))
         return 1;
     std::atexit(SDL_Quit);
@@ -60,48 +113,203 @@ int main(int argc, char **argv)
     if (!sdl_verify(isInitPngSet ? 0 : -1 , "initializing SDL Image"))
         return 1;
 
-    // Gets `g_sm` ready for recording what we need.
-    if (!init_realsense())
+    // The latency calibration doesn't record anything, so it doesn't need a session.
+    if (!opt.calibrate_latency) {
+        if (!session_open())
+            return 2;
+
+        double latency_ms = latency_load_ms();
+        if (latency_ms >= 0)
+            session_meta("display_to_camera_latency_ms", latency_ms);
+        else
+            std::cout << "No display->camera latency measured yet, consider running with --calibrate-latency." << std::endl;
+    }
+
+    // Gets the SDK ready for recording what we need. With face crops, those are the recording,
+    // infrared's included (see `FaceCropStage`).
+    if (!opt.no_camera && !init_realsense(!opt.calibrate_latency && !opt.face_crop, opt.ir))
         return 2;
 
-    // Open up a window.
+    // The online processing of what's captured, on worker threads of their own.
+    std::vector<std::unique_ptr<Stage>> stages;
+    if (capture_ready() && !opt.calibrate_latency) {
+        bool needs_color = opt.register_depth || opt.face_crop || (opt.blinks && !opt.ir) || opt.sharpness;
+        bool needs_ir = opt.pupils || (opt.blinks && opt.ir);
+        bool needs_depth = needs_color || needs_ir || opt.pointcloud || opt.head_pose;
+        Intrinsics depth, color, ir;
+        Extrinsics depth_to_color, depth_to_ir;
+        if (needs_depth && !capture_intrinsics(STREAM_DEPTH, depth)) {
+            show_error("RealSense Error", "Unable to get the depth camera's calibration.");
+            return 2;
+        }
+        if (needs_color && (!capture_intrinsics(STREAM_COLOR, color) ||
+                            !capture_extrinsics(STREAM_DEPTH, STREAM_COLOR, depth_to_color))) {
+            show_error("RealSense Error", "Unable to get the color camera's calibration.");
+            return 2;
+        }
+        if (needs_ir && !capture_intrinsics(STREAM_IR, ir)) {
+            show_error("RealSense Error", "Unable to get the infrared camera's calibration.");
+            return 2;
+        }
+        // Infrared comes from the depth camera itself, so when the SDK doesn't
+        // know, they're the same.
+        if (needs_ir && !capture_extrinsics(STREAM_DEPTH, STREAM_IR, depth_to_ir)) {
+            for (int i = 0; i < 9; ++i)
+                depth_to_ir.r[i] = i % 4 == 0 ? 1.0f : 0.0f;
+            depth_to_ir.t[0] = depth_to_ir.t[1] = depth_to_ir.t[2] = 0.0f;
+        }
+
+        if (opt.pointcloud)
+            stages.emplace_back(new PointCloudStage(depth));
+        if (opt.register_depth)
+            stages.emplace_back(new RegistrationStage(depth, color, depth_to_color, opt.aligned_depth));
+        if (opt.face_crop)
+            stages.emplace_back(new FaceCropStage(depth, color, depth_to_color, opt.keyframe_interval, opt.ir));
+        if (opt.filter_depth)
+            stages.emplace_back(new DepthFilterStage);
+        if (opt.quality)
+            stages.emplace_back(new QualityStage);
+        if (opt.blinks && opt.ir)
+            stages.emplace_back(new BlinkStage(depth, ir, depth_to_ir, STREAM_IR));
+        else if (opt.blinks)
+            stages.emplace_back(new BlinkStage(depth, color, depth_to_color, STREAM_COLOR));
+        if (opt.sharpness)
+            stages.emplace_back(new SharpnessStage(depth, color, depth_to_color));
+        if (opt.head_pose)
+            stages.emplace_back(new HeadPoseStage(depth));
+        if (opt.pupils)
+            stages.emplace_back(new PupilStage(depth, ir, depth_to_ir));
+        for (auto& stage : stages)
+            capture_add_stage(stage.get());
+    }
+
+    // Prefer SDL's OpenGL renderer, that's the one `SpriteBatch` can batch draws with.
+    // SDL falls back to any other one if it's not available. Headless, only software rendering is.
+    SDL_SetHint(SDL_HINT_RENDER_DRIVER, opt.headless ? "software" : "opengl");
+
+    // In dual-display mode the participant only sees the stimuli, and the operator
+    // gets their own window on another display, see `operator.h`.
+    bool dual = opt.operator_display >= 0;
+    int ndisplays = SDL_GetNumVideoDisplays();
+    if (opt.stimulus_display >= ndisplays || opt.operator_display >= ndisplays) {
+        show_error("SDL Error", "There are only " + std::to_string(ndisplays) + " displays.");
+        return 3;
+    }
+
+    // Open up a window. Headless, one the size of a typical fullscreen one.
 #ifdef _DEBUG
-    if (!sdl_verify(SDL_CreateWindowAndRenderer(640, 480, 0, &g_window, &g_renderer), "opening a window"))
+    int win_w = 640, win_h = 480;
+    Uint32 win_flags = 0;
 #else
-    if (!sdl_verify(SDL_CreateWindowAndRenderer(0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP, &g_window, &g_renderer), "opening a window"))
+    int win_w = 0, win_h = 0;
+    Uint32 win_flags = SDL_WINDOW_FULLSCREEN_DESKTOP;
 #endif
+    if (opt.headless) {
+        win_w = 1920, win_h = 1080;
+        win_flags = 0;
+    }
+    int win_pos = opt.stimulus_display >= 0 ? SDL_WINDOWPOS_CENTERED_DISPLAY(opt.stimulus_display) : SDL_WINDOWPOS_UNDEFINED;
+    g_window = SDL_CreateWindow("RealSense Gaze Recorder", win_pos, win_pos, win_w, win_h, win_flags);
+    if (!sdl_verify(g_window == nullptr, "opening a window"))
         return 3;
     atexit([](){ SDL_DestroyWindow(g_window); });
-    atexit([](){ SDL_DestroyRenderer(g_renderer); });
+
+    if (dual) {
+        int op_pos = SDL_WINDOWPOS_CENTERED_DISPLAY(opt.operator_display);
+        g_operator_window = SDL_CreateWindow("RealSense Gaze Recorder - Operator", op_pos, op_pos, 1280, 720, 0);
+        if (!sdl_verify(g_operator_window == nullptr, "opening the operator's window"))
+            return 3;
+        atexit([](){ SDL_DestroyWindow(g_operator_window); });
+    }
+
+    // The main thread only handles events from here on, and tells the render thread
+    // what the user wants through `g_commands`. So a burst of events, or the main
+    // thread being stuck in some modal loop of the OS, never holds up a frame.
+    // The window can't be resized, so SDL never pokes the renderer from this thread.
+    if (dual)
+        operator_start(g_operator_window);
+    session_watch_start();
+    int exit_code = 0;
+    std::thread render_thread([&opt, &exit_code](){
+        exit_code = render_loop(opt);
+
+        // Done, one way or another, so wake up the main thread.
+        SDL_Event quit;
+        quit.type = SDL_QUIT;
+        SDL_PushEvent(&quit);
+    });
+
+    SDL_Event e = { 0 };
+    while (SDL_WaitEvent(&e)) {
+        if (e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_F1) {
+            if (dual)
+                operator_toggle_hud();
+            else
+                g_commands.post(CMD_TOGGLE_HUD);
+        }
+        else if (e.type == SDL_KEYUP) {
+            g_commands.post(CMD_ADVANCE);
+        }
+        else if (e.type == SDL_QUIT || (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_CLOSE)) {
+            g_commands.post(CMD_QUIT);
+            break;
+        }
+        // Ignore all other kinds of events.
+    }
+    render_thread.join();
+    operator_stop();
+    session_watch_stop();
+
+    // In case we got quit in the middle of a recording.
+    capture_stop();
+    session_close();
+
+    return exit_code;
+}
+
+static int render_loop(const Options& opt)
+{
+    // With vsync, presenting waits for the display instead of us spinning through frames.
+    Uint32 flags = opt.headless ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+    g_renderer = SDL_CreateRenderer(g_window, -1, flags);
+    if (!sdl_verify(g_renderer == nullptr, "creating a renderer"))
+        return 3;
+
+    // Everything holding on to the renderer has to go before it, and on this thread.
+    struct Teardown {
+        ~Teardown() {
+            g_atlas.clear();
+            SDL_DestroyRenderer(g_renderer);
+            g_renderer = nullptr;
+        }
+    } teardown;
+
+    FramePacer pacer;
+    pacer.init(g_window, g_renderer);
+    if (opt.speed != 1.0)
+        pacer.speed_up(opt.speed);
 
     // Get the window's w/h.
     int w, h;
     SDL_GL_GetDrawableSize(g_window, &w, &h);
 
-    // Load a default font.
-    if (!ttf_verify((g_font = TTF_OpenFont("data/Orbitron Medium.ttf", 24)) == nullptr, "opening the Orbitron font"))
+    // Load a default font, and a smaller one for the performance HUD.
+    if (!ttf_verify(g_text.load("data/Orbitron Medium.ttf", 24, g_atlas) ? 0 : -1, "loading the Orbitron font"))
+        return 4;
+    if (!ttf_verify(g_small_text.load("data/Orbitron Medium.ttf", 14, g_atlas) ? 0 : -1, "loading the Orbitron font"))
         return 4;
-    atexit([](){ TTF_CloseFont(g_font); });
-
-    g_texts[TEXT_INSTRUCTION] = mktxt("Follow the green dot with your eyes.");
-    g_texts[TEXT_START] = mktxt("Press any key to start.");
-    g_texts[TEXT_QUIT] = mktxt("Press any key to quit.");
-    g_texts[TEXT_FILE] = mktxt("Recording into the ~User/AppData/Roaming/...");
-    for (int i = 0; i < TEXT_COUNT; ++i)
-        if (g_texts[i] == nullptr)
-            return 5;
-
-    // Load Mr.Point into a texture.
-    SDL_Surface* mrpoint_surf = IMG_Load("data/mrpoint.png");
-    if (!sdl_verify(mrpoint_surf == nullptr, "loading Mr.Point"))
+
+    // Load Mr.Point.
+    int mrpoint = g_atlas.add(IMG_Load("data/mrpoint.png"));
+    if (!sdl_verify(mrpoint < 0, "loading Mr.Point"))
         return 6;
-    std::unique_ptr<SDL_Texture, decltype(tex_deleter)> mrpoint(
-        SDL_CreateTextureFromSurface(g_renderer, mrpoint_surf),
-        tex_deleter
-    );
-    SDL_FreeSurface(mrpoint_surf);
-    if (!sdl_verify(mrpoint == nullptr, "loading Mr.Point texture"))
+
+    // And pack them all into one texture, which must be freed before the renderer is.
+    // It's filtered linearly for drawing the stimuli in between pixels.
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+    if (!sdl_verify(g_atlas.build(g_renderer) ? 0 : -1, "packing the sprites into a texture"))
         return 6;
+    g_sprites.init(g_renderer);
 
     // This is an extremely simple state-machine for handling input with the states
     // preparing -> recording -> done.
@@ -112,207 +320,181 @@ int main(int argc, char **argv)
         STATE_QUIT,
     } state = STATE_PRE;
 
-    // The current position of Mr.Point (in relative screen-coordinates).
-    double x = 0.01, y = 0.01;
+    // Where Mr.Point is going, see `trajectory.h`.
+    Trajectory traj = standard_trajectory(opt.trajectory);
+    if (!opt.calibrate_latency) {
+        session_meta("trajectory", shape_name(opt.trajectory));
+        session_meta("choreography_speed", opt.speed);
+        write_ground_truth(traj, 500);
+    }
+
+    // Mr.Point and its distractors, if any. It waits in the top-left corner until we start.
+    StimulusSet stimuli;
+    stimuli.init(g_atlas.rect(mrpoint), w, h, g_sprites.is_gl());
+    stimuli.setup(traj, opt.distractors, 1337);
+    stimuli.hold(Point{ 0.01, 0.01 });
+    if (!opt.calibrate_latency) {
+        session_meta("distractors", opt.distractors);
+        session_meta("stimulus_step_px", stimuli.step_px());
+    }
+
+    // Where everyone was in every frame we rendered while recording.
+    SessionLog stimulus_log;
+    unsigned frame = 0;
 
     // Remembers at what time the recording started.
-    Uint32 t0 = 0;
+    Uint64 t0 = 0;
+
+    // The camera preview needs frames before the recording starts. Note that the
+    // SDK records everything we capture, so the start is marked in the meta.
+    // With an operator's window, the preview is there for the whole session instead.
+    bool dual = opt.operator_display >= 0;
+    bool pip = opt.preview && !dual;
+    PreviewRenderer preview;
+    if (opt.preview || dual) {
+        preview.init(g_renderer);
+        preview_enable(true);
+        capture_start();
+    }
 
-    // A separate thread for recording, otherwise we're LAGGY.
-    std::thread record_thread;
+    // F1 toggles it. The stimuli can be anywhere on the display, so it's not drawn
+    // while they play (or flash for the latency calibration), only before and after.
+    // With an operator's window, it's over there, for the whole session.
+    PerfHud hud;
+    hud.init(&g_small_text);
+    hud.show(opt.hud && !dual);
+    RenderStats render_stats;
+
+    // For the operator's window, if there is one.
+    const char* STATE_NAMES[] = { "Waiting to start", "Recording", "Done", "Quitting" };
+    double t = 0.0;
 
-    SDL_Event e = { 0 };
     while (state != STATE_QUIT) {
-        // Handle all events before moving to the next frame!
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_KEYUP) {
-                // Start recording when the user presses a key!
-                if (state == STATE_PRE) {
-                    state = STATE_RECORDING;
-                    t0 = SDL_GetTicks();
-                    
-                    // Start the other thread which will record the video.
-                    record_thread = std::move(std::thread([](State* pstate){
-                        // Only record when we should be recording, duh!
-                        while (*pstate == STATE_RECORDING) {
-                            // It seems that acquiring frames is necessary for the recording to record anything!
-                            // I tried just idling in a MessageBox and it didn't work.
-
-                            // Waits until new frame is available and locks it for application processing.
-                            if (!pxc_verify(g_sm->AcquireFrame(true), "Acquiring frame"))
-                                break;  // TODO: Apparently one should recover from PXC_STATUS_STREAM_CONFIG_CHANGED?
-
-                            // Done working with the frame.
-                            g_sm->ReleaseFrame();
-                        }
-                    }, &state));
-                }
-                // When done recording, quit upon a keypress.
-                else if (state == STATE_DONE) {
-                    state = STATE_QUIT;
-                    break;
-                }
-            }
-            else if (e.type == SDL_QUIT) {
-                state = STATE_QUIT;
-                break;
-            }
-            // Ignore all other kinds of events.
+        pacer.begin_frame();
+
+        // Whatever the main thread got from the user since the last frame.
+        Uint32 commands = g_commands.take();
+        if (commands & CMD_TOGGLE_HUD)
+            hud.toggle();
+        if (commands & CMD_QUIT) {
+            state = STATE_QUIT;
+            break;
         }
 
-        // Update the dot's position according to the "storyline".
-        if (state == STATE_RECORDING) {
-            double t = 0.001*(SDL_GetTicks() - t0);
-
-            // That's the choreography!
+        // Headless, nobody presses keys, so move on as soon as a frame of the state was shown.
+        bool advance = (commands & CMD_ADVANCE) || (opt.headless && state != STATE_RECORDING && pacer.last_present_us() != 0);
+
+        // Start recording when the user presses a key!
+        if (advance && state == STATE_PRE) {
+            state = STATE_RECORDING;
+            // The choreography starts with the first frame shown, see below.
+            t0 = pacer.predict_present_us();
+            pacer.reset_stats();
+            preview_enable(dual);
+            session_meta("choreography_start_us", std::to_string(t0));
+            if (opt.calibrate_latency)
+                latency_begin(t0, 40);
+            else
+                stimulus_log.open("stimulus", stimuli.log_header().c_str());
+
+            // Start the other thread which will record the video, unless the preview already did.
+            capture_start();
+        }
+        // When done recording, quit upon a keypress.
+        else if (advance && state == STATE_DONE) {
+            state = STATE_QUIT;
+            break;
+        }
 
-            // Move along the screen border once
-            if (0 <= t && t < 3) {
-                x = lerp(t, 0.01, 0.99, 0, 3);
-            }
-            else if (3 <= t && t < 5) {
-                y = lerp(t, 0.01, 0.99, 3, 5);
-            }
-            else if (5 <= t && t < 8) {
-                x = lerp(t, 0.99, 0.01, 5, 8);
-            }
-            else if (8 <= t && t < 10) {
-                y = lerp(t, 0.99, 0.01, 8, 10);
-            }
-            // Then zig-zag just like regular reading.
-            else if (10 <= t && t < 14) {
-                x = lerp(t, 0.01, 0.99, 10, 14);
-            }
-            else if (14 <= t && t < 15) {
-                x = lerp(t, 0.99, 0.01, 14, 15);
-                y = lerp(t, 0.01, 0.20, 14, 15);
-            }
-            else if (15 <= t && t < 19) {
-                x = lerp(t, 0.01, 0.99, 15, 19);
-            }
-            else if (19 <= t && t < 20) {
-                x = lerp(t, 0.99, 0.01, 19, 20);
-                y = lerp(t, 0.20, 0.40, 19, 20);
-            }
-            else if (20 <= t && t < 24) {
-                x = lerp(t, 0.01, 0.99, 20, 24);
-            }
-            else if (24 <= t && t < 25) {
-                x = lerp(t, 0.99, 0.01, 24, 25);
-                y = lerp(t, 0.40, 0.60, 24, 25);
-            }
-            else if (25 <= t && t < 29) {
-                x = lerp(t, 0.01, 0.99, 25, 29);
-            }
-            else if (29 <= t && t < 30) {
-                x = lerp(t, 0.99, 0.01, 29, 30);
-                y = lerp(t, 0.60, 0.80, 29, 30);
-            }
-            else if (30 <= t && t < 34) {
-                x = lerp(t, 0.01, 0.99, 30, 34);
-            }
-            else if (34 <= t && t < 35) {
-                x = lerp(t, 0.99, 0.01, 34, 35);
-                y = lerp(t, 0.80, 0.99, 34, 35);
-            }
-            else if (35 <= t && t < 39) {
-                x = lerp(t, 0.01, 0.99, 35, 39);
-            }
-            else if (39 <= t && t < 40) {
-                x = lerp(t, 0.99, 0.01, 39, 40);
-                y = lerp(t, 0.99, 0.01, 39, 40);
-            }
-            // Then zig-zag vertically.
-            else if (40 <= t && t < 44) {
-                y = lerp(t, 0.01, 0.99, 40, 44);
-            }
-            else if (44 <= t && t < 45) {
-                x = lerp(t, 0.01, 0.20, 44, 45);
-                y = lerp(t, 0.99, 0.01, 44, 45);
-            }
-            else if (45 <= t && t < 49) {
-                y = lerp(t, 0.01, 0.99, 45, 49);
-            }
-            else if (49 <= t && t < 50) {
-                x = lerp(t, 0.20, 0.40, 49, 50);
-                y = lerp(t, 0.99, 0.01, 49, 50);
-            }
-            else if (50 <= t && t < 54) {
-                y = lerp(t, 0.01, 0.99, 50, 54);
-            }
-            else if (54 <= t && t < 55) {
-                x = lerp(t, 0.40, 0.60, 54, 55);
-                y = lerp(t, 0.99, 0.01, 54, 55);
-            }
-            else if (55 <= t && t < 59) {
-                y = lerp(t, 0.01, 0.99, 55, 59);
-            }
-            else if (59 <= t && t < 60) {
-                x = lerp(t, 0.60, 0.80, 59, 60);
-                y = lerp(t, 0.99, 0.01, 59, 60);
-            }
-            else if (60 <= t && t < 64) {
-                y = lerp(t, 0.01, 0.99, 60, 64);
-            }
-            else if (64 <= t && t < 65) {
-                x = lerp(t, 0.80, 0.99, 64, 65);
-                y = lerp(t, 0.99, 0.01, 64, 65);
-            }
-            else if (65 <= t && t < 69) {
-                y = lerp(t, 0.01, 0.99, 65, 69);
-            }
-            else if (69 <= t && t < 70) {
-                x = lerp(t, 0.99, 0.01, 69, 70);
-                y = lerp(t, 0.99, 0.01, 69, 70);
+        // The latency calibration has no storyline, it just flashes until it's done.
+        if (state == STATE_RECORDING && opt.calibrate_latency) {
+            if (latency_done(host_us())) {
+                state = STATE_DONE;
+                capture_stop();
+                latency_finish();
             }
-            // Switch over to done state.
-            else {
+        }
+        // Update the dot's position according to the "storyline".
+        else if (state == STATE_RECORDING) {
+            // Everyone goes where they should be when this frame will be on screen,
+            // not where they were when we started building it.
+            Uint64 present_us = pacer.predict_present_us();
+            t = opt.speed * 1e-6 * (present_us - t0);
+
+            // That's the choreography, see `choreography.h`! Switch over to done state once it's over.
+            if (stimuli.update(t)) {
+                stimuli.log(stimulus_log, frame++, present_us);
+            } else {
                 state = STATE_DONE;
-                record_thread.join();
+                capture_stop();
+                stimulus_log.close();
+                pacer.report();
+                std::cout << "The " << t << " s choreography took " << 1e-6 * (host_us() - t0) << " s." << std::endl;
             }
         }
 
-        // Clear the screen in black.
-        SDL_SetRenderDrawColor(g_renderer, 0, 0, 0, 255);
+        // Clear the screen in black, or white when flashing for the latency calibration.
+        bool flash = state == STATE_RECORDING && opt.calibrate_latency && latency_flash(host_us());
+        Uint8 bg = flash ? 255 : 0;
+        SDL_SetRenderDrawColor(g_renderer, bg, bg, bg, 255);
         SDL_RenderClear(g_renderer);
 
-        // The rendering.
+        // The rendering, all of it in one batch.
+        g_sprites.begin(g_atlas.texture());
         switch (state) {
         case STATE_PRE:
-            rendermid(g_texts[TEXT_INSTRUCTION].get(), 0.5, 0.33, w, h);
-            rendermid(g_texts[TEXT_START].get(), 0.5, 0.66, w, h);
-            rendermid(mrpoint.get(), x, y, w, h);
+            if (pip) {
+                // Small enough in the bottom corners not to get in the way of the texts.
+                int pw = w / 4, ph = pw * 3 / 4, margin = 16;
+                SDL_Rect color_dst = { margin, h - ph - margin, pw, ph };
+                SDL_Rect depth_dst = { w - pw - margin, h - ph - margin, pw, ph };
+                preview.update();
+                preview.render(color_dst, depth_dst);
+            }
+            rendermid(g_texts[opt.calibrate_latency ? TEXT_CALIBRATE : TEXT_INSTRUCTION], 0.5, 0.33, w, h);
+            rendermid(g_texts[TEXT_START], 0.5, 0.66, w, h);
+            if (!opt.calibrate_latency)
+                stimuli.render(g_sprites);
             break;
         case STATE_RECORDING:
-            rendermid(mrpoint.get(), x, y, w, h);
+            if (!opt.calibrate_latency)
+                stimuli.render(g_sprites);
             break;
         case STATE_DONE:
-            rendermid(g_texts[TEXT_QUIT].get(), 0.5, 0.5, w, h);
+            rendermid(g_texts[TEXT_QUIT], 0.5, 0.5, w, h);
             break;
         }
-
-        // Swap framebuffers.
-        SDL_RenderPresent(g_renderer);
+        if (hud.visible() && state != STATE_RECORDING) {
+            // Bottom left, above the color preview if there is one.
+            int hw, hh, margin = 16;
+            hud.size(&hw, &hh);
+            int bottom = state == STATE_PRE && pip ? h - (w / 4) * 3 / 4 - margin : h;
+            hud.render(g_sprites, float(margin), float(bottom - hh - margin));
+        }
+        g_sprites.end();
+
+        // Swap framebuffers, at the display's pace.
+        pacer.present();
+        render_stats.presented(pacer.last_present_us());
+        hud.update(pacer.last_present_us());
+        operator_status(opt.calibrate_latency && state == STATE_RECORDING ? "Calibrating" : STATE_NAMES[state], t, traj.duration() / opt.speed);
+        if (state == STATE_RECORDING && opt.calibrate_latency)
+            latency_presented(flash, host_us());
     }
 
     return 0;
 }
 
-bool pxc_verify(pxcStatus ret, std::string msg)
+void show_error(const char* title, const std::string& text)
 {
-    if (ret < PXC_STATUS_NO_ERROR) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "RealSense Error", ("RealSense error #" + std::to_string(ret) + ": " + msg).c_str(), nullptr);
-        return false;
-    }
-    if (ret > PXC_STATUS_NO_ERROR)
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "RealSense Error", ("RealSense warning #" + std::to_string(ret) + ": " + msg).c_str(), nullptr);
-    return true;
+    std::cerr << title << ": " << text << std::endl;
+    SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, title, text.c_str(), nullptr);
 }
 
 bool sdl_verify(int ret, std::string msg)
 {
     if (ret != 0) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Error", ("Error " + msg + ": " + SDL_GetError()).c_str(), nullptr);
+        show_error("SDL Error", "Error " + msg + ": " + SDL_GetError());
         return false;
     }
     return true;
@@ -321,90 +503,33 @@ bool sdl_verify(int ret, std::string msg)
 bool ttf_verify(int ret, std::string msg)
 {
     if (ret != 0) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Error", ("Error " + msg + ": " + TTF_GetError()).c_str(), nullptr);
+        show_error("SDL Error", "Error " + msg + ": " + TTF_GetError());
         return false;
     }
     return true;
 }
 
-// Current date and time as almost-ISO string.
-std::string now()
+void rendermid(const char* txt, double x, double y, int w, int h)
 {
-    std::time_t rawtime;
-    std::time(&rawtime);
-
-    char buffer[80];
-    std::strftime(buffer, 80, "%Y-%m-%d-%H-%M-%S", std::localtime(&rawtime));
-    return std::string(buffer);
-}
-
-bool init_realsense()
-{
-    // Initialize RealSense
-    if ((g_sm = PXCSenseManager::CreateInstance()) == nullptr) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "RealSense Error", "Unable to create the SenseManager.", nullptr);
-        return false;
-    }
-    std::atexit([](){ g_sm->Release(); });
-
-    // Sets file recording or playback
-    char *pszPath = SDL_GetPrefPath("Beymans", "RealSenseRecorder");
-    if (!pszPath) {
-        SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "SDL Error", "Can't retrieve your home directory. What the!?", nullptr);
-        return false;
-    }
-    std::string utf8path = pszPath + now() + ".rssdk";
-    SDL_free(pszPath);
-    std::cout << "Recording to " << utf8path << std::endl;
-
-    // Damn you RealSense!
-    std::wstring path = std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(utf8path);
-    if (!pxc_verify(g_sm->QueryCaptureManager()->SetFileName(path.c_str(), true), "Setting filename for recording."))
-        return false;
-
-    // Chooses what streams we want to capture.
-    if (!pxc_verify(g_sm->EnableStream(PXCCapture::STREAM_TYPE_COLOR, 640, 480, 30), "Enabling RGB stream."))
-        return false;
-    if (!pxc_verify(g_sm->EnableStream(PXCCapture::STREAM_TYPE_DEPTH, 640, 480, 30), "Enabling D stream. Yup Alex, can't get the D!"))
-        return false;
-
-    return pxc_verify(g_sm->Init(), "Initialize the capture.");
-}
+    int tw, th;
+    g_text.size(txt, &tw, &th);
 
-std::unique_ptr<SDL_Texture, decltype(tex_deleter)> mktxt(const char* txt)
-{
+    //Setup the text to be at the (pixel) position we want.
     SDL_Color white = { 255, 255, 255, 255 };
+    g_text.draw(g_sprites, txt, float(x*w - tw*0.5), float(y*h - th*0.5), white, 1);
+}
 
-    //We need to first render to a surface as that's what TTF_RenderText
-    //returns, then load that surface into a texture
-    std::unique_ptr<SDL_Surface, decltype(surf_deleter)> surf(
-        TTF_RenderText_Blended(g_font, txt, white),
-        surf_deleter
-    );
-
-    if (!ttf_verify(surf == nullptr, "writing some text."))
-        return nullptr;
-
-    std::unique_ptr<SDL_Texture, decltype(tex_deleter)> tex(
-        SDL_CreateTextureFromSurface(g_renderer, surf.get()),
-        tex_deleter
-    );
-    sdl_verify(tex == nullptr, "moving the surface to a texture.");
-    return tex;
-};
-
-void rendermid(SDL_Texture* tex, double x, double y, int w, int h)
+void write_ground_truth(const Trajectory& traj, int hz)
 {
-    // Get the texture w/h.
-    int tw, th;
-    SDL_QueryTexture(tex, NULL, NULL, &tw, &th);
+    SessionLog log;
+    if (!log.open("trajectory", "t,x,y"))
+        return;
 
-    //Setup the destination rectangle to be at the (pixel) position we want.
-    SDL_Rect dst;
-    dst.x = int(x*w - tw*0.5);
-    dst.y = int(y*h - th*0.5);
+    std::vector<double> t(size_t(traj.duration() * hz)), x(t.size()), y(t.size());
+    for (size_t i = 0; i < t.size(); ++i)
+        t[i] = double(i) / hz;
+    traj.at_batch(t.data(), t.size(), x.data(), y.data());
 
-    //Query the texture to get its width and height to use
-    SDL_QueryTexture(tex, NULL, NULL, &dst.w, &dst.h);
-    SDL_RenderCopy(g_renderer, tex, NULL, &dst);
+    for (size_t i = 0; i < t.size(); ++i)
+        log.row("%.6f,%.6f,%.6f", t[i], x[i], y[i]);
 }
@@ -0,0 +1,137 @@
+#include "operator.h"
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "atlas.h"
+#include "counters.h"
+#include "glyphs.h"
+#include "hud.h"
+#include "pacer.h"
+#include "preview.h"
+#include "quality.h"
+#include "spritebatch.h"
+#include "timing.h"
+#include "verify.h"
+
+// Plenty for watching a preview that updates at 10 Hz.
+static const double RATE_HZ = 30;
+
+static std::atomic<const char*> g_state("Starting");
+static std::atomic<Uint32> g_t_ms(0), g_duration_ms(0);
+
+static SDL_Window* g_window = nullptr;
+static std::atomic<bool> g_running(false), g_toggle_hud(false);
+static std::thread g_thread;
+
+void operator_status(const char* state, double t, double duration)
+{
+    g_state.store(state, std::memory_order_relaxed);
+    g_t_ms.store(Uint32(1000 * t), std::memory_order_relaxed);
+    g_duration_ms.store(Uint32(1000 * duration), std::memory_order_relaxed);
+}
+
+static void operator_loop(SDL_Renderer* renderer)
+{
+    int w, h;
+    SDL_GetRendererOutputSize(renderer, &w, &h);
+
+    // Everything of this window's is its own, textures can't be shared between renderers.
+    Atlas atlas;
+    GlyphFont text, small_text;
+    if (!text.load("data/Orbitron Medium.ttf", 20, atlas) || !small_text.load("data/Orbitron Medium.ttf", 14, atlas) || !atlas.build(renderer)) {
+        show_error("SDL Error", "Can't set up the operator's window.");
+        return;
+    }
+    SpriteBatch sprites;
+    sprites.init(renderer);
+
+    PreviewRenderer preview;
+    preview.init(renderer);
+
+    PerfHud hud;
+    hud.init(&small_text);
+    hud.show(true);
+
+    FramePacer pacer;
+    pacer.init(g_window, renderer);
+    pacer.set_rate(RATE_HZ);
+
+    SDL_Color white = { 255, 255, 255, 255 };
+    SDL_Color red = { 255, 64, 64, 255 };
+    char status[128];
+    while (g_running) {
+        pacer.begin_frame();
+        if (g_toggle_hud.exchange(false))
+            hud.toggle();
+
+        SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
+        SDL_RenderClear(renderer);
+
+        // Color and depth side by side across the top, as large as they fit.
+        int margin = 16;
+        int pw = (w - 3*margin) / 2, ph = pw * 3 / 4;
+        if (ph > h / 2) {
+            ph = h / 2;
+            pw = ph * 4 / 3;
+        }
+        SDL_Rect color_dst = { margin, margin, pw, ph };
+        SDL_Rect depth_dst = { 2*margin + pw, margin, pw, ph };
+        preview.update();
+        preview.render(color_dst, depth_dst);
+
+        sprites.begin(atlas.texture());
+        std::sprintf(status, "%s  %.1f / %.1f s\nAny key starts and quits, F1 toggles the HUD.",
+                     g_state.load(std::memory_order_relaxed),
+                     0.001 * g_t_ms.load(std::memory_order_relaxed), 0.001 * g_duration_ms.load(std::memory_order_relaxed));
+        text.draw(sprites, status, float(margin), float(2*margin + ph), white);
+        // Where it can't be missed.
+        int quality = g_counters.quality_flags.load(std::memory_order_relaxed);
+        int behind = g_counters.recording_queued.load(std::memory_order_relaxed);
+        std::string warning;
+        if (quality > 0)
+            warning = "Participant: " + quality_text(Uint32(quality));
+        if (behind > RECORDING_QUEUED_WARN)
+            warning += (warning.empty() ? "" : "  ") + std::string("Disk too slow, recording falls behind!");
+        if (!warning.empty())
+            text.draw(sprites, warning.c_str(), float(margin), float(2*margin + ph + 2*text.line_height()), red);
+        hud.update(host_us());
+        hud.render(sprites, float(margin), float(2*margin + ph + 4*text.line_height()));
+        sprites.end();
+
+        pacer.present();
+    }
+
+    // The textures have to go before the renderer.
+    preview.clear();
+    atlas.clear();
+}
+
+void operator_start(SDL_Window* window)
+{
+    g_window = window;
+    g_running = true;
+    g_thread = std::thread([](){
+        // No vsync, on some drivers it would tie this window to the other one's flips.
+        SDL_Renderer* renderer = SDL_CreateRenderer(g_window, -1, SDL_RENDERER_ACCELERATED);
+        if (!sdl_verify(renderer == nullptr, "creating the operator's renderer"))
+            return;
+        operator_loop(renderer);
+        SDL_DestroyRenderer(renderer);
+    });
+}
+
+void operator_stop()
+{
+    g_running = false;
+    if (g_thread.joinable())
+        g_thread.join();
+}
+
+void operator_toggle_hud()
+{
+    g_toggle_hud = true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <SDL.h>
+
+// The operator's console for dual-display mode, in its own window on another
+// display than the participant's: the camera preview, the performance HUD and
+// where the session is at, so the participant's display only shows stimuli.
+//
+// It runs on its own thread with its own renderer, paced well below the
+// stimulus display, and only ever reads what other threads publish without
+// locking (`g_counters`, `operator_status`) or what they hand over without
+// waiting (`preview_publish`). So it can't hold up a stimulus frame.
+
+// Render thread: what the session is doing, e.g. "Recording" at `t` of `duration` seconds.
+// `state` must be a string literal or otherwise live forever.
+void operator_status(const char* state, double t, double duration);
+
+// Starts rendering into `window`, which the main thread created. If that fails,
+// it complains and the session goes on without it.
+void operator_start(SDL_Window* window);
+void operator_stop();
+
+// Main thread: shows or hides the HUD.
+void operator_toggle_hud();
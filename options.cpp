@@ -0,0 +1,109 @@
+#include "options.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --calibrate-latency   Point the camera at the screen and measure the display->camera latency.\n"
+              << "  --trajectory SHAPE    How Mr.Point moves: linear (default), minjerk or catmullrom.\n"
+              << "  --distractors N       Show N distractors moving around along with Mr.Point.\n"
+              << "  --preview             Show the camera's color and depth streams before starting.\n"
+              << "  --hud                 Show the performance HUD (F1 toggles it).\n"
+              << "  --stimulus-display N  Show the stimuli fullscreen on display N.\n"
+              << "  --operator-display N  Show the preview, HUD and status in an operator's window on display N.\n"
+              << "  --headless            Render offscreen and start/quit on its own, then print timing stats.\n"
+              << "  --no-camera           Don't use the RealSense, e.g. for soak tests without one.\n"
+              << "  --speed X             Run the choreography X times faster than real time (default 1).\n"
+              << "  --pointcloud          Deproject every depth frame while recording and log the participant's distance.\n"
+              << "  --register            Register every depth frame to color while recording.\n"
+              << "  --aligned-depth       The same, and store the aligned depth frames with the session.\n"
+              << "  --face-crop           Store only the face instead of whole frames, which takes ~5x less disk.\n"
+              << "  --keyframe-interval N With --face-crop, store whole frames every N frames anyway (default 150, 0 for never).\n"
+              << "  --filter-depth        Also record the depth stream denoised and with its small holes filled.\n"
+              << "  --quality             Warn when the participant is out of range or moves a lot, and log it per frame.\n"
+              << "  --blinks              Detect blinks and eye closures, and log them with their timestamps.\n"
+              << "  --sharpness           Score how sharp every color frame is, and log which ones are blurred by motion.\n"
+              << "  --head-pose           Estimate the head's position and orientation from every depth frame.\n"
+              << "  --ir                  Also capture the infrared stream, and detect blinks in it instead of color.\n"
+              << "  --pupils              Detect the pupils in every infrared frame, and log their centers. Implies --ir.\n"
+              << "  --bench NAME          Run the micro-benchmark NAME (or all of them) and exit.\n"
+              << std::flush;
+}
+
+bool parse_options(int argc, char **argv, Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+
+        if (arg == "--calibrate-latency")
+            opt.calibrate_latency = true;
+        else if (arg == "--trajectory" && i + 1 < argc && parse_shape(argv[i+1], opt.trajectory))
+            ++i;
+        else if (arg == "--distractors" && i + 1 < argc)
+            opt.distractors = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--preview")
+            opt.preview = true;
+        else if (arg == "--hud")
+            opt.hud = true;
+        else if (arg == "--stimulus-display" && i + 1 < argc)
+            opt.stimulus_display = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--operator-display" && i + 1 < argc)
+            opt.operator_display = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--headless")
+            opt.headless = true;
+        else if (arg == "--no-camera")
+            opt.no_camera = true;
+        else if (arg == "--speed" && i + 1 < argc && std::atof(argv[i+1]) > 0.0)
+            opt.speed = std::atof(argv[++i]);
+        else if (arg == "--pointcloud")
+            opt.pointcloud = true;
+        else if (arg == "--register")
+            opt.register_depth = true;
+        else if (arg == "--aligned-depth")
+            opt.register_depth = opt.aligned_depth = true;
+        else if (arg == "--filter-depth")
+            opt.filter_depth = true;
+        else if (arg == "--quality")
+            opt.quality = true;
+        else if (arg == "--blinks")
+            opt.blinks = true;
+        else if (arg == "--sharpness")
+            opt.sharpness = true;
+        else if (arg == "--head-pose")
+            opt.head_pose = true;
+        else if (arg == "--ir")
+            opt.ir = true;
+        else if (arg == "--pupils")
+            opt.pupils = opt.ir = true;
+        else if (arg == "--face-crop")
+            opt.face_crop = true;
+        else if (arg == "--keyframe-interval" && i + 1 < argc)
+            opt.keyframe_interval = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--bench" && i + 1 < argc)
+            opt.bench = argv[++i];
+        else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            usage(argv[0]);
+            return false;
+        }
+    }
+
+    if (opt.calibrate_latency && opt.no_camera) {
+        std::cerr << "--calibrate-latency needs the camera." << std::endl;
+        return false;
+    }
+    // Otherwise the stimuli go wherever SDL puts the window, maybe right under the operator's.
+    if (opt.operator_display >= 0 && opt.stimulus_display < 0) {
+        std::cerr << "--operator-display needs --stimulus-display too." << std::endl;
+        return false;
+    }
+    if (opt.operator_display >= 0 && opt.operator_display == opt.stimulus_display) {
+        std::cerr << "The operator's window and the stimuli need different displays." << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <string>
+
+#include "trajectory.h"
+
+// Everything that can be changed from the command-line.
+struct Options {
+    // Instead of recording a session, measure the display->camera latency by
+    // flashing the screen while the camera looks at it. See `latency.h`.
+    bool calibrate_latency;
+
+    // Run the named micro-benchmark(s) instead of anything else, see `bench.h`.
+    std::string bench;
+
+    // How Mr.Point moves between the keyframes of the choreography.
+    Shape trajectory;
+
+    // How many distractors move around along with Mr.Point.
+    int distractors;
+
+    // Show what the camera sees before the recording starts.
+    bool preview;
+
+    // Show the performance HUD from the start, F1 toggles it anyway.
+    bool hud;
+
+    // Which display the stimuli go on, -1 for wherever SDL puts them.
+    int stimulus_display;
+
+    // Which display the operator's window goes on, -1 for none. See `operator.h`.
+    int operator_display;
+
+    // Render offscreen with SDL's dummy video driver and advance through the
+    // states on our own, for benchmarks and soak tests on hosts without a display.
+    bool headless;
+
+    // Run without the RealSense, nothing gets captured or recorded then.
+    bool no_camera;
+
+    // How much faster than real time the choreography runs.
+    double speed;
+
+    // Turn every depth frame into a point cloud while recording, see `pointcloud.h`.
+    bool pointcloud;
+
+    // Register every depth frame to color while recording, and whether to store
+    // the aligned depth frames, see `registration.h`.
+    bool register_depth;
+    bool aligned_depth;
+
+    // Store only the participant's face instead of the SDK's recording of the whole
+    // frames, and whole frames only every `keyframe_interval` frames. See `facecrop.h`.
+    bool face_crop;
+    int keyframe_interval;
+
+    // Record a denoised, hole-filled depth stream next to the raw one, see `depthfilter.h`.
+    bool filter_depth;
+
+    // Warn the operator when the participant is out of range or moves a lot, see `quality.h`.
+    bool quality;
+
+    // Detect blinks and eye closures in the color stream, see `blink.h`.
+    bool blinks;
+
+    // Score how sharp every color frame is, to find the ones blurred by motion, see `sharpness.h`.
+    bool sharpness;
+
+    // Estimate the head's pose from every depth frame, see `headpose.h`.
+    bool head_pose;
+
+    // Capture (and record) the infrared stream too, and detect blinks in it instead of color.
+    bool ir;
+
+    // Detect the pupils in every infrared frame, see `pupil.h`. Implies `ir`.
+    bool pupils;
+
+    Options()
+        : calibrate_latency(false)
+        , trajectory(SHAPE_LINEAR)
+        , distractors(0)
+        , preview(false)
+        , hud(false)
+        , stimulus_display(-1)
+        , operator_display(-1)
+        , headless(false)
+        , no_camera(false)
+        , speed(1.0)
+        , pointcloud(false)
+        , register_depth(false)
+        , aligned_depth(false)
+        , face_crop(false)
+        , keyframe_interval(150)
+        , filter_depth(false)
+        , quality(false)
+        , blinks(false)
+        , sharpness(false)
+        , head_pose(false)
+        , ir(false)
+        , pupils(false)
+    {}
+};
+
+// Returns false (after printing usage) on unknown arguments.
+bool parse_options(int argc, char **argv, Options& opt);
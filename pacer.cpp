@@ -0,0 +1,146 @@
+#include "pacer.h"
+
+#include <cmath>
+#include <iostream>
+
+#include "session.h"
+#include "timing.h"
+
+// Sleeping is only trusted up to this long before the deadline, then we spin.
+static const Uint64 SPIN_US = 2000;
+
+// How quickly the refresh period and phase follow the measured present times.
+// Presents jitter by a fraction of a millisecond, the display's clock hardly at all.
+static const double PERIOD_GAIN = 0.01;
+static const double PHASE_GAIN = 0.1;
+
+FramePacer::FramePacer()
+    : m_renderer(nullptr)
+    , m_vsync(false)
+    , m_period_us(1e6 / 60)
+    , m_frame_start(0)
+    , m_last_present(0)
+    , m_measured_us(1e6 / 60)
+    , m_phase_us(0.0)
+    , m_missed(0)
+    , m_cpu_ms(0.1, 500)
+    , m_interval_ms(0.1, 1000)
+{}
+
+void FramePacer::init(SDL_Window* window, SDL_Renderer* renderer)
+{
+    m_renderer = renderer;
+
+    SDL_RendererInfo info;
+    m_vsync = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
+
+    // Not all drivers know the refresh rate, 60 Hz is the safest guess then.
+    SDL_DisplayMode mode;
+    int hz = SDL_GetWindowDisplayMode(window, &mode) == 0 ? mode.refresh_rate : 0;
+    m_period_us = m_measured_us = 1e6 / (hz > 0 ? hz : 60);
+
+    std::cout << "Pacing frames at " << 1e6 / m_period_us << " Hz"
+              << (m_vsync ? " with vsync." : " by sleeping, no vsync.") << std::endl;
+}
+
+void FramePacer::speed_up(double factor)
+{
+    if (m_vsync)
+        return;
+    m_period_us /= factor;
+    m_measured_us = m_period_us;
+    std::cout << "Pacing frames at " << 1e6 / m_period_us << " Hz instead, " << factor << "x real time." << std::endl;
+}
+
+void FramePacer::set_rate(double hz)
+{
+    if (!m_vsync)
+        m_period_us = m_measured_us = 1e6 / hz;
+}
+
+void FramePacer::begin_frame()
+{
+    m_frame_start = host_us();
+}
+
+void FramePacer::present()
+{
+    Uint64 now = host_us();
+    m_cpu_ms.add(0.001 * (now - m_frame_start));
+
+    if (!m_vsync && m_last_present) {
+        Uint64 deadline = m_last_present + Uint64(m_period_us);
+        if (now + SPIN_US < deadline)
+            SDL_Delay(Uint32((deadline - now - SPIN_US) / 1000));
+        while (host_us() < deadline)
+            ;
+    }
+
+    SDL_RenderPresent(m_renderer);
+
+    now = host_us();
+    if (m_last_present) {
+        double interval = double(now - m_last_present);
+        m_interval_ms.add(0.001 * interval);
+        if (interval > 1.5 * m_period_us)
+            ++m_missed;
+    }
+    m_last_present = now;
+
+    // Where the present should have been going by the phase and period so far, allowing
+    // for missed refreshes. Close to it, both get nudged towards what we saw, way off
+    // (e.g. after a hitch that wasn't a whole number of refreshes) we start over.
+    double n = std::floor((double(now) - m_phase_us) / m_measured_us + 0.5);
+    double expected = m_phase_us + n * m_measured_us;
+    double error = double(now) - expected;
+    if (m_phase_us > 0 && n >= 1 && std::abs(error) < 0.25 * m_measured_us) {
+        m_measured_us += PERIOD_GAIN * error / n;
+        m_phase_us = expected + PHASE_GAIN * error;
+    } else {
+        m_phase_us = double(now);
+    }
+}
+
+Uint64 FramePacer::predict_present_us() const
+{
+    double now = double(host_us());
+    if (m_phase_us <= 0)
+        return Uint64(now);
+
+    // The first refresh that's still ahead of us.
+    double k = std::floor((now - m_phase_us) / m_measured_us) + 1;
+    return Uint64(m_phase_us + k * m_measured_us);
+}
+
+void FramePacer::reset_stats()
+{
+    m_cpu_ms.clear();
+    m_interval_ms.clear();
+    m_missed = 0;
+}
+
+void FramePacer::report()
+{
+    std::cout << "Measured refresh rate: " << 1e6 / m_measured_us << " Hz\n"
+              << "Frame CPU time [ms]: " << m_cpu_ms.summary() << "\n"
+              << "Present interval [ms]: " << m_interval_ms.summary() << "\n"
+              << "Missed deadlines: " << m_missed << " of " << m_interval_ms.count() << " frames" << std::endl;
+
+    session_meta("render_refresh_hz", 1e6 / m_period_us);
+    session_meta("render_measured_refresh_hz", 1e6 / m_measured_us);
+    session_meta("render_vsync", m_vsync ? 1.0 : 0.0);
+    session_meta("render_frames", double(m_interval_ms.count()));
+    session_meta("render_missed_deadlines", double(m_missed));
+    session_meta("render_cpu_ms_p50", m_cpu_ms.percentile(50));
+    session_meta("render_cpu_ms_p99", m_cpu_ms.percentile(99));
+    session_meta("render_interval_ms_p50", m_interval_ms.percentile(50));
+    session_meta("render_interval_ms_p99", m_interval_ms.percentile(99));
+    session_meta("render_interval_ms_max", m_interval_ms.max());
+
+    // Both histograms in one file, told apart by the first column.
+    SessionLog log;
+    if (log.open("frametimes", "histogram,bin_ms,count")) {
+        m_cpu_ms.write(log, "cpu");
+        m_interval_ms.write(log, "interval");
+    }
+}
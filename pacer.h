@@ -0,0 +1,66 @@
+#pragma once
+
+#include <SDL.h>
+
+#include "histogram.h"
+
+// Paces the render loop to the display's refresh instead of spinning as fast as
+// the driver lets us, which would burn a whole core the capture thread needs.
+//
+// With vsync, presenting blocks until the flip anyway. Without it, we sleep
+// until shortly before the next refresh is due and spin the rest of the way,
+// since `SDL_Delay` is only good to a millisecond or so.
+// Meanwhile it keeps histograms of the CPU time per frame and of the intervals
+// between presents, and counts deadlines we missed by more than half a refresh.
+//
+// It also tracks the actual refresh period and phase from the present times, as
+// displays are rarely at the integer rate they report, to predict when the frame
+// being built will be shown. Things moving on screen should be where they are at that time.
+class FramePacer {
+public:
+    FramePacer();
+
+    // Figures out the refresh rate and whether `renderer` syncs to it.
+    void init(SDL_Window* window, SDL_Renderer* renderer);
+
+    // Without vsync, paces as if the display refreshed `factor` times faster, so that
+    // an accelerated choreography still gets as many frames per second of it.
+    void speed_up(double factor);
+    // Without vsync, paces at `hz` instead of the display's refresh rate.
+    void set_rate(double hz);
+
+    // Call at the very beginning of a frame's work.
+    void begin_frame();
+    // Instead of `SDL_RenderPresent`.
+    void present();
+
+    bool vsync() const { return m_vsync; }
+    double period_us() const { return m_period_us; }
+    Uint64 last_present_us() const { return m_last_present; }
+
+    // The refresh period as measured, `period_us` until there's enough to go by.
+    double measured_period_us() const { return m_measured_us; }
+    // When the frame we're building now will be presented, in `host_us` time.
+    Uint64 predict_present_us() const;
+
+    void reset_stats();
+    size_t missed() const { return m_missed; }
+    const Histogram& cpu_ms() const { return m_cpu_ms; }
+    const Histogram& interval_ms() const { return m_interval_ms; }
+
+    // Prints the stats and writes them into the session's meta and `*.frametimes.csv`.
+    void report();
+
+private:
+    SDL_Renderer* m_renderer;
+    bool m_vsync;
+    double m_period_us;
+
+    Uint64 m_frame_start;
+    Uint64 m_last_present;
+    double m_measured_us;
+    double m_phase_us;  // A smoothed present time, 0 until the first one.
+    size_t m_missed;
+    Histogram m_cpu_ms;
+    Histogram m_interval_ms;
+};
@@ -0,0 +1,187 @@
+#include "pointcloud.h"
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+// Depth comes in millimeters, points go out in meters.
+static const float MM = 0.001f;
+
+void RayTable::init(const Intrinsics& in)
+{
+    width = in.width;
+    height = in.height;
+    x.resize(size_t(width) * height);
+    y.resize(x.size());
+    for (int v = 0; v < height; ++v)
+        for (int u = 0; u < width; ++u)
+            in.unproject(float(u), float(v), x[v*width + u], y[v*width + u]);
+}
+
+void PointCloud::resize(int w, int h)
+{
+    width = w;
+    height = h;
+    x.resize(size_t(w) * h);
+    y.resize(x.size());
+    z.resize(x.size());
+}
+
+void deproject_scalar(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        float d = depth[i] * MM;
+        x[i] = rx[i] * d;
+        y[i] = ry[i] * d;
+        z[i] = d;
+    }
+}
+
+#ifdef HAVE_SSE2
+void deproject_sse2(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    const __m128 mm = _mm_set1_ps(MM);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+        __m128 d[2] = {
+            _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d16, zero)), mm),
+            _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(d16, zero)), mm),
+        };
+        for (int j = 0; j < 2; ++j) {
+            size_t k = i + 4*j;
+            _mm_storeu_ps(x + k, _mm_mul_ps(_mm_loadu_ps(rx + k), d[j]));
+            _mm_storeu_ps(y + k, _mm_mul_ps(_mm_loadu_ps(ry + k), d[j]));
+            _mm_storeu_ps(z + k, d[j]);
+        }
+    }
+    deproject_scalar(rx + i, ry + i, depth + i, x + i, y + i, z + i, n - i);
+}
+#else
+void deproject_sse2(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    deproject_scalar(rx, ry, depth, x, y, z, n);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void deproject_avx2(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    const __m256 mm = _mm256_set1_ps(MM);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i d16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(depth + i));
+        __m256 d[2] = {
+            _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(d16))), mm),
+            _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(d16, 1))), mm),
+        };
+        for (int j = 0; j < 2; ++j) {
+            size_t k = i + 8*j;
+            _mm256_storeu_ps(x + k, _mm256_mul_ps(_mm256_loadu_ps(rx + k), d[j]));
+            _mm256_storeu_ps(y + k, _mm256_mul_ps(_mm256_loadu_ps(ry + k), d[j]));
+            _mm256_storeu_ps(z + k, d[j]);
+        }
+    }
+    deproject_scalar(rx + i, ry + i, depth + i, x + i, y + i, z + i, n - i);
+}
+#else
+void deproject_avx2(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    deproject_sse2(rx, ry, depth, x, y, z, n);
+}
+#endif
+
+#ifdef HAVE_NEON
+void deproject_neon(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    const float32x4_t mm = vdupq_n_f32(MM);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t d16 = vld1q_u16(depth + i);
+        float32x4_t d[2] = {
+            vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(d16))), mm),
+            vmulq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(d16))), mm),
+        };
+        for (int j = 0; j < 2; ++j) {
+            size_t k = i + 4*j;
+            vst1q_f32(x + k, vmulq_f32(vld1q_f32(rx + k), d[j]));
+            vst1q_f32(y + k, vmulq_f32(vld1q_f32(ry + k), d[j]));
+            vst1q_f32(z + k, d[j]);
+        }
+    }
+    deproject_scalar(rx + i, ry + i, depth + i, x + i, y + i, z + i, n - i);
+}
+#else
+void deproject_neon(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n)
+{
+    deproject_scalar(rx, ry, depth, x, y, z, n);
+}
+#endif
+
+void deproject(const RayTable& rays, const Uint16* depth, PointCloud& out)
+{
+    out.resize(rays.width, rays.height);
+    size_t n = rays.x.size();
+
+#if defined(HAVE_NEON)
+    deproject_neon(rays.x.data(), rays.y.data(), depth, out.x.data(), out.y.data(), out.z.data(), n);
+#else
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        deproject_avx2(rays.x.data(), rays.y.data(), depth, out.x.data(), out.y.data(), out.z.data(), n);
+    else if (SDL_HasSSE2())
+        deproject_sse2(rays.x.data(), rays.y.data(), depth, out.x.data(), out.y.data(), out.z.data(), n);
+    else
+        deproject_scalar(rays.x.data(), rays.y.data(), depth, out.x.data(), out.y.data(), out.z.data(), n);
+#endif
+}
+
+PointCloudStage::PointCloudStage(const Intrinsics& depth)
+    : Stage("pointcloud", STREAM_DEPTH)
+    , m_intrinsics(depth)
+{}
+
+void PointCloudStage::begin()
+{
+    m_log.open("pointcloud", "frame,host_us,points,center_z");
+}
+
+void PointCloudStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    if (!depth)
+        return;
+
+    // New rays whenever the profile changes, which is hardly ever.
+    if (depth->width != m_rays.width || depth->height != m_rays.height)
+        m_rays.init(m_intrinsics.scaled(depth->width, depth->height));
+
+    deproject(m_rays, depth->row<Uint16>(0), m_cloud);
+    m_cloud.index = depth->index;
+    m_cloud.host_us = depth->host_us;
+
+    // How many points there are at all, and the mean distance in the middle quarter.
+    int w = m_cloud.width, h = m_cloud.height;
+    size_t points = 0, center = 0;
+    double center_z = 0.0;
+    for (int v = 0; v < h; ++v) {
+        const float* z = &m_cloud.z[size_t(v) * w];
+        bool middle_row = v >= h/4 && v < 3*h/4;
+        for (int u = 0; u < w; ++u) {
+            if (z[u] <= 0.0f)
+                continue;
+            ++points;
+            if (middle_row && u >= w/4 && u < 3*w/4) {
+                center_z += z[u];
+                ++center;
+            }
+        }
+    }
+    m_log.row("%u,%lld,%u,%.4f", m_cloud.index, (long long)m_cloud.host_us, unsigned(points), center ? center_z / center : 0.0);
+}
+
+void PointCloudStage::end()
+{
+    m_log.close();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+#include "session.h"
+#include "stage.h"
+
+// Per pixel, the undistorted ray through it scaled to z = 1, so that a pixel's
+// 3D point is just its ray times its depth. It only depends on the stream's
+// intrinsics, so it's computed once per stream profile.
+struct RayTable {
+    int width, height;
+    std::vector<float> x, y;
+
+    RayTable() : width(0), height(0) {}
+    void init(const Intrinsics& in);
+};
+
+// A depth frame's points in the depth camera's coordinates, in meters, one per
+// pixel, as separate x, y and z arrays. All 0 where there's no depth.
+struct PointCloud {
+    int width, height;
+    unsigned index;  // Of the depth frame, see `Frame`.
+    Sint64 host_us;
+    std::vector<float> x, y, z;
+
+    PointCloud() : width(0), height(0), index(0), host_us(0) {}
+    // Only ever allocates the first time it gets this big.
+    void resize(int w, int h);
+};
+
+// Turns `rays.width` x `rays.height` depths in mm into `out`, using the best kernel the CPU supports.
+void deproject(const RayTable& rays, const Uint16* depth, PointCloud& out);
+
+// The individual kernels on `n` pixels, for testing and benchmarking.
+void deproject_scalar(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n);
+void deproject_sse2(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n);
+void deproject_avx2(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n);
+void deproject_neon(const float* rx, const float* ry, const Uint16* depth, float* x, float* y, float* z, size_t n);
+
+// Deprojects every depth frame into a reused point cloud on a worker thread,
+// logging per frame how many points there are and how far away the middle of
+// the image is (`<session>.pointcloud.csv`), for gating on the participant's distance.
+// Nothing else consumes the clouds, so for now it's mostly there to measure
+// deprojection online, next to `--bench pointcloud`.
+class PointCloudStage : public Stage {
+public:
+    explicit PointCloudStage(const Intrinsics& depth);
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    Intrinsics m_intrinsics;
+    RayTable m_rays;
+    PointCloud m_cloud;
+    SessionLog m_log;
+};
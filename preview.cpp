@@ -0,0 +1,111 @@
+#include "preview.h"
+
+#include <atomic>
+#include <mutex>
+
+// The camera runs at 30 Hz, 10 Hz is plenty for checking the framing.
+static const unsigned DECIMATION = 3;
+
+static std::atomic<bool> g_enabled(false);
+
+// The newest frames, waiting for the render thread.
+static std::mutex g_mutex;
+static FramePtr g_color, g_depth;
+
+void preview_enable(bool on)
+{
+    g_enabled = on;
+    if (!on) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_color.reset();
+        g_depth.reset();
+    }
+}
+
+bool preview_enabled()
+{
+    return g_enabled;
+}
+
+bool preview_wants(unsigned index)
+{
+    return g_enabled && index % DECIMATION == 0;
+}
+
+void preview_publish(FramePtr color, FramePtr depth)
+{
+    // Whatever we replace goes back to the pool once we're out of the lock.
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_color.swap(color);
+    g_depth.swap(depth);
+}
+
+PreviewRenderer::PreviewRenderer()
+    : m_renderer(nullptr)
+    , m_color(nullptr)
+    , m_depth(nullptr)
+{
+    // Roughly where a participant sits in front of a screen.
+    m_colormap.init(300, 1200);
+}
+
+void PreviewRenderer::init(SDL_Renderer* renderer)
+{
+    m_renderer = renderer;
+}
+
+void PreviewRenderer::clear()
+{
+    if (m_color)
+        SDL_DestroyTexture(m_color);
+    if (m_depth)
+        SDL_DestroyTexture(m_depth);
+    m_color = m_depth = nullptr;
+}
+
+bool PreviewRenderer::ensure(SDL_Texture*& tex, int w, int h)
+{
+    int tw = 0, th = 0;
+    if (tex)
+        SDL_QueryTexture(tex, NULL, NULL, &tw, &th);
+    if (tex && tw == w && th == h)
+        return true;
+
+    if (tex)
+        SDL_DestroyTexture(tex);
+    tex = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+    return tex != nullptr;
+}
+
+bool PreviewRenderer::update()
+{
+    FramePtr color, depth;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        color.swap(g_color);
+        depth.swap(g_depth);
+    }
+
+    // BGRA bytes are ARGB8888 on little-endian, so color goes up as-is.
+    if (color && ensure(m_color, color->width, color->height))
+        SDL_UpdateTexture(m_color, NULL, color->pixels.data(), int(color->stride));
+
+    if (depth && ensure(m_depth, depth->width, depth->height)) {
+        void* pixels;
+        int pitch;
+        if (SDL_LockTexture(m_depth, NULL, &pixels, &pitch) == 0) {
+            for (int y = 0; y < depth->height; ++y)
+                colormap_depth(m_colormap, depth->row<Uint16>(y), reinterpret_cast<Uint32*>(static_cast<Uint8*>(pixels) + y*pitch), depth->width);
+            SDL_UnlockTexture(m_depth);
+        }
+    }
+    return color || depth;
+}
+
+void PreviewRenderer::render(const SDL_Rect& color_dst, const SDL_Rect& depth_dst)
+{
+    if (m_color)
+        SDL_RenderCopy(m_renderer, m_color, NULL, &color_dst);
+    if (m_depth)
+        SDL_RenderCopy(m_renderer, m_depth, NULL, &depth_dst);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <SDL.h>
+
+#include "colormap.h"
+#include "frames.h"
+
+// A live look at what the camera sees, so the operator can fix the participant's
+// framing before wasting a whole recording on it.
+//
+// The capture thread hands over copies of every few frames (see `preview_wants`);
+// it never waits for the render thread, which picks up whatever is newest when it
+// gets around to it and does the colormapping and uploading on its side.
+
+void preview_enable(bool on);
+bool preview_enabled();
+
+// Capture thread: whether frame number `index` should be copied for the preview.
+bool preview_wants(unsigned index);
+// Capture thread: replaces whatever the preview hasn't picked up yet.
+void preview_publish(FramePtr color, FramePtr depth);
+
+// Render thread: keeps the preview textures up to date and draws them.
+class PreviewRenderer {
+public:
+    PreviewRenderer();
+    ~PreviewRenderer() { clear(); }
+
+    void init(SDL_Renderer* renderer);
+    // Frees the textures, which has to happen before the renderer goes.
+    void clear();
+
+    // Uploads the newest frames, if there are any. Returns whether there were.
+    bool update();
+
+    // Color into `color_dst`, the depth colormap into `depth_dst`.
+    void render(const SDL_Rect& color_dst, const SDL_Rect& depth_dst);
+
+private:
+    bool ensure(SDL_Texture*& tex, int w, int h);
+
+    SDL_Renderer* m_renderer;
+    SDL_Texture* m_color;
+    SDL_Texture* m_depth;
+    DepthColormap m_colormap;
+};
@@ -0,0 +1,406 @@
+#include "pupil.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+// Where the eyes are: a bit above the head's middle, this far apart, and the
+// region searched around each, in millimeters.
+static const float EYES_ABOVE_MM = 15.0f, EYES_APART_MM = 62.0f;
+static const float EYE_W_MM = 36.0f, EYE_H_MM = 24.0f;
+// How big a pupil can be, in millimeters.
+static const float PUPIL_MIN_MM = 2.0f, PUPIL_MAX_MM = 8.0f;
+// Pixels count as dark up to a quarter of the way from the darkest to the mean,
+// but at least this far above the darkest.
+static const int DARK_MIN = 10;
+// Thinner blobs than this (minor over major diameter) aren't pupils.
+static const float MIN_ROUNDNESS = 0.4f;
+static const float DEGREES = 57.2957795f;
+
+void eye_min_sum_scalar(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum)
+{
+    Uint8 m = 255;
+    Uint32 s = 0;
+    for (int r = y; r < y + h; ++r) {
+        const Uint8* p = image.row<Uint8>(r) + x;
+        for (int i = 0; i < w; ++i) {
+            m = std::min(m, p[i]);
+            s += p[i];
+        }
+    }
+    min = m;
+    sum = s;
+}
+
+void dark_mask_scalar(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask)
+{
+    for (int r = 0; r < h; ++r) {
+        const Uint8* p = image.row<Uint8>(y + r) + x;
+        Uint8* m = mask + r*w;
+        for (int i = 0; i < w; ++i)
+            m[i] = p[i] <= threshold;
+    }
+}
+
+#ifdef HAVE_SSE2
+void eye_min_sum_sse2(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m = _mm_set1_epi8(-1), s = zero;
+    Uint8 tail_min = 255;
+    Uint32 tail_sum = 0;
+    for (int r = y; r < y + h; ++r) {
+        const Uint8* p = image.row<Uint8>(r) + x;
+        int i = 0;
+        for (; i + 16 <= w; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            m = _mm_min_epu8(m, v);
+            s = _mm_add_epi64(s, _mm_sad_epu8(v, zero));
+        }
+        for (; i < w; ++i) {
+            tail_min = std::min(tail_min, p[i]);
+            tail_sum += p[i];
+        }
+    }
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 8));
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 4));
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 2));
+    m = _mm_min_epu8(m, _mm_srli_si128(m, 1));
+    min = std::min(tail_min, Uint8(_mm_cvtsi128_si32(m) & 0xff));
+    s = _mm_add_epi64(s, _mm_srli_si128(s, 8));
+    sum = Uint32(_mm_cvtsi128_si32(s)) + tail_sum;
+}
+
+void dark_mask_sse2(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask)
+{
+    const __m128i t = _mm_set1_epi8(char(threshold)), one = _mm_set1_epi8(1);
+    for (int r = 0; r < h; ++r) {
+        const Uint8* p = image.row<Uint8>(y + r) + x;
+        Uint8* m = mask + r*w;
+        int i = 0;
+        for (; i + 16 <= w; i += 16) {
+            // p <= t is max(p, t) == t, there's no unsigned compare.
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            __m128i dark = _mm_cmpeq_epi8(_mm_max_epu8(v, t), t);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(m + i), _mm_and_si128(dark, one));
+        }
+        for (; i < w; ++i)
+            m[i] = p[i] <= threshold;
+    }
+}
+#else
+void eye_min_sum_sse2(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum)
+{
+    eye_min_sum_scalar(image, x, y, w, h, min, sum);
+}
+
+void dark_mask_sse2(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask)
+{
+    dark_mask_scalar(image, x, y, w, h, threshold, mask);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void eye_min_sum_avx2(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i m = _mm256_set1_epi8(-1), s = zero;
+    // Eye regions are narrow, so what's left of each row mostly gets half a vector too.
+    __m128i m128 = _mm_set1_epi8(-1), s128 = _mm_setzero_si128();
+    Uint8 tail_min = 255;
+    Uint32 tail_sum = 0;
+    for (int r = y; r < y + h; ++r) {
+        const Uint8* p = image.row<Uint8>(r) + x;
+        int i = 0;
+        for (; i + 32 <= w; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            m = _mm256_min_epu8(m, v);
+            s = _mm256_add_epi64(s, _mm256_sad_epu8(v, zero));
+        }
+        if (i + 16 <= w) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            m128 = _mm_min_epu8(m128, v);
+            s128 = _mm_add_epi64(s128, _mm_sad_epu8(v, _mm_setzero_si128()));
+            i += 16;
+        }
+        for (; i < w; ++i) {
+            tail_min = std::min(tail_min, p[i]);
+            tail_sum += p[i];
+        }
+    }
+    m128 = _mm_min_epu8(m128, _mm_min_epu8(_mm256_castsi256_si128(m), _mm256_extracti128_si256(m, 1)));
+    m128 = _mm_min_epu8(m128, _mm_srli_si128(m128, 8));
+    m128 = _mm_min_epu8(m128, _mm_srli_si128(m128, 4));
+    m128 = _mm_min_epu8(m128, _mm_srli_si128(m128, 2));
+    m128 = _mm_min_epu8(m128, _mm_srli_si128(m128, 1));
+    min = std::min(tail_min, Uint8(_mm_cvtsi128_si32(m128) & 0xff));
+    s128 = _mm_add_epi64(s128, _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+    s128 = _mm_add_epi64(s128, _mm_srli_si128(s128, 8));
+    sum = Uint32(_mm_cvtsi128_si32(s128)) + tail_sum;
+}
+
+TARGET_AVX2 void dark_mask_avx2(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask)
+{
+    const __m256i t = _mm256_set1_epi8(char(threshold)), one = _mm256_set1_epi8(1);
+    for (int r = 0; r < h; ++r) {
+        const Uint8* p = image.row<Uint8>(y + r) + x;
+        Uint8* m = mask + r*w;
+        int i = 0;
+        for (; i + 32 <= w; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            __m256i dark = _mm256_cmpeq_epi8(_mm256_max_epu8(v, t), t);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(m + i), _mm256_and_si256(dark, one));
+        }
+        if (i + 16 <= w) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+            __m128i dark = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm256_castsi256_si128(t)), _mm256_castsi256_si128(t));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(m + i), _mm_and_si128(dark, _mm256_castsi256_si128(one)));
+            i += 16;
+        }
+        for (; i < w; ++i)
+            m[i] = p[i] <= threshold;
+    }
+}
+#else
+void eye_min_sum_avx2(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum)
+{
+    eye_min_sum_sse2(image, x, y, w, h, min, sum);
+}
+
+void dark_mask_avx2(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask)
+{
+    dark_mask_sse2(image, x, y, w, h, threshold, mask);
+}
+#endif
+
+void eye_min_sum(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        eye_min_sum_avx2(image, x, y, w, h, min, sum);
+    else if (SDL_HasSSE2())
+        eye_min_sum_sse2(image, x, y, w, h, min, sum);
+    else
+        eye_min_sum_scalar(image, x, y, w, h, min, sum);
+}
+
+void dark_mask(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        dark_mask_avx2(image, x, y, w, h, threshold, mask);
+    else if (SDL_HasSSE2())
+        dark_mask_sse2(image, x, y, w, h, threshold, mask);
+    else
+        dark_mask_scalar(image, x, y, w, h, threshold, mask);
+}
+
+static int find_root(std::vector<int>& parent, int i)
+{
+    while (parent[i] != i)
+        i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+bool find_pupil(const Frame& image, int x, int y, int w, int h, int min_area, int max_area,
+                std::vector<Uint8>& mask, std::vector<int>& labels, Pupil& out)
+{
+    Uint8 darkest;
+    Uint32 sum;
+    eye_min_sum(image, x, y, w, h, darkest, sum);
+    int mean = int(sum / Uint32(w*h));
+    int threshold = std::min(255, darkest + std::max(DARK_MIN, (mean - darkest) / 4));
+
+    mask.resize(size_t(w) * h);
+    dark_mask(image, x, y, w, h, Uint8(threshold), mask.data());
+
+    // Connected blobs (8 neighbours) in one pass with union-find, each pixel
+    // labeled with its blob's first label.
+    labels.assign(size_t(w) * h, -1);
+    std::vector<int> parent;
+    for (int r = 0; r < h; ++r) {
+        for (int i = 0; i < w; ++i) {
+            if (!mask[r*w + i])
+                continue;
+            int label = -1;
+            const int neighbours[4][2] = { { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+            for (auto& n : neighbours) {
+                int nx = i + n[0], ny = r + n[1];
+                if (nx < 0 || nx >= w || ny < 0)
+                    continue;
+                int other = labels[ny*w + nx];
+                if (other < 0)
+                    continue;
+                other = find_root(parent, other);
+                if (label < 0)
+                    label = other;
+                else if (other != label)
+                    parent[std::max(label, other)] = label = std::min(label, other);
+            }
+            if (label < 0) {
+                label = int(parent.size());
+                parent.push_back(label);
+            }
+            labels[r*w + i] = label;
+        }
+    }
+
+    struct Blob {
+        Uint32 area, darkness;
+        bool border;
+        double w, wx, wy;
+        double sx, sy, sxx, sxy, syy;
+    };
+    std::vector<Blob> blobs(parent.size(), Blob());
+    for (int r = 0; r < h; ++r) {
+        const Uint8* p = image.row<Uint8>(y + r) + x;
+        for (int i = 0; i < w; ++i) {
+            int label = labels[r*w + i];
+            if (label < 0)
+                continue;
+            Blob& b = blobs[find_root(parent, label)];
+            ++b.area;
+            b.darkness += p[i];
+            b.border = b.border || i == 0 || r == 0 || i == w - 1 || r == h - 1;
+            // Weighted by how far below the threshold, for the subpixel middle.
+            double weight = threshold + 1 - p[i];
+            b.w += weight;
+            b.wx += weight * i;
+            b.wy += weight * r;
+            b.sx += i;
+            b.sy += r;
+            b.sxx += double(i) * i;
+            b.sxy += double(i) * r;
+            b.syy += double(r) * r;
+        }
+    }
+
+    // The darkest blob of the right size and shape.
+    double best = 1e30;
+    bool found = false;
+    for (const Blob& b : blobs) {
+        if (b.border || int(b.area) < min_area || int(b.area) > max_area)
+            continue;
+        // Its ellipse from the second moments, a pixel being a 1x1 square. A disc
+        // of diameter d has a variance of d^2 / 16 along any axis.
+        double n = b.area, mx = b.sx / n, my = b.sy / n;
+        double cxx = b.sxx / n - mx*mx + 1.0 / 12, cyy = b.syy / n - my*my + 1.0 / 12, cxy = b.sxy / n - mx*my;
+        double half = 0.5 * (cxx + cyy), diff = std::sqrt(0.25 * (cxx - cyy) * (cxx - cyy) + cxy*cxy);
+        double major = 4.0 * std::sqrt(half + diff), minor = 4.0 * std::sqrt(std::max(0.0, half - diff));
+        if (minor < MIN_ROUNDNESS * major)
+            continue;
+        double darkness = double(b.darkness) / n;
+        if (darkness >= best)
+            continue;
+        best = darkness;
+        found = true;
+        out.x = float(x + b.wx / b.w);
+        out.y = float(y + b.wy / b.w);
+        out.major = float(major);
+        out.minor = float(minor);
+        out.angle = float(DEGREES * 0.5 * std::atan2(2.0 * cxy, cxx - cyy));
+        out.area = b.area;
+    }
+    return found;
+}
+
+PupilStage::PupilStage(const Intrinsics& depth, const Intrinsics& ir, const Extrinsics& depth_to_ir)
+    : Stage("pupil", STREAM_DEPTH | STREAM_IR)
+    , m_ir(ir)
+    , m_extrinsics(depth_to_ir)
+    , m_tracker(depth)
+    , m_z(0.0f)
+{
+    for (Eye& eye : m_eyes) {
+        eye.tracking = false;
+        eye.x = eye.y = 0.0f;
+        eye.found_frames = 0;
+    }
+}
+
+void PupilStage::begin()
+{
+    m_z = 0.0f;
+    for (Eye& eye : m_eyes) {
+        eye.tracking = false;
+        eye.found_frames = 0;
+    }
+    m_log.open("pupils", "frame,host_us,"
+                         "right_found,right_x,right_y,right_major,right_minor,right_angle,right_area,"
+                         "left_found,left_x,left_y,left_major,left_minor,left_angle,left_area");
+}
+
+void PupilStage::process(const FrameSet& frames)
+{
+    const Frame* ir = frames.ir.get();
+    if (!ir || ir->format != FRAME_Y8)
+        return;
+
+    // Where the eyes should be, from the head.
+    Intrinsics in = m_ir.scaled(ir->width, ir->height);
+    bool head = frames.depth && m_tracker.update(*frames.depth);
+    float head_u = 0.0f, head_v = 0.0f;
+    if (head) {
+        m_tracker.in_camera(in, m_extrinsics, head_u, head_v, m_z);
+        head_v -= in.fy * EYES_ABOVE_MM / m_z;
+    }
+
+    // Searching only around the last pupil can settle on a lash or a brow, or take
+    // both eyes to the same blob: eyes closer than half their distance start over,
+    // and so does an eye that drifted more than its width from where the head has it.
+    if (m_z > 0.0f && m_eyes[0].tracking && m_eyes[1].tracking &&
+        std::hypot(m_eyes[1].x - m_eyes[0].x, m_eyes[1].y - m_eyes[0].y) < 0.5f * in.fx * EYES_APART_MM / m_z)
+        m_eyes[0].tracking = m_eyes[1].tracking = false;
+
+    char columns[2][128];
+    for (int e = 0; e < 2; ++e) {
+        Eye& eye = m_eyes[e];
+        std::snprintf(columns[e], sizeof(columns[e]), "0,,,,,,");
+        if (m_z <= 0.0f || (!eye.tracking && !head)) {
+            eye.tracking = false;
+            continue;
+        }
+
+        float head_eye_u = head_u + (e == 0 ? -0.5f : 0.5f) * in.fx * EYES_APART_MM / m_z;
+        if (eye.tracking && head &&
+            std::hypot(eye.x - head_eye_u, eye.y - head_v) > in.fx * EYE_W_MM / m_z)
+            eye.tracking = false;
+
+        float u = eye.x, v = eye.y;
+        if (!eye.tracking) {
+            u = head_eye_u;
+            v = head_v;
+        }
+        int w = int(in.fx * EYE_W_MM / m_z), h = int(in.fy * EYE_H_MM / m_z);
+        int x0 = std::max(0, int(u) - w/2), y0 = std::max(0, int(v) - h/2);
+        int x1 = std::min(ir->width, int(u) - w/2 + w), y1 = std::min(ir->height, int(v) - h/2 + h);
+        if (x1 - x0 < 8 || y1 - y0 < 8) {
+            eye.tracking = false;
+            continue;
+        }
+
+        float d_min = in.fx * PUPIL_MIN_MM / m_z, d_max = in.fx * PUPIL_MAX_MM / m_z;
+        int min_area = std::max(2, int(0.785f * d_min * d_min)), max_area = int(0.785f * d_max * d_max) + 1;
+        Pupil p;
+        eye.tracking = find_pupil(*ir, x0, y0, x1 - x0, y1 - y0, min_area, max_area, m_mask, m_labels, p);
+        if (!eye.tracking)
+            continue;
+        eye.x = p.x;
+        eye.y = p.y;
+        ++eye.found_frames;
+        std::snprintf(columns[e], sizeof(columns[e]), "1,%.2f,%.2f,%.2f,%.2f,%.1f,%u",
+                      p.x, p.y, p.major, p.minor, p.angle, p.area);
+    }
+    m_log.row("%u,%lld,%s,%s", ir->index, (long long)ir->host_us, columns[0], columns[1]);
+}
+
+void PupilStage::end()
+{
+    m_log.close();
+    session_meta("pupil_right_frames", double(m_eyes[0].found_frames));
+    session_meta("pupil_left_frames", double(m_eyes[1].found_frames));
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+#include "facecrop.h"
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// The darkest pixel and the sum of all of the `w`x`h` region at x,y of the Y8
+// `image`. Uses the best kernel the CPU supports.
+void eye_min_sum(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum);
+// Sets `mask` (`w`x`h`) to 1 where the region's pixels are at most `threshold`, 0
+// elsewhere. Uses the best kernel the CPU supports.
+void dark_mask(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask);
+
+// The individual kernels, for testing and benchmarking.
+void eye_min_sum_scalar(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum);
+void eye_min_sum_sse2(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum);
+void eye_min_sum_avx2(const Frame& image, int x, int y, int w, int h, Uint8& min, Uint32& sum);
+void dark_mask_scalar(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask);
+void dark_mask_sse2(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask);
+void dark_mask_avx2(const Frame& image, int x, int y, int w, int h, Uint8 threshold, Uint8* mask);
+
+// A pupil as an ellipse, in pixels of the image it was found in.
+struct Pupil {
+    float x, y;          // The middle, weighted by how dark each pixel is.
+    float major, minor;  // Diameters.
+    float angle;         // Of the major axis, in degrees clockwise from the image's x.
+    Uint32 area;
+};
+
+// Finds the pupil in the `w`x`h` region at x,y of the Y8 `image` as the darkest
+// blob of about the right size and shape: the pixels near the region's darkest,
+// grouped into connected blobs, and the blob's ellipse from its moments. Blobs
+// touching the region's border are left out, they're lashes, brows or hair.
+// `min_area` and `max_area` in pixels. `mask` and `labels` are scratch space.
+bool find_pupil(const Frame& image, int x, int y, int w, int h, int min_area, int max_area,
+                std::vector<Uint8>& mask, std::vector<int>& labels, Pupil& out);
+
+// Detects both pupils in every infrared frame on a worker thread, where they're
+// much darker against the iris than in color.
+//
+// Each eye is searched around where its pupil was in the last frame, or, when it
+// was lost, where the eyes are on the head found in the depth stream (see
+// `HeadTracker`). It's also searched there again when its pupil got more than an
+// eye's width away from there, or both pupils got closer than half the eyes'
+// distance, so that neither stays on the wrong blob. Per frame, the pupils'
+// centers (subpixel) and ellipses go into `<session>.pupils.csv`, as features for
+// gaze models, and in how many frames each was found into the meta.
+class PupilStage : public Stage {
+public:
+    // `ir` and `depth_to_ir` the infrared stream's calibration.
+    PupilStage(const Intrinsics& depth, const Intrinsics& ir, const Extrinsics& depth_to_ir);
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    Intrinsics m_ir;
+    Extrinsics m_extrinsics;
+
+    HeadTracker m_tracker;
+    float m_z;  // How far the head was when last found, 0 before.
+    std::vector<Uint8> m_mask;
+    std::vector<int> m_labels;
+
+    // The participant's right and left eye, which are on the image's left and right.
+    struct Eye {
+        bool tracking;
+        float x, y;
+        unsigned found_frames;
+    } m_eyes[2];
+
+    SessionLog m_log;
+};
@@ -0,0 +1,311 @@
+#include "quality.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <SDL_cpuinfo.h>
+
+#include "counters.h"
+#include "simd.h"
+
+// Where someone can be at all, and where the recording wants them, in millimeters.
+static const int MIN_RANGE_MM = 200, MAX_RANGE_MM = 1200;
+static const float TOO_CLOSE_MM = 400.0f, TOO_FAR_MM = 900.0f;
+// How deep a blob's allowed to be: head and shoulders.
+static const int BLOB_DEPTH_MM = 300;
+// A blob needs this much of the frame, about a face at the far end of the range.
+static const float MIN_AREA = 0.01f;
+// More than this per frame is a large movement: the centroid by a few percent
+// of the frame's width, or the distance by a few centimeters.
+static const float MOVE_WIDTHS = 0.04f, MOVE_MM = 50.0f;
+// For how many frames `QUALITY_MOVED` stays published.
+static const unsigned MOVED_FRAMES = 15;
+
+std::string quality_text(Uint32 flags)
+{
+    static const char* names[] = { "nobody in range", "too close", "too far", "moved" };
+    std::string text;
+    for (int i = 0; i < 4; ++i) {
+        if (flags & (1 << i)) {
+            if (!text.empty())
+                text += ", ";
+            text += names[i];
+        }
+    }
+    return text.empty() ? "ok" : text;
+}
+
+void depth_histogram_scalar(const Uint16* depth, size_t n, Uint32* hist)
+{
+    for (size_t i = 0; i < n; ++i)
+        ++hist[std::min(depth[i] >> DEPTH_BIN_SHIFT, DEPTH_BINS - 1)];
+}
+
+// The binning is vectorized, the counting can't be. The bins are taken straight
+// out of the registers, and every 4th pixel goes into a histogram of its own, which
+// keeps successive increments of the same bin from waiting on each other. With
+// depth images they mostly would.
+#ifdef HAVE_SSE2
+static inline void count8(Uint32 (*h)[DEPTH_BINS], __m128i b)
+{
+    ++h[0][_mm_extract_epi16(b, 0)];
+    ++h[1][_mm_extract_epi16(b, 1)];
+    ++h[2][_mm_extract_epi16(b, 2)];
+    ++h[3][_mm_extract_epi16(b, 3)];
+    ++h[0][_mm_extract_epi16(b, 4)];
+    ++h[1][_mm_extract_epi16(b, 5)];
+    ++h[2][_mm_extract_epi16(b, 6)];
+    ++h[3][_mm_extract_epi16(b, 7)];
+}
+
+void depth_histogram_sse2(const Uint16* depth, size_t n, Uint32* hist)
+{
+    Uint32 h[4][DEPTH_BINS] = {};
+    const __m128i last = _mm_set1_epi16(DEPTH_BINS - 1);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+        __m128i b = _mm_min_epi16(_mm_srli_epi16(d, DEPTH_BIN_SHIFT), last);
+        count8(h, b);
+    }
+    for (int b = 0; b < DEPTH_BINS; ++b)
+        hist[b] += h[0][b] + h[1][b] + h[2][b] + h[3][b];
+    depth_histogram_scalar(depth + i, n - i, hist);
+}
+#else
+void depth_histogram_sse2(const Uint16* depth, size_t n, Uint32* hist)
+{
+    depth_histogram_scalar(depth, n, hist);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void depth_histogram_avx2(const Uint16* depth, size_t n, Uint32* hist)
+{
+    Uint32 h[4][DEPTH_BINS] = {};
+    const __m256i last = _mm256_set1_epi16(DEPTH_BINS - 1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(depth + i));
+        __m256i b = _mm256_min_epi16(_mm256_srli_epi16(d, DEPTH_BIN_SHIFT), last);
+        __m128i b0 = _mm256_castsi256_si128(b), b1 = _mm256_extracti128_si256(b, 1);
+        count8(h, b0);
+        count8(h, b1);
+    }
+    for (int b = 0; b < DEPTH_BINS; ++b)
+        hist[b] += h[0][b] + h[1][b] + h[2][b] + h[3][b];
+    depth_histogram_scalar(depth + i, n - i, hist);
+}
+#else
+void depth_histogram_avx2(const Uint16* depth, size_t n, Uint32* hist)
+{
+    depth_histogram_sse2(depth, n, hist);
+}
+#endif
+
+// Pixels `x0` to `w` of row `y`.
+static void blob_row(const Uint16* row, int x0, int w, int y, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    for (int x = x0; x < w; ++x) {
+        if (row[x] >= lo && row[x] < hi) {
+            ++out.area;
+            out.sum_x += x;
+            out.sum_y += y;
+        }
+    }
+}
+
+void blob_stats_scalar(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    out.area = 0;
+    out.sum_x = out.sum_y = 0;
+    for (int y = 0; y < h; ++y)
+        blob_row(depth + size_t(y)*w, 0, w, y, lo, hi, out);
+}
+
+// Per row, counts and x coordinates of the pixels in range are summed up in 16
+// and 32 bit lanes, and added up across lanes at the end of the row.
+#ifdef HAVE_SSE2
+void blob_stats_sse2(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    out.area = 0;
+    out.sum_x = out.sum_y = 0;
+
+    // SSE2 only compares signed, so shift the range into that.
+    const __m128i flip = _mm_set1_epi16(-32768);
+    const __m128i lo_s = _mm_set1_epi16(Sint16(lo ^ 0x8000)), hi_s = _mm_set1_epi16(Sint16(hi ^ 0x8000));
+    const __m128i ones = _mm_set1_epi16(1), step = _mm_set1_epi16(8);
+    Sint32 lanes[4];
+    for (int y = 0; y < h; ++y) {
+        const Uint16* row = depth + size_t(y)*w;
+        __m128i count = _mm_setzero_si128(), sum_x = _mm_setzero_si128();
+        __m128i xs = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+        int x = 0;
+        for (; x + 8 <= w; x += 8) {
+            __m128i d = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)), flip);
+            __m128i in = _mm_andnot_si128(_mm_cmplt_epi16(d, lo_s), _mm_cmplt_epi16(d, hi_s));
+            count = _mm_sub_epi16(count, in);
+            sum_x = _mm_add_epi32(sum_x, _mm_madd_epi16(_mm_and_si128(in, xs), ones));
+            xs = _mm_add_epi16(xs, step);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_madd_epi16(count, ones));
+        Uint32 n = Uint32(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum_x);
+        out.area += n;
+        out.sum_x += Uint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        out.sum_y += Uint64(n) * y;
+        blob_row(row, x, w, y, lo, hi, out);
+    }
+}
+#else
+void blob_stats_sse2(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    blob_stats_scalar(depth, w, h, lo, hi, out);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void blob_stats_avx2(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    out.area = 0;
+    out.sum_x = out.sum_y = 0;
+
+    const __m256i flip = _mm256_set1_epi16(-32768);
+    const __m256i lo_s = _mm256_set1_epi16(Sint16(lo ^ 0x8000)), hi_s = _mm256_set1_epi16(Sint16(hi ^ 0x8000));
+    const __m256i ones = _mm256_set1_epi16(1), step = _mm256_set1_epi16(16);
+    Sint32 lanes[8];
+    for (int y = 0; y < h; ++y) {
+        const Uint16* row = depth + size_t(y)*w;
+        __m256i count = _mm256_setzero_si256(), sum_x = _mm256_setzero_si256();
+        __m256i xs = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        int x = 0;
+        for (; x + 16 <= w; x += 16) {
+            __m256i d = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x)), flip);
+            __m256i in = _mm256_andnot_si256(_mm256_cmpgt_epi16(lo_s, d), _mm256_cmpgt_epi16(hi_s, d));
+            count = _mm256_sub_epi16(count, in);
+            sum_x = _mm256_add_epi32(sum_x, _mm256_madd_epi16(_mm256_and_si256(in, xs), ones));
+            xs = _mm256_add_epi16(xs, step);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_madd_epi16(count, ones));
+        Uint32 n = 0;
+        for (int i = 0; i < 8; ++i)
+            n += lanes[i];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum_x);
+        for (int i = 0; i < 8; ++i)
+            out.sum_x += lanes[i];
+        out.area += n;
+        out.sum_y += Uint64(n) * y;
+        blob_row(row, x, w, y, lo, hi, out);
+    }
+}
+#else
+void blob_stats_avx2(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    blob_stats_sse2(depth, w, h, lo, hi, out);
+}
+#endif
+
+void depth_histogram(const Uint16* depth, size_t n, Uint32* hist)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        depth_histogram_avx2(depth, n, hist);
+    else if (SDL_HasSSE2())
+        depth_histogram_sse2(depth, n, hist);
+    else
+        depth_histogram_scalar(depth, n, hist);
+}
+
+void blob_stats(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        blob_stats_avx2(depth, w, h, lo, hi, out);
+    else if (SDL_HasSSE2())
+        blob_stats_sse2(depth, w, h, lo, hi, out);
+    else
+        blob_stats_scalar(depth, w, h, lo, hi, out);
+}
+
+QualityStage::QualityStage()
+    : Stage("quality", STREAM_DEPTH)
+    , m_had_blob(false)
+    , m_x(0.0f)
+    , m_y(0.0f)
+    , m_z(0.0f)
+    , m_moved_frames(0)
+{}
+
+void QualityStage::begin()
+{
+    m_had_blob = false;
+    m_moved_frames = 0;
+    std::fill(m_flagged, m_flagged + 4, 0);
+    m_log.open("quality", "frame,host_us,flags,blob_z_mm,blob_area,blob_x,blob_y");
+}
+
+void QualityStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    if (!depth)
+        return;
+    int w = depth->width, h = depth->height;
+    const Uint16* d = depth->row<Uint16>(0);
+
+    // The nearest depth in range with enough pixels is the participant.
+    std::fill(m_hist, m_hist + DEPTH_BINS, 0);
+    depth_histogram(d, size_t(w) * h, m_hist);
+    Uint32 min_area = Uint32(MIN_AREA * w * h);
+    int near = MIN_RANGE_MM / DEPTH_BIN_MM;
+    while (near < MAX_RANGE_MM / DEPTH_BIN_MM && m_hist[near] < min_area)
+        ++near;
+
+    Uint32 flags = 0;
+    BlobStats blob = { 0, 0, 0 };
+    float x = 0.0f, y = 0.0f, z = 0.0f;
+    if (near == MAX_RANGE_MM / DEPTH_BIN_MM) {
+        flags |= QUALITY_NO_FACE;
+        m_had_blob = false;
+    } else {
+        int lo = near * DEPTH_BIN_MM, hi = lo + BLOB_DEPTH_MM;
+        blob_stats(d, w, h, Uint16(lo), Uint16(hi), blob);
+
+        // The mean distance, from the histogram's bins, that's close enough.
+        double sum = 0.0, n = 0.0;
+        for (int b = near; b < std::min(DEPTH_BINS, hi / DEPTH_BIN_MM); ++b) {
+            sum += m_hist[b] * (b + 0.5) * DEPTH_BIN_MM;
+            n += m_hist[b];
+        }
+        x = float(blob.sum_x) / blob.area;
+        y = float(blob.sum_y) / blob.area;
+        z = float(sum / n);
+
+        if (z < TOO_CLOSE_MM)
+            flags |= QUALITY_TOO_CLOSE;
+        if (z > TOO_FAR_MM)
+            flags |= QUALITY_TOO_FAR;
+        if (m_had_blob && (std::hypot(x - m_x, y - m_y) > MOVE_WIDTHS * w || std::fabs(z - m_z) > MOVE_MM))
+            flags |= QUALITY_MOVED;
+        m_had_blob = true;
+        m_x = x;
+        m_y = y;
+        m_z = z;
+    }
+
+    for (int i = 0; i < 4; ++i)
+        m_flagged[i] += (flags >> i) & 1;
+    m_log.row("%u,%lld,%u,%.0f,%u,%.1f,%.1f", depth->index, (long long)depth->host_us, flags, z, blob.area, x, y);
+
+    m_moved_frames = flags & QUALITY_MOVED ? MOVED_FRAMES : (m_moved_frames ? m_moved_frames - 1 : 0);
+    g_counters.quality_flags.store(int(flags | (m_moved_frames ? QUALITY_MOVED : 0)), std::memory_order_relaxed);
+}
+
+void QualityStage::end()
+{
+    g_counters.quality_flags.store(-1, std::memory_order_relaxed);
+    m_log.close();
+
+    static const char* keys[] = { "quality_no_face_frames", "quality_too_close_frames", "quality_too_far_frames", "quality_moved_frames" };
+    for (int i = 0; i < 4; ++i)
+        session_meta(keys[i], double(m_flagged[i]));
+}
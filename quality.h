@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <SDL_stdinc.h>
+
+#include "session.h"
+#include "stage.h"
+
+// Watches whether the participant stays where the recording needs them, from
+// simple statistics of the depth stream: the nearest blob in range is taken to
+// be the participant, and its distance, area and centroid tell the rest.
+
+enum {
+    QUALITY_NO_FACE = 1 << 0,    // Nobody in range at all.
+    QUALITY_TOO_CLOSE = 1 << 1,
+    QUALITY_TOO_FAR = 1 << 2,
+    QUALITY_MOVED = 1 << 3,      // The blob jumped between frames.
+};
+
+// "too close, moved" etc., "ok" for no flags.
+std::string quality_text(Uint32 flags);
+
+// Depths in millimeters into `DEPTH_BINS` bins of `DEPTH_BIN_MM` each, the last one
+// taking everything beyond, bin 0 including the pixels without a measurement.
+static const int DEPTH_BINS = 64, DEPTH_BIN_SHIFT = 5, DEPTH_BIN_MM = 1 << DEPTH_BIN_SHIFT;
+
+// The pixels of a frame at depths in [lo, hi).
+struct BlobStats {
+    Uint32 area;
+    Uint64 sum_x, sum_y;
+};
+
+// Adds `n` depths to `hist`, using the best kernel the CPU supports.
+void depth_histogram(const Uint16* depth, size_t n, Uint32* hist);
+// Of the `w`x`h` depths, using the best kernel the CPU supports.
+void blob_stats(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out);
+
+// The individual kernels, for testing and benchmarking.
+void depth_histogram_scalar(const Uint16* depth, size_t n, Uint32* hist);
+void depth_histogram_sse2(const Uint16* depth, size_t n, Uint32* hist);
+void depth_histogram_avx2(const Uint16* depth, size_t n, Uint32* hist);
+void blob_stats_scalar(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out);
+void blob_stats_sse2(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out);
+void blob_stats_avx2(const Uint16* depth, int w, int h, Uint16 lo, Uint16 hi, BlobStats& out);
+
+// Flags every depth frame on a worker thread, logging them per frame into
+// `<session>.quality.csv` and how many frames got each into the meta. The newest
+// flags are published in `g_counters.quality_flags` for warning the operator, with
+// `QUALITY_MOVED` kept up for half a second so it can't be missed.
+class QualityStage : public Stage {
+public:
+    QualityStage();
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    Uint32 m_hist[DEPTH_BINS];
+    bool m_had_blob;
+    float m_x, m_y, m_z;
+    unsigned m_moved_frames;
+    Uint64 m_flagged[4];
+
+    SessionLog m_log;
+};
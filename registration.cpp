@@ -0,0 +1,271 @@
+#include "registration.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <SDL_cpuinfo.h>
+
+#include "simd.h"
+
+void RegistrationTable::init(const Intrinsics& depth, const Intrinsics& color_, const Extrinsics& e)
+{
+    width = depth.width;
+    height = depth.height;
+    color = color_;
+    // The depth is in millimeters, so the translation has to be, too.
+    tx = 1000.0f * e.t[0];
+    ty = 1000.0f * e.t[1];
+    tz = 1000.0f * e.t[2];
+
+    x.resize(size_t(width) * height);
+    y.resize(x.size());
+    z.resize(x.size());
+    for (int v = 0; v < height; ++v) {
+        for (int u = 0; u < width; ++u) {
+            size_t i = size_t(v)*width + u;
+            float rx, ry;
+            depth.unproject(float(u), float(v), rx, ry);
+            e.apply(rx, ry, 1.0f, x[i], y[i], z[i]);
+            // `apply` adds the translation, which isn't per unit of depth.
+            x[i] -= e.t[0];
+            y[i] -= e.t[1];
+            z[i] -= e.t[2];
+        }
+    }
+}
+
+// Pixels `begin` to `end`. The vectorized kernels do exactly the same operations
+// in the same order, so that all of them agree to the bit.
+static void project_range(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t begin, size_t end)
+{
+    const Intrinsics& c = t.color;
+    const float p0x2 = 2.0f*c.p[0], p1x2 = 2.0f*c.p[1];
+    const float w = float(c.width), h = float(c.height);
+
+    for (size_t i = begin; i < end; ++i) {
+        target[i] = -1;
+        z[i] = 0;
+
+        float d = float(depth[i]);
+        float px = d*t.x[i] + t.tx;
+        float py = d*t.y[i] + t.ty;
+        float pz = d*t.z[i] + t.tz;
+        if (!(d > 0.0f) || !(pz > 0.0f))
+            continue;
+
+        // `Intrinsics::project`.
+        float xn = px / pz, yn = py / pz;
+        float xx = xn*xn, yy = yn*yn, xy = xn*yn;
+        float r2 = xx + yy;
+        float radial = 1.0f + r2*(c.k[0] + r2*(c.k[1] + r2*c.k[2]));
+        float xd = xn*radial + p0x2*xy + c.p[1]*(r2 + 2.0f*xx);
+        float yd = yn*radial + c.p[0]*(r2 + 2.0f*yy) + p1x2*xy;
+        // Rounded to the nearest pixel.
+        float u = c.fx*xd + c.cx + 0.5f;
+        float v = c.fy*yd + c.cy + 0.5f;
+        if (u >= 0.0f && u < w && v >= 0.0f && v < h) {
+            target[i] = int(v)*c.width + int(u);
+            z[i] = Uint16(std::min(pz + 0.5f, 65535.0f));
+        }
+    }
+}
+
+void project_depth_scalar(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n)
+{
+    project_range(t, depth, target, z, 0, n);
+}
+
+#ifdef HAVE_SSE2
+void project_depth_sse2(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n)
+{
+    const Intrinsics& c = t.color;
+    const __m128 tx = _mm_set1_ps(t.tx), ty = _mm_set1_ps(t.ty), tz = _mm_set1_ps(t.tz);
+    const __m128 k0 = _mm_set1_ps(c.k[0]), k1 = _mm_set1_ps(c.k[1]), k2 = _mm_set1_ps(c.k[2]);
+    const __m128 p0 = _mm_set1_ps(c.p[0]), p1 = _mm_set1_ps(c.p[1]);
+    const __m128 p0x2 = _mm_set1_ps(2.0f*c.p[0]), p1x2 = _mm_set1_ps(2.0f*c.p[1]);
+    const __m128 fx = _mm_set1_ps(c.fx), fy = _mm_set1_ps(c.fy), cx = _mm_set1_ps(c.cx), cy = _mm_set1_ps(c.cy);
+    const __m128 w = _mm_set1_ps(float(c.width)), h = _mm_set1_ps(float(c.height));
+    const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    const __m128 zmax = _mm_set1_ps(65535.0f);
+    const __m128i none = _mm_set1_epi32(-1);
+    // SSE2 can only pack signed, so shift into that range and back.
+    const __m128i bias32 = _mm_set1_epi32(32768), bias16 = _mm_set1_epi16(-32768);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+        __m128i zi[2];
+        for (int j = 0; j < 2; ++j) {
+            size_t k = i + 4*j;
+            __m128 d = _mm_cvtepi32_ps(j ? _mm_unpackhi_epi16(d16, _mm_setzero_si128()) : _mm_unpacklo_epi16(d16, _mm_setzero_si128()));
+            __m128 px = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(&t.x[k])), tx);
+            __m128 py = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(&t.y[k])), ty);
+            __m128 pz = _mm_add_ps(_mm_mul_ps(d, _mm_loadu_ps(&t.z[k])), tz);
+
+            __m128 xn = _mm_div_ps(px, pz), yn = _mm_div_ps(py, pz);
+            __m128 xx = _mm_mul_ps(xn, xn), yy = _mm_mul_ps(yn, yn), xy = _mm_mul_ps(xn, yn);
+            __m128 r2 = _mm_add_ps(xx, yy);
+            __m128 radial = _mm_add_ps(one, _mm_mul_ps(r2, _mm_add_ps(k0, _mm_mul_ps(r2, _mm_add_ps(k1, _mm_mul_ps(r2, k2))))));
+            __m128 xd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(xn, radial), _mm_mul_ps(p0x2, xy)), _mm_mul_ps(p1, _mm_add_ps(r2, _mm_mul_ps(two, xx))));
+            __m128 yd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(yn, radial), _mm_mul_ps(p0, _mm_add_ps(r2, _mm_mul_ps(two, yy)))), _mm_mul_ps(p1x2, xy));
+            __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, xd), cx), half);
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fy, yd), cy), half);
+
+            // Comparisons with NaN are false, so the divisions by 0 drop out here, too.
+            __m128 valid = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_cmpgt_ps(pz, zero));
+            valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmplt_ps(u, w)));
+            valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmplt_ps(v, h)));
+            __m128i mask = _mm_castps_si128(valid);
+
+            // No 32 bit multiplies in SSE2, but the indices are exact in floats.
+            __m128 index = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)), w), _mm_cvtepi32_ps(_mm_cvttps_epi32(u)));
+            __m128i ti = _mm_or_si128(_mm_and_si128(mask, _mm_cvttps_epi32(index)), _mm_andnot_si128(mask, none));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + k), ti);
+            zi[j] = _mm_and_si128(mask, _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(pz, half), zmax)));
+        }
+        __m128i z16 = _mm_packs_epi32(_mm_sub_epi32(zi[0], bias32), _mm_sub_epi32(zi[1], bias32));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(z + i), _mm_xor_si128(z16, bias16));
+    }
+    project_range(t, depth, target, z, i, n);
+}
+#else
+void project_depth_sse2(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n)
+{
+    project_depth_scalar(t, depth, target, z, n);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 void project_depth_avx2(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n)
+{
+    const Intrinsics& c = t.color;
+    const __m256 tx = _mm256_set1_ps(t.tx), ty = _mm256_set1_ps(t.ty), tz = _mm256_set1_ps(t.tz);
+    const __m256 k0 = _mm256_set1_ps(c.k[0]), k1 = _mm256_set1_ps(c.k[1]), k2 = _mm256_set1_ps(c.k[2]);
+    const __m256 p0 = _mm256_set1_ps(c.p[0]), p1 = _mm256_set1_ps(c.p[1]);
+    const __m256 p0x2 = _mm256_set1_ps(2.0f*c.p[0]), p1x2 = _mm256_set1_ps(2.0f*c.p[1]);
+    const __m256 fx = _mm256_set1_ps(c.fx), fy = _mm256_set1_ps(c.fy), cx = _mm256_set1_ps(c.cx), cy = _mm256_set1_ps(c.cy);
+    const __m256 w = _mm256_set1_ps(float(c.width)), h = _mm256_set1_ps(float(c.height));
+    const __m256 zero = _mm256_setzero_ps(), half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+    const __m256 zmax = _mm256_set1_ps(65535.0f);
+    const __m256i none = _mm256_set1_epi32(-1);
+    const __m256i width = _mm256_set1_epi32(c.width);
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i d16 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(depth + i));
+        __m256i zi[2];
+        for (int j = 0; j < 2; ++j) {
+            size_t k = i + 8*j;
+            __m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(j ? _mm256_extracti128_si256(d16, 1) : _mm256_castsi256_si128(d16)));
+            __m256 px = _mm256_add_ps(_mm256_mul_ps(d, _mm256_loadu_ps(&t.x[k])), tx);
+            __m256 py = _mm256_add_ps(_mm256_mul_ps(d, _mm256_loadu_ps(&t.y[k])), ty);
+            __m256 pz = _mm256_add_ps(_mm256_mul_ps(d, _mm256_loadu_ps(&t.z[k])), tz);
+
+            __m256 xn = _mm256_div_ps(px, pz), yn = _mm256_div_ps(py, pz);
+            __m256 xx = _mm256_mul_ps(xn, xn), yy = _mm256_mul_ps(yn, yn), xy = _mm256_mul_ps(xn, yn);
+            __m256 r2 = _mm256_add_ps(xx, yy);
+            __m256 radial = _mm256_add_ps(one, _mm256_mul_ps(r2, _mm256_add_ps(k0, _mm256_mul_ps(r2, _mm256_add_ps(k1, _mm256_mul_ps(r2, k2))))));
+            __m256 xd = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(xn, radial), _mm256_mul_ps(p0x2, xy)), _mm256_mul_ps(p1, _mm256_add_ps(r2, _mm256_mul_ps(two, xx))));
+            __m256 yd = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(yn, radial), _mm256_mul_ps(p0, _mm256_add_ps(r2, _mm256_mul_ps(two, yy)))), _mm256_mul_ps(p1x2, xy));
+            __m256 u = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, xd), cx), half);
+            __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fy, yd), cy), half);
+
+            __m256 valid = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ), _mm256_cmp_ps(pz, zero, _CMP_GT_OQ));
+            valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, w, _CMP_LT_OQ)));
+            valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, h, _CMP_LT_OQ)));
+
+            __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(v), width), _mm256_cvttps_epi32(u));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target + k), _mm256_blendv_epi8(none, index, _mm256_castps_si256(valid)));
+            zi[j] = _mm256_and_si256(_mm256_castps_si256(valid), _mm256_cvttps_epi32(_mm256_min_ps(_mm256_add_ps(pz, half), zmax)));
+        }
+        // Packing works per 128 bit lane, so the halves need putting back in order.
+        __m256i z16 = _mm256_permute4x64_epi64(_mm256_packus_epi32(zi[0], zi[1]), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(z + i), z16);
+    }
+    project_range(t, depth, target, z, i, n);
+}
+#else
+void project_depth_avx2(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n)
+{
+    project_depth_sse2(t, depth, target, z, n);
+}
+#endif
+
+void project_depth(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        project_depth_avx2(t, depth, target, z, n);
+    else if (SDL_HasSSE2())
+        project_depth_sse2(t, depth, target, z, n);
+    else
+        project_depth_scalar(t, depth, target, z, n);
+}
+
+size_t splat_depth(const Sint32* target, const Uint16* z, size_t n, Uint16* aligned, size_t& occluded)
+{
+    size_t landed = 0;
+    occluded = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (target[i] < 0)
+            continue;
+        ++landed;
+        Uint16& a = aligned[target[i]];
+        if (!a) {
+            a = z[i];
+        } else {
+            ++occluded;
+            a = std::min(a, z[i]);
+        }
+    }
+    return landed;
+}
+
+RegistrationStage::RegistrationStage(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color, bool store)
+    : Stage("registration", STREAM_DEPTH)
+    , m_depth(depth)
+    , m_color(color)
+    , m_extrinsics(depth_to_color)
+    , m_store(store)
+{}
+
+void RegistrationStage::begin()
+{
+    m_log.open("registration", "frame,host_us,landed,occluded");
+    if (m_store)
+        m_stream.open("aligned_depth");
+}
+
+void RegistrationStage::process(const FrameSet& frames)
+{
+    const Frame* depth = frames.depth.get();
+    if (!depth)
+        return;
+
+    if (depth->width != m_table.width || depth->height != m_table.height) {
+        m_table.init(m_depth.scaled(depth->width, depth->height), m_color, m_extrinsics);
+        m_target.resize(m_table.x.size());
+        m_z.resize(m_table.x.size());
+    }
+    size_t n = m_target.size();
+    project_depth(m_table, depth->row<Uint16>(0), m_target.data(), m_z.data(), n);
+
+    FramePtr aligned = m_pool.get(FRAME_DEPTH16, m_color.width, m_color.height);
+    aligned->index = depth->index;
+    aligned->device_us = depth->device_us;
+    aligned->host_us = depth->host_us;
+    std::memset(aligned->pixels.data(), 0, aligned->pixels.size());
+    size_t occluded;
+    size_t landed = splat_depth(m_target.data(), m_z.data(), n, aligned->row<Uint16>(0), occluded);
+    m_aligned = aligned;
+
+    m_log.row("%u,%lld,%u,%u", depth->index, (long long)depth->host_us, unsigned(landed), unsigned(occluded));
+    if (m_store)
+        m_stream.write(*m_aligned);
+}
+
+void RegistrationStage::end()
+{
+    m_log.close();
+    m_stream.close();
+}
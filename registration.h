@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// Depth registered to color: what the depth camera measured, as seen from the
+// color camera, so that a color pixel's depth is the aligned frame's same pixel.
+//
+// Per depth pixel, a point at depth d lands at d * (x,y,z) + t in the color
+// camera's coordinates, in millimeters. That only depends on the calibration, so
+// it's computed once per stream profile, and what's left per pixel is a few
+// multiply-adds, the color camera's projection, and a z-buffer for the points
+// the color camera sees hidden behind others.
+struct RegistrationTable {
+    int width, height;  // Of the depth stream.
+    Intrinsics color;
+    float tx, ty, tz;
+    std::vector<float> x, y, z;
+
+    RegistrationTable() : width(0), height(0) {}
+    void init(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color);
+};
+
+// Where the first `n` depth pixels land in the color frame, as the index of the
+// color pixel in `target` (-1 for nowhere) and the depth from the color camera in
+// `z`. Uses the best kernel the CPU supports.
+void project_depth(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n);
+
+// Draws what `project_depth` computed into `aligned` (color-sized, all 0 beforehand),
+// the nearest point winning where several land on a pixel. Returns how many landed
+// anywhere, and how many of those lost against nearer ones in `occluded`.
+size_t splat_depth(const Sint32* target, const Uint16* z, size_t n, Uint16* aligned, size_t& occluded);
+
+// The individual kernels, for testing and benchmarking.
+void project_depth_scalar(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n);
+void project_depth_sse2(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n);
+void project_depth_avx2(const RegistrationTable& t, const Uint16* depth, Sint32* target, Uint16* z, size_t n);
+
+// Registers every depth frame to color on a worker thread, logging per frame how
+// many pixels made it and how many were occluded (`<session>.registration.csv`).
+// With `store`, the aligned frames also go into `<session>.aligned_depth.frames`.
+class RegistrationStage : public Stage {
+public:
+    RegistrationStage(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color, bool store);
+
+    // Worker thread: the newest aligned depth frame, null before the first.
+    const FramePtr& aligned() const { return m_aligned; }
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    Intrinsics m_depth, m_color;
+    Extrinsics m_extrinsics;
+    bool m_store;
+
+    RegistrationTable m_table;
+    std::vector<Sint32> m_target;
+    std::vector<Uint16> m_z;
+    FramePool m_pool;
+    FramePtr m_aligned;
+
+    SessionLog m_log;
+    SessionStream m_stream;
+};
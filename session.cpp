@@ -0,0 +1,235 @@
+#include "session.h"
+
+#include <cstdarg>
+#include <ctime>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <codecvt>
+#include <locale>
+#include <windows.h>
+#else
+#include <sys/statvfs.h>
+#endif
+
+#include <SDL.h>
+
+#include "counters.h"
+#include "frames.h"
+#include "verify.h"
+
+static std::string g_session_base;
+static std::mutex g_meta_mutex;
+
+static std::thread g_watch_thread;
+static std::atomic<bool> g_watching(false);
+static const Uint32 WATCH_MS = 250;
+static const unsigned DISK_EVERY = 8;
+
+std::string pref_path()
+{
+    char *pszPath = SDL_GetPrefPath("Beymans", "RealSenseRecorder");
+    if (!pszPath)
+        return std::string();
+    std::string path = pszPath;
+    SDL_free(pszPath);
+    return path;
+}
+
+std::string now()
+{
+    std::time_t rawtime;
+    std::time(&rawtime);
+
+    char buffer[80];
+    std::strftime(buffer, 80, "%Y-%m-%d-%H-%M-%S", std::localtime(&rawtime));
+    return std::string(buffer);
+}
+
+bool session_open()
+{
+    std::string dir = pref_path();
+    if (dir.empty()) {
+        show_error("SDL Error", "Can't retrieve your home directory. What the!?");
+        return false;
+    }
+    g_session_base = dir + now();
+    std::cout << "Session files go to " << g_session_base << ".*" << std::endl;
+    return true;
+}
+
+void session_close()
+{
+    g_session_base.clear();
+}
+
+std::string session_path(const std::string& suffix)
+{
+    return g_session_base + suffix;
+}
+
+#ifdef _WIN32
+// Windows only takes non-ASCII paths as UTF-16.
+static std::wstring widen(const std::string& utf8)
+{
+    return std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(utf8);
+}
+#endif
+
+long long session_file_size(const std::string& suffix)
+{
+    if (g_session_base.empty())
+        return -1;
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_wstat64(widen(session_path(suffix)).c_str(), &st) != 0)
+        return -1;
+#else
+    struct stat st;
+    if (stat(session_path(suffix).c_str(), &st) != 0)
+        return -1;
+#endif
+    return (long long)st.st_size;
+}
+
+long long session_disk_free()
+{
+    std::string dir = pref_path();
+    if (dir.empty())
+        return -1;
+#ifdef _WIN32
+    ULARGE_INTEGER avail;
+    if (!GetDiskFreeSpaceExW(widen(dir).c_str(), &avail, nullptr, nullptr))
+        return -1;
+    return (long long)avail.QuadPart;
+#else
+    struct statvfs st;
+    if (statvfs(dir.c_str(), &st) != 0)
+        return -1;
+    return (long long)st.f_bavail * st.f_frsize;
+#endif
+}
+
+void session_watch_start()
+{
+    if (g_watching)
+        return;
+    g_watching = true;
+    g_watch_thread = std::thread([](){
+        SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+        for (unsigned i = 0; g_watching; ++i) {
+            long long recording = session_file_size(".rssdk");
+            g_counters.recording_bytes.store(recording < 0 ? 0 : recording, std::memory_order_relaxed);
+            if (i % DISK_EVERY == 0)
+                g_counters.disk_free.store(session_disk_free(), std::memory_order_relaxed);
+            SDL_Delay(WATCH_MS);
+        }
+    });
+}
+
+void session_watch_stop()
+{
+    g_watching = false;
+    if (g_watch_thread.joinable())
+        g_watch_thread.join();
+}
+
+void session_meta(const std::string& key, const std::string& value)
+{
+    if (g_session_base.empty())
+        return;
+
+    std::lock_guard<std::mutex> lock(g_meta_mutex);
+    FILE* f = std::fopen(session_path(".meta.txt").c_str(), "a");
+    if (!f)
+        return;
+    std::fprintf(f, "%s = %s\n", key.c_str(), value.c_str());
+    std::fclose(f);
+}
+
+void session_meta(const std::string& key, double value)
+{
+    std::ostringstream ss;
+    ss.precision(9);
+    ss << value;
+    session_meta(key, ss.str());
+}
+
+bool SessionLog::open(const std::string& name, const char* header)
+{
+    close();
+    if (g_session_base.empty())
+        return false;
+
+    m_f = std::fopen(session_path("." + name + ".csv").c_str(), "w");
+    if (!m_f)
+        return false;
+    std::fprintf(m_f, "%s\n", header);
+    return true;
+}
+
+void SessionLog::close()
+{
+    if (m_f)
+        std::fclose(m_f);
+    m_f = nullptr;
+}
+
+void SessionLog::row(const char* fmt, ...)
+{
+    if (!m_f)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    int n = std::vfprintf(m_f, fmt, args);
+    va_end(args);
+    std::fputc('\n', m_f);
+    if (n >= 0)
+        count(g_counters.bytes_logged, Uint64(n) + 1);
+}
+
+bool SessionStream::open(const std::string& name)
+{
+    close();
+    if (g_session_base.empty())
+        return false;
+
+    m_f = std::fopen(session_path("." + name + ".frames").c_str(), "wb");
+    return m_f != nullptr;
+}
+
+void SessionStream::close()
+{
+    if (m_f)
+        std::fclose(m_f);
+    m_f = nullptr;
+}
+
+void SessionStream::write(const Frame& frame)
+{
+    write(frame, 0, 0, frame.width, frame.height);
+}
+
+void SessionStream::write(const Frame& frame, int x, int y, int w, int h)
+{
+    if (!m_f)
+        return;
+
+    // Everything we run on is little-endian anyway.
+    Uint32 header32[4] = { frame.index, Uint32(frame.format), Uint32(w), Uint32(h) };
+    Sint64 header64[2] = { frame.device_us, frame.host_us };
+    std::fwrite(header32, sizeof(header32), 1, m_f);
+    std::fwrite(header64, sizeof(header64), 1, m_f);
+
+    int bpp = bytes_per_pixel(frame.format);
+    size_t row = size_t(w) * bpp;
+    for (int i = 0; i < h; ++i)
+        std::fwrite(frame.row<Uint8>(y + i) + x*bpp, row, 1, m_f);
+    count(g_counters.bytes_logged, sizeof(header32) + sizeof(header64) + row*h);
+}
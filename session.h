@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+struct Frame;
+
+// A session is everything belonging to one recording. All its files live in the
+// SDL pref-path and share a basename with the `.rssdk` file the SDK writes, e.g.
+//   2015-06-01-12-00-00.rssdk      the SDK's recording
+//   2015-06-01-12-00-00.meta.txt   `key = value` lines, see `session_meta`
+//   2015-06-01-12-00-00.NAME.csv   per-frame logs, see `SessionLog`
+//   2015-06-01-12-00-00.NAME.frames  image streams of our own, see `SessionStream`
+
+// The per-user directory we store everything in, with trailing separator.
+// Empty if SDL can't figure it out.
+std::string pref_path();
+
+// Current date and time as almost-ISO string.
+std::string now();
+
+// Picks the basename for a new session. Returns false (after complaining) on failure.
+bool session_open();
+// Ends it, once nothing writes to it anymore: meta and logs from then on go nowhere.
+void session_close();
+
+// The full path of a session file, e.g. `session_path(".rssdk")`.
+std::string session_path(const std::string& suffix);
+
+// Size in bytes of a session file so far, -1 if there's none (yet).
+long long session_file_size(const std::string& suffix);
+
+// Free bytes on the disk the sessions go to, -1 if we can't tell.
+long long session_disk_free();
+
+// Asking the file system can take a while on a busy disk, so a low-priority
+// thread of its own samples the `.rssdk` file's size four times a second, and
+// the free disk space every two, into `g_counters` for the `PerfHud`. Stop it
+// before the session is closed.
+void session_watch_start();
+void session_watch_stop();
+
+// Appends a `key = value` line to the session's meta file. Thread-safe.
+void session_meta(const std::string& key, const std::string& value);
+void session_meta(const std::string& key, double value);
+
+// A CSV file of per-frame records belonging to the session.
+// Each log should only ever be written to from one thread.
+class SessionLog {
+public:
+    SessionLog() : m_f(nullptr) {}
+    ~SessionLog() { close(); }
+
+    // Creates `<session>.<name>.csv` and writes the header line.
+    bool open(const std::string& name, const char* header);
+    void close();
+    bool is_open() const { return m_f != nullptr; }
+
+    // printf-style, a newline is appended. Counts into `g_counters.bytes_logged`.
+    void row(const char* fmt, ...);
+
+private:
+    SessionLog(const SessionLog&);
+    SessionLog& operator=(const SessionLog&);
+
+    FILE* m_f;
+};
+
+// A binary file of images belonging to the session, for what we compute from the
+// camera's streams ourselves. Per frame, a 32 byte little-endian header
+//   u32 index, u32 format (`FrameFormat`), u32 width, u32 height,
+//   i64 device_us, i64 host_us
+// followed by the pixels, rows without any padding.
+// Each stream should only ever be written to from one thread.
+class SessionStream {
+public:
+    SessionStream() : m_f(nullptr) {}
+    ~SessionStream() { close(); }
+
+    // Creates `<session>.<name>.frames`.
+    bool open(const std::string& name);
+    void close();
+    bool is_open() const { return m_f != nullptr; }
+
+    // Counts into `g_counters.bytes_logged`.
+    void write(const Frame& frame);
+    // Only the `w`x`h` pixels at x,y of `frame`, which have to be inside it.
+    void write(const Frame& frame, int x, int y, int w, int h);
+
+private:
+    SessionStream(const SessionStream&);
+    SessionStream& operator=(const SessionStream&);
+
+    FILE* m_f;
+};
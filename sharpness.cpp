@@ -0,0 +1,357 @@
+#include "sharpness.h"
+
+#include <algorithm>
+
+#include <SDL_cpuinfo.h>
+
+#include "convert.h"
+#include "simd.h"
+
+// The face's interior around the head's middle, in millimeters, leaving out the
+// hair line and the background next to the head, which stay sharp when the head moves.
+static const float FACE_W_MM = 140.0f, FACE_H_MM = 180.0f;
+// How much of each sharp frame goes into the usual score, and of each blurred one,
+// so that a lasting drop (lighting, focus) becomes the usual within a few seconds.
+static const float USUAL_GAIN = 0.05f, BLURRED_GAIN = 0.005f;
+
+// The gray weights on the 2x2 block's sums are 1024 times the luma of their average.
+static void gray_half_row(const Uint8* r0, const Uint8* r1, int from, int to, Uint8* gray)
+{
+    for (int i = from; i < to; ++i) {
+        const Uint8* p = r0 + 8*i;
+        const Uint8* q = r1 + 8*i;
+        int b = p[0] + p[4] + q[0] + q[4];
+        int g = p[1] + p[5] + q[1] + q[5];
+        int r = p[2] + p[6] + q[2] + q[6];
+        gray[i] = Uint8((GRAY_WEIGHT_B*b + GRAY_WEIGHT_G*g + GRAY_WEIGHT_R*r + 512) >> 10);
+    }
+}
+
+void gray_half_scalar(const Uint8* bgra, int width, int height, Uint8* gray)
+{
+    int w = width / 2;
+    for (int y = 0; y < height / 2; ++y) {
+        const Uint8* r0 = bgra + size_t(2*y) * width * 4;
+        gray_half_row(r0, r0 + width*4, 0, w, gray + size_t(y) * w);
+    }
+}
+
+static void add_scalar(const Uint8* c, int width, int from, int to, LaplacianStats& out)
+{
+    for (int i = from; i < to; ++i) {
+        int l = 4*c[i] - c[i-1] - c[i+1] - c[i-width] - c[i+width];
+        out.sum += l;
+        out.sum_sq += Uint64(l*l);
+    }
+}
+
+void laplacian_stats_scalar(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out)
+{
+    out.n = Uint32(w) * h;
+    out.sum = 0;
+    out.sum_sq = 0;
+    for (int r = y; r < y + h; ++r)
+        add_scalar(gray + size_t(r) * width, width, x, x + w, out);
+}
+
+double LaplacianStats::variance() const
+{
+    if (!n)
+        return 0.0;
+    double mean = double(sum) / n;
+    return double(sum_sq) / n - mean*mean;
+}
+
+#ifdef HAVE_SSE2
+// The sums of the 4 lanes of each of m0..m3, in that order.
+static inline __m128i sum4(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    __m128i u0 = _mm_add_epi32(_mm_unpacklo_epi32(m0, m1), _mm_unpackhi_epi32(m0, m1));
+    __m128i u1 = _mm_add_epi32(_mm_unpacklo_epi32(m2, m3), _mm_unpackhi_epi32(m2, m3));
+    return _mm_add_epi32(_mm_unpacklo_epi64(u0, u1), _mm_unpackhi_epi64(u0, u1));
+}
+
+void gray_half_sse2(const Uint8* bgra, int width, int height, Uint8* gray)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_setr_epi16(GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                           GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0);
+    const __m128i round = _mm_set1_epi32(512);
+    int w = width / 2;
+    for (int y = 0; y < height / 2; ++y) {
+        const Uint8* r0 = bgra + size_t(2*y) * width * 4;
+        const Uint8* r1 = r0 + width*4;
+        Uint8* out = gray + size_t(y) * w;
+        int i = 0;
+        for (; i + 8 <= w; i += 8) {
+            // Each pair of pixels in a row, summed with the one below, makes one output.
+            __m128i m[8];
+            for (int k = 0; k < 4; ++k) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 8*i + 16*k));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 8*i + 16*k));
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                m[2*k] = _mm_madd_epi16(lo, weights);
+                m[2*k + 1] = _mm_madd_epi16(hi, weights);
+            }
+            __m128i g0 = _mm_srli_epi32(_mm_add_epi32(sum4(m[0], m[1], m[2], m[3]), round), 10);
+            __m128i g1 = _mm_srli_epi32(_mm_add_epi32(sum4(m[4], m[5], m[6], m[7]), round), 10);
+            __m128i g = _mm_packs_epi32(g0, g1);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(g, g));
+        }
+        gray_half_row(r0, r1, i, w, out);
+    }
+}
+
+void laplacian_stats_sse2(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    out.n = Uint32(w) * h;
+    out.sum = 0;
+    out.sum_sq = 0;
+    Sint32 lanes[4];
+    for (int r = y; r < y + h; ++r) {
+        const Uint8* c = gray + size_t(r) * width;
+        // In 32 bits per row, which even at 1020 squared for every pixel takes
+        // thousands of pixels to overflow.
+        __m128i sum = zero, sum_sq = zero;
+        int i = x;
+        for (; i + 16 <= x + w; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i));
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i - 1));
+            __m128i e = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i + 1));
+            __m128i n = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i - width));
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(c + i + width));
+            __m128i lap[2];
+            lap[0] = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(v, zero), 2),
+                                   _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(l, zero), _mm_unpacklo_epi8(e, zero)),
+                                                 _mm_add_epi16(_mm_unpacklo_epi8(n, zero), _mm_unpacklo_epi8(s, zero))));
+            lap[1] = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(v, zero), 2),
+                                   _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(l, zero), _mm_unpackhi_epi8(e, zero)),
+                                                 _mm_add_epi16(_mm_unpackhi_epi8(n, zero), _mm_unpackhi_epi8(s, zero))));
+            for (int k = 0; k < 2; ++k) {
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(lap[k], ones));
+                sum_sq = _mm_add_epi32(sum_sq, _mm_madd_epi16(lap[k], lap[k]));
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+        out.sum += Sint64(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum_sq);
+        out.sum_sq += Uint64(Uint32(lanes[0])) + Uint32(lanes[1]) + Uint32(lanes[2]) + Uint32(lanes[3]);
+        add_scalar(c, width, i, x + w, out);
+    }
+}
+#else
+void gray_half_sse2(const Uint8* bgra, int width, int height, Uint8* gray)
+{
+    gray_half_scalar(bgra, width, height, gray);
+}
+
+void laplacian_stats_sse2(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out)
+{
+    laplacian_stats_scalar(gray, width, x, y, w, h, out);
+}
+#endif
+
+#ifdef HAVE_AVX2
+TARGET_AVX2 static inline __m256i sum4_avx2(__m256i m0, __m256i m1, __m256i m2, __m256i m3)
+{
+    __m256i u0 = _mm256_add_epi32(_mm256_unpacklo_epi32(m0, m1), _mm256_unpackhi_epi32(m0, m1));
+    __m256i u1 = _mm256_add_epi32(_mm256_unpacklo_epi32(m2, m3), _mm256_unpackhi_epi32(m2, m3));
+    return _mm256_add_epi32(_mm256_unpacklo_epi64(u0, u1), _mm256_unpackhi_epi64(u0, u1));
+}
+
+TARGET_AVX2 void gray_half_avx2(const Uint8* bgra, int width, int height, Uint8* gray)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i weights = _mm256_setr_epi16(GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                              GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                              GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0,
+                                              GRAY_WEIGHT_B, GRAY_WEIGHT_G, GRAY_WEIGHT_R, 0);
+    const __m256i round = _mm256_set1_epi32(512);
+    // Unpacking and so the sums work per 128 bit lane, which leaves the outputs
+    // as 0 1 4 5 | 2 3 6 7.
+    const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    int w = width / 2;
+    for (int y = 0; y < height / 2; ++y) {
+        const Uint8* r0 = bgra + size_t(2*y) * width * 4;
+        const Uint8* r1 = r0 + width*4;
+        Uint8* out = gray + size_t(y) * w;
+        int i = 0;
+        for (; i + 16 <= w; i += 16) {
+            __m256i m[8];
+            for (int k = 0; k < 4; ++k) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r0 + 8*i + 32*k));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r1 + 8*i + 32*k));
+                __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+                __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+                m[2*k] = _mm256_madd_epi16(lo, weights);
+                m[2*k + 1] = _mm256_madd_epi16(hi, weights);
+            }
+            __m256i g0 = _mm256_permutevar8x32_epi32(sum4_avx2(m[0], m[1], m[2], m[3]), order);
+            __m256i g1 = _mm256_permutevar8x32_epi32(sum4_avx2(m[4], m[5], m[6], m[7]), order);
+            g0 = _mm256_srli_epi32(_mm256_add_epi32(g0, round), 10);
+            g1 = _mm256_srli_epi32(_mm256_add_epi32(g1, round), 10);
+            __m128i lo = _mm_packs_epi32(_mm256_castsi256_si128(g0), _mm256_extracti128_si256(g0, 1));
+            __m128i hi = _mm_packs_epi32(_mm256_castsi256_si128(g1), _mm256_extracti128_si256(g1, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+        }
+        gray_half_row(r0, r1, i, w, out);
+    }
+}
+
+TARGET_AVX2 void laplacian_stats_avx2(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    out.n = Uint32(w) * h;
+    out.sum = 0;
+    out.sum_sq = 0;
+    Sint32 lanes[8];
+    for (int r = y; r < y + h; ++r) {
+        const Uint8* c = gray + size_t(r) * width;
+        __m256i sum = zero, sum_sq = zero;
+        int i = x;
+        for (; i + 32 <= x + w; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + i));
+            __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + i - 1));
+            __m256i e = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + i + 1));
+            __m256i n = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + i - width));
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + i + width));
+            __m256i lap[2];
+            lap[0] = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_unpacklo_epi8(v, zero), 2),
+                                      _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(l, zero), _mm256_unpacklo_epi8(e, zero)),
+                                                       _mm256_add_epi16(_mm256_unpacklo_epi8(n, zero), _mm256_unpacklo_epi8(s, zero))));
+            lap[1] = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_unpackhi_epi8(v, zero), 2),
+                                      _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(l, zero), _mm256_unpackhi_epi8(e, zero)),
+                                                       _mm256_add_epi16(_mm256_unpackhi_epi8(n, zero), _mm256_unpackhi_epi8(s, zero))));
+            for (int k = 0; k < 2; ++k) {
+                sum = _mm256_add_epi32(sum, _mm256_madd_epi16(lap[k], ones));
+                sum_sq = _mm256_add_epi32(sum_sq, _mm256_madd_epi16(lap[k], lap[k]));
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        for (int k = 0; k < 8; ++k)
+            out.sum += lanes[k];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum_sq);
+        for (int k = 0; k < 8; ++k)
+            out.sum_sq += Uint32(lanes[k]);
+        add_scalar(c, width, i, x + w, out);
+    }
+}
+#else
+void gray_half_avx2(const Uint8* bgra, int width, int height, Uint8* gray)
+{
+    gray_half_sse2(bgra, width, height, gray);
+}
+
+void laplacian_stats_avx2(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out)
+{
+    laplacian_stats_sse2(gray, width, x, y, w, h, out);
+}
+#endif
+
+void gray_half(const Uint8* bgra, int width, int height, Uint8* gray)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        gray_half_avx2(bgra, width, height, gray);
+    else if (SDL_HasSSE2())
+        gray_half_sse2(bgra, width, height, gray);
+    else
+        gray_half_scalar(bgra, width, height, gray);
+}
+
+void laplacian_stats(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out)
+{
+    static const bool avx2 = cpu_has_avx2();
+    if (avx2)
+        laplacian_stats_avx2(gray, width, x, y, w, h, out);
+    else if (SDL_HasSSE2())
+        laplacian_stats_sse2(gray, width, x, y, w, h, out);
+    else
+        laplacian_stats_scalar(gray, width, x, y, w, h, out);
+}
+
+SharpnessStage::SharpnessStage(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color)
+    : Stage("sharpness", STREAM_DEPTH | STREAM_COLOR)
+    , m_color(color)
+    , m_extrinsics(depth_to_color)
+    , m_tracker(depth)
+    , m_blurred_frames(0)
+{
+    m_usual[0] = m_usual[1] = 0.0f;
+}
+
+void SharpnessStage::begin()
+{
+    m_usual[0] = m_usual[1] = 0.0f;
+    m_blurred_frames = 0;
+    m_scores.clear();
+    m_log.open("sharpness", "frame,host_us,face,x,y,w,h,sharpness,usual_sharpness,blurred");
+}
+
+void SharpnessStage::process(const FrameSet& frames)
+{
+    const Frame* color = frames.color.get();
+    if (!color || color->width < 8 || color->height < 8)
+        return;
+
+    // Halved, which is sharp enough to tell blur by head motion, and a quarter of the work.
+    int gw = color->width / 2, gh = color->height / 2;
+    m_gray.resize(size_t(gw) * gh);
+    gray_half(color->row<Uint8>(0), gw*2, gh*2, m_gray.data());
+
+    // The face in the halved frame, or its middle when the head is lost, a pixel
+    // away from the borders for the Laplacian.
+    bool face = frames.depth && m_tracker.update(*frames.depth);
+    int x0 = gw/4, y0 = gh/4, x1 = gw - gw/4, y1 = gh - gh/4;
+    if (face) {
+        Intrinsics in = m_color.scaled(gw, gh);
+        float u, v, z;
+        m_tracker.in_camera(in, m_extrinsics, u, v, z);
+        int w = int(in.fx * FACE_W_MM / z), h = int(in.fy * FACE_H_MM / z);
+        int fx0 = std::max(1, int(u) - w/2), fy0 = std::max(1, int(v) - h/2);
+        int fx1 = std::min(gw - 1, int(u) - w/2 + w), fy1 = std::min(gh - 1, int(v) - h/2 + h);
+        face = fx1 - fx0 >= 8 && fy1 - fy0 >= 8;
+        if (face) {
+            x0 = fx0;
+            y0 = fy0;
+            x1 = fx1;
+            y1 = fy1;
+        }
+    }
+
+    LaplacianStats stats;
+    laplacian_stats(m_gray.data(), gw, x0, y0, x1 - x0, y1 - y0, stats);
+    float score = float(stats.variance());
+
+    // The face and the frame's middle score differently, so each has its own.
+    float& usual = m_usual[face];
+    if (usual <= 0.0f)
+        usual = score;
+    bool blurred = score < SHARPNESS_BLURRED * usual;
+    if (blurred)
+        ++m_blurred_frames;
+    usual += (blurred ? BLURRED_GAIN : USUAL_GAIN) * (score - usual);
+    m_scores.push_back(score);
+
+    m_log.row("%u,%lld,%d,%d,%d,%d,%d,%.1f,%.1f,%d", color->index, (long long)color->host_us, int(face),
+              2*x0, 2*y0, 2*(x1 - x0), 2*(y1 - y0), score, usual, int(blurred));
+}
+
+void SharpnessStage::end()
+{
+    m_log.close();
+
+    double p50 = 0.0, p10 = 0.0;
+    if (!m_scores.empty()) {
+        std::sort(m_scores.begin(), m_scores.end());
+        p50 = m_scores[m_scores.size() / 2];
+        p10 = m_scores[m_scores.size() / 10];
+    }
+    session_meta("sharpness_p50", p50);
+    session_meta("sharpness_p10", p10);
+    session_meta("blurred_frames", double(m_blurred_frames));
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL_stdinc.h>
+
+#include "calibration.h"
+#include "facecrop.h"
+#include "frames.h"
+#include "session.h"
+#include "stage.h"
+
+// Halves the `width`x`height` BGRA `bgra` into gray, each output pixel the luma of a
+// 2x2 block's average. `width` and `height` need to be even. Uses the best kernel
+// the CPU supports.
+void gray_half(const Uint8* bgra, int width, int height, Uint8* gray);
+
+// Sums of the 4-neighbour Laplacian over a region of a gray image.
+struct LaplacianStats {
+    Uint32 n;
+    Sint64 sum;
+    Uint64 sum_sq;
+
+    // The variance of the Laplacian: high for sharp edges and texture, low for
+    // blurred or flat regions.
+    double variance() const;
+};
+
+// Of the `w`x`h` region at x,y of the `width` wide `gray`, which needs to keep a pixel
+// away from the image's borders. Uses the best kernel the CPU supports.
+void laplacian_stats(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out);
+
+// The individual kernels, for testing and benchmarking.
+void gray_half_scalar(const Uint8* bgra, int width, int height, Uint8* gray);
+void gray_half_sse2(const Uint8* bgra, int width, int height, Uint8* gray);
+void gray_half_avx2(const Uint8* bgra, int width, int height, Uint8* gray);
+void laplacian_stats_scalar(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out);
+void laplacian_stats_sse2(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out);
+void laplacian_stats_avx2(const Uint8* gray, int width, int x, int y, int w, int h, LaplacianStats& out);
+
+// A frame is blurred when it scores below SHARPNESS_BLURRED times the usual score.
+static const float SHARPNESS_BLURRED = 0.5f;
+
+// Scores how sharp every color frame is on a worker thread, so frames blurred by
+// fast head motion can be left out of training.
+//
+// The score is the variance of the Laplacian over the face, found from the head in
+// the depth stream (see `HeadTracker`), or over the middle of the frame while the
+// head is lost, on the frame halved to gray. A frame is blurred when it scores below
+// half of the usual score over the same kind of region, which follows the sharp
+// frames and, only slowly, the blurred ones, so a lasting drop doesn't blur the
+// rest of the session. Per frame, the score goes into `<session>.sharpness.csv`,
+// and its median, 10th percentile and the number of blurred frames into the meta.
+class SharpnessStage : public Stage {
+public:
+    SharpnessStage(const Intrinsics& depth, const Intrinsics& color, const Extrinsics& depth_to_color);
+
+protected:
+    void begin() override;
+    void process(const FrameSet& frames) override;
+    void end() override;
+
+private:
+    Intrinsics m_color;
+    Extrinsics m_extrinsics;
+
+    HeadTracker m_tracker;
+    std::vector<Uint8> m_gray;
+
+    // Over the frame's middle and over the face, 0 until their first frame.
+    float m_usual[2];
+    unsigned m_blurred_frames;
+    std::vector<float> m_scores;
+
+    SessionLog m_log;
+};
@@ -0,0 +1,29 @@
+#include "simd.h"
+
+#include <SDL_cpuinfo.h>
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <cpuid.h>
+#endif
+
+bool cpu_has_avx2()
+{
+    // SDL_HasAVX also checks that the OS saves the upper halves of the registers.
+    if (!SDL_HasAVX())
+        return false;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int regs[4];
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    unsigned a, b, c, d;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+        return false;
+    return (b & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
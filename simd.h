@@ -0,0 +1,28 @@
+#pragma once
+
+// Which SIMD instruction sets we can compile for. Whether the CPU we end up
+// running on actually has them is checked at runtime, see `cpu_has_avx2` and
+// `SDL_cpuinfo.h` for the rest.
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define HAVE_SSE2 1
+#  include <emmintrin.h>
+#endif
+
+// MSVC lets us use AVX2 intrinsics anywhere, GCC and clang only in functions marked for it.
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#  define HAVE_AVX2 1
+#  define TARGET_AVX2
+#  include <immintrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_AVX2 1
+#  define TARGET_AVX2 __attribute__((target("avx2")))
+#  include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define HAVE_NEON 1
+#  include <arm_neon.h>
+#endif
+
+// SDL 2.0.3 only knows up to AVX.
+bool cpu_has_avx2();
@@ -0,0 +1,164 @@
+#include "spritebatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <SDL_opengl.h>
+
+// The few GL 1.1 functions we need. We don't link against OpenGL ourselves,
+// SDL has it loaded already when it's the renderer.
+struct GLFuncs {
+    void (APIENTRY *EnableClientState)(GLenum);
+    void (APIENTRY *DisableClientState)(GLenum);
+    void (APIENTRY *VertexPointer)(GLint, GLenum, GLsizei, const GLvoid*);
+    void (APIENTRY *TexCoordPointer)(GLint, GLenum, GLsizei, const GLvoid*);
+    void (APIENTRY *ColorPointer)(GLint, GLenum, GLsizei, const GLvoid*);
+    void (APIENTRY *DrawArrays)(GLenum, GLint, GLsizei);
+    void (APIENTRY *Color4f)(GLfloat, GLfloat, GLfloat, GLfloat);
+};
+static GLFuncs g_gl;
+
+template<typename F>
+static bool load(F& f, const char* name)
+{
+    f = reinterpret_cast<F>(SDL_GL_GetProcAddress(name));
+    return f != nullptr;
+}
+
+static bool load_gl()
+{
+    return load(g_gl.EnableClientState, "glEnableClientState")
+        && load(g_gl.DisableClientState, "glDisableClientState")
+        && load(g_gl.VertexPointer, "glVertexPointer")
+        && load(g_gl.TexCoordPointer, "glTexCoordPointer")
+        && load(g_gl.ColorPointer, "glColorPointer")
+        && load(g_gl.DrawArrays, "glDrawArrays")
+        && load(g_gl.Color4f, "glColor4f");
+}
+
+SpriteBatch::SpriteBatch()
+    : m_renderer(nullptr)
+    , m_tex(nullptr)
+    , m_tw(0)
+    , m_th(0)
+    , m_gl(false)
+{}
+
+void SpriteBatch::init(SDL_Renderer* renderer)
+{
+    m_renderer = renderer;
+
+    SDL_RendererInfo info;
+    m_gl = SDL_GetRendererInfo(renderer, &info) == 0
+        && std::strcmp(info.name, "opengl") == 0
+        && load_gl();
+}
+
+void SpriteBatch::begin(SDL_Texture* tex)
+{
+    if (tex != m_tex && tex)
+        SDL_QueryTexture(tex, NULL, NULL, &m_tw, &m_th);
+    m_tex = tex;
+    m_sprites.clear();
+}
+
+void SpriteBatch::add(const SDL_Rect& src, float x, float y, float w, float h, SDL_Color c, int depth)
+{
+    Sprite s = { src, x, y, w, h, c, depth };
+    m_sprites.push_back(s);
+}
+
+void SpriteBatch::end()
+{
+    if (m_sprites.empty() || !m_tex)
+        return;
+
+    std::stable_sort(m_sprites.begin(), m_sprites.end(), [](const Sprite& a, const Sprite& b){
+        return a.depth < b.depth;
+    });
+
+    if (m_gl)
+        draw_gl();
+    else
+        draw_fallback();
+}
+
+void SpriteBatch::draw_gl()
+{
+    // SDL caches GL state (blend mode, shader, color, bound texture) and only sets
+    // what changed. So first let it draw the texture once, invisibly, which sets
+    // up everything exactly as for a regular copy and keeps its cache truthful.
+    Uint8 alpha;
+    SDL_GetTextureAlphaMod(m_tex, &alpha);
+    SDL_SetTextureAlphaMod(m_tex, 0);
+    SDL_Rect dot = { 0, 0, 1, 1 };
+    SDL_RenderCopy(m_renderer, m_tex, &m_sprites[0].src, &dot);
+    SDL_SetTextureAlphaMod(m_tex, alpha);
+
+    float texw, texh;
+    if (SDL_GL_BindTexture(m_tex, &texw, &texh) != 0) {
+        draw_fallback();
+        return;
+    }
+
+    // Texture coordinates may be normalized or in texels (rectangle textures),
+    // `texw`,`texh` is what the full texture spans either way.
+    const float su = texw / m_tw, sv = texh / m_th;
+
+    m_verts.resize(4 * m_sprites.size());
+    Vertex* v = m_verts.data();
+    for (const Sprite& s : m_sprites) {
+        float u0 = su * s.src.x, u1 = su * (s.src.x + s.src.w);
+        float v0 = sv * s.src.y, v1 = sv * (s.src.y + s.src.h);
+        Vertex q[4] = {
+            { s.x,       s.y,       u0, v0, s.c.r, s.c.g, s.c.b, s.c.a },
+            { s.x + s.w, s.y,       u1, v0, s.c.r, s.c.g, s.c.b, s.c.a },
+            { s.x + s.w, s.y + s.h, u1, v1, s.c.r, s.c.g, s.c.b, s.c.a },
+            { s.x,       s.y + s.h, u0, v1, s.c.r, s.c.g, s.c.b, s.c.a },
+        };
+        std::copy(q, q + 4, v);
+        v += 4;
+    }
+
+    g_gl.EnableClientState(GL_VERTEX_ARRAY);
+    g_gl.EnableClientState(GL_TEXTURE_COORD_ARRAY);
+    g_gl.EnableClientState(GL_COLOR_ARRAY);
+    g_gl.VertexPointer(2, GL_FLOAT, sizeof(Vertex), &m_verts[0].x);
+    g_gl.TexCoordPointer(2, GL_FLOAT, sizeof(Vertex), &m_verts[0].u);
+    g_gl.ColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), &m_verts[0].r);
+    g_gl.DrawArrays(GL_QUADS, 0, GLsizei(m_verts.size()));
+    g_gl.DisableClientState(GL_COLOR_ARRAY);
+    g_gl.DisableClientState(GL_TEXTURE_COORD_ARRAY);
+    g_gl.DisableClientState(GL_VERTEX_ARRAY);
+
+    // The color array leaves the current color undefined, restore what SDL thinks it is.
+    SDL_Color c;
+    SDL_GetTextureColorMod(m_tex, &c.r, &c.g, &c.b);
+    g_gl.Color4f(c.r / 255.0f, c.g / 255.0f, c.b / 255.0f, 0.0f);
+
+    SDL_GL_UnbindTexture(m_tex);
+}
+
+void SpriteBatch::draw_fallback()
+{
+    Uint8 r, g, b, a;
+    SDL_GetTextureColorMod(m_tex, &r, &g, &b);
+    SDL_GetTextureAlphaMod(m_tex, &a);
+
+    // Color-modulation is per texture here; `end` keeps the order within a depth,
+    // so all we can do is only change it between sprites of different colors.
+    SDL_Color last = { r, g, b, a };
+    for (const Sprite& s : m_sprites) {
+        if (std::memcmp(&s.c, &last, sizeof(SDL_Color)) != 0) {
+            SDL_SetTextureColorMod(m_tex, s.c.r, s.c.g, s.c.b);
+            SDL_SetTextureAlphaMod(m_tex, s.c.a);
+            last = s.c;
+        }
+        SDL_Rect dst = { int(std::floor(s.x + 0.5f)), int(std::floor(s.y + 0.5f)), int(s.w + 0.5f), int(s.h + 0.5f) };
+        SDL_RenderCopy(m_renderer, m_tex, &s.src, &dst);
+    }
+
+    SDL_SetTextureColorMod(m_tex, r, g, b);
+    SDL_SetTextureAlphaMod(m_tex, a);
+}
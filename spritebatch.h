@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL.h>
+
+// Draws many sprites from one texture (usually an `Atlas`) per frame with as few
+// driver submissions as the renderer allows.
+//
+// With SDL's OpenGL renderer, all quads of a batch go out in a single
+// `glDrawArrays` from client-side vertex arrays, with the texture bound by SDL.
+// Everything else falls back to one `SDL_RenderCopy` per sprite. Positions are
+// in (fractional) pixels; only the GL path can actually draw them in between pixels,
+// the fallback rounds them to the nearest one.
+// Sprites are drawn in order of their depth (lowest first), and in the order
+// they were added within the same depth.
+class SpriteBatch {
+public:
+    SpriteBatch();
+
+    // Checks which renderer we got and loads the GL functions if it's OpenGL.
+    void init(SDL_Renderer* renderer);
+    bool is_gl() const { return m_gl; }
+
+    // All sprites until `end` are drawn from `tex`.
+    void begin(SDL_Texture* tex);
+    // Draws the `src` part of the texture with its top-left corner at `x`,`y` pixels,
+    // `c` modulating the texture's color and alpha.
+    void add(const SDL_Rect& src, float x, float y, float w, float h, SDL_Color c, int depth = 0);
+    void end();
+
+private:
+    struct Vertex { float x, y, u, v; Uint8 r, g, b, a; };
+    struct Sprite { SDL_Rect src; float x, y, w, h; SDL_Color c; int depth; };
+
+    void draw_gl();
+    void draw_fallback();
+
+    SDL_Renderer* m_renderer;
+    SDL_Texture* m_tex;
+    int m_tw, m_th;
+    bool m_gl;
+
+    std::vector<Sprite> m_sprites;
+    std::vector<Vertex> m_verts;
+};
@@ -0,0 +1,93 @@
+#include "stage.h"
+
+#include <iostream>
+
+#include "counters.h"
+#include "session.h"
+#include "timing.h"
+
+Stage::Stage(const std::string& name, Uint32 streams, size_t max_queued)
+    : m_name(name)
+    , m_streams(streams)
+    , m_max_queued(max_queued)
+    , m_running(false)
+    , m_dropped(0)
+    , m_ms(0.01, 5000)
+{}
+
+void Stage::start()
+{
+    if (m_thread.joinable())
+        return;
+    m_ms.clear();
+    m_dropped = 0;
+    m_running = true;
+    m_thread = std::thread(&Stage::run, this);
+}
+
+void Stage::stop()
+{
+    if (!m_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+
+    std::cout << m_name << " [ms]: " << m_ms.summary() << ", dropped " << m_dropped << std::endl;
+    session_meta(m_name + "_frames", double(m_ms.count()));
+    session_meta(m_name + "_dropped", double(m_dropped));
+    session_meta(m_name + "_ms_p50", m_ms.percentile(50));
+    session_meta(m_name + "_ms_p99", m_ms.percentile(99));
+}
+
+void Stage::push(const FrameSet& frames)
+{
+    bool dropped = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        if (m_max_queued > 0 && m_queue.size() >= m_max_queued) {
+            m_queue.pop_front();
+            ++m_dropped;
+            dropped = true;
+        }
+        m_queue.push_back(frames);
+    }
+    m_wake.notify_one();
+
+    if (dropped) {
+        count(g_counters.stage_dropped);
+    } else {
+        g_counters.stage_queued.fetch_add(1, std::memory_order_relaxed);
+        if (m_max_queued == 0)
+            g_counters.recording_queued.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Stage::run()
+{
+    begin();
+    for (;;) {
+        FrameSet frames;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]{ return !m_queue.empty() || !m_running; });
+            if (m_queue.empty())
+                break;
+            frames = m_queue.front();
+            m_queue.pop_front();
+        }
+        g_counters.stage_queued.fetch_sub(1, std::memory_order_relaxed);
+        if (m_max_queued == 0)
+            g_counters.recording_queued.fetch_sub(1, std::memory_order_relaxed);
+
+        Uint64 t0 = host_us();
+        process(frames);
+        m_ms.add(0.001 * (host_us() - t0));
+    }
+    end();
+}
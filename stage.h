@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <SDL_stdinc.h>
+
+#include "frames.h"
+#include "histogram.h"
+
+// Which of a frame's streams a stage looks at.
+enum {
+    STREAM_COLOR = 1 << 0,
+    STREAM_DEPTH = 1 << 1,
+    STREAM_IR = 1 << 2,
+};
+
+// The copies of one frame's streams, null for the ones nobody asked for.
+struct FrameSet {
+    FramePtr color, depth, ir;
+};
+
+// A step of processing the camera's frames online, on its own worker thread.
+//
+// The capture thread hands it every frame without waiting: frames queue up
+// while the stage is busy, and if it falls behind by more than `max_queued`,
+// the oldest are dropped (and counted in `g_counters`). With `max_queued` 0 it
+// never drops any, for stages whose output is the recording: they queue up as
+// long as it takes, counted in `g_counters.recording_queued` for the HUD to warn
+// about. The worker processes them in order. Stopping lets it finish what's queued, then prints how long
+// processing took per frame and writes that and the drops into the meta as
+// `<name>_ms_p50` etc.
+//
+// Must be stopped before it's destroyed, `capture_stop` does that for the ones
+// added with `capture_add_stage`.
+class Stage {
+public:
+    Stage(const std::string& name, Uint32 streams, size_t max_queued = 4);
+    virtual ~Stage() {}
+
+    const std::string& name() const { return m_name; }
+    Uint32 streams() const { return m_streams; }
+
+    void start();
+    void stop();
+
+    // Capture thread: queues `frames` for processing.
+    void push(const FrameSet& frames);
+
+protected:
+    // All on the worker thread: before the first frame, per frame, and after the last.
+    virtual void begin() {}
+    virtual void process(const FrameSet& frames) = 0;
+    virtual void end() {}
+
+private:
+    Stage(const Stage&);
+    Stage& operator=(const Stage&);
+
+    void run();
+
+    std::string m_name;
+    Uint32 m_streams;
+    size_t m_max_queued;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<FrameSet> m_queue;
+    bool m_running;
+    Uint64 m_dropped;
+    std::thread m_thread;
+
+    // Only touched by the worker, or after joining it.
+    Histogram m_ms;
+};
@@ -0,0 +1,111 @@
+#include "stimuli.h"
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// As fine as GPUs place vertices.
+static const double SUBPIXELS = 256.0;
+
+void StimulusSet::init(const SDL_Rect& sprite, int w, int h, bool subpixel)
+{
+    m_sprite = SDL_Rect{ sprite.x - 1, sprite.y - 1, sprite.w + 2, sprite.h + 2 };
+    m_w = w;
+    m_h = h;
+    m_step = subpixel ? 1.0 / SUBPIXELS : 1.0;
+}
+
+void StimulusSet::setup(const Trajectory& traj, int ndistractors, unsigned seed)
+{
+    m_targets.clear();
+
+    Target mrpoint = { &traj, 0.0, false, false, { 255, 255, 255, 255 }, 1.0f };
+    m_targets.push_back(mrpoint);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> phase(0.0, traj.duration());
+    std::uniform_int_distribution<int> coin(0, 1);
+    std::uniform_int_distribution<int> tint(96, 192);
+    std::uniform_real_distribution<float> scale(0.5f, 1.0f);
+    for (int i = 0; i < ndistractors; ++i) {
+        Uint8 gray = Uint8(tint(rng));
+        Target d = { &traj, phase(rng), coin(rng) == 1, coin(rng) == 1, { gray, gray, gray, 255 }, scale(rng) };
+        m_targets.push_back(d);
+    }
+
+    Point start = { 0.01, 0.01 };
+    m_pos.assign(m_targets.size(), start);
+    m_visible = 1;
+}
+
+bool StimulusSet::update(double t)
+{
+    if (!m_targets[0].traj->at(t, m_pos[0]))
+        return false;
+    snap(0);
+
+    for (size_t i = 1; i < m_targets.size(); ++i) {
+        const Target& tg = m_targets[i];
+        double d = tg.traj->duration();
+        Point p;
+        tg.traj->at(std::fmod(t + tg.phase, d), p);
+        m_pos[i].x = tg.mirror_x ? 1.0 - p.x : p.x;
+        m_pos[i].y = tg.mirror_y ? 1.0 - p.y : p.y;
+        snap(i);
+    }
+    m_visible = m_targets.size();
+    return true;
+}
+
+void StimulusSet::hold(Point p)
+{
+    m_pos[0] = p;
+    snap(0);
+    m_visible = 1;
+}
+
+void StimulusSet::snap(size_t i)
+{
+    // Snapping the top-left corner, which is what's actually drawn, then back to the center.
+    // Half the size exactly as `render` computes it, or the float rounding differs.
+    float sw = m_sprite.w * m_targets[i].scale, sh = m_sprite.h * m_targets[i].scale;
+    double hw = sw*0.5, hh = sh*0.5;
+    double x = std::floor((m_pos[i].x*m_w - hw) / m_step + 0.5) * m_step;
+    double y = std::floor((m_pos[i].y*m_h - hh) / m_step + 0.5) * m_step;
+    m_pos[i].x = (x + hw) / m_w;
+    m_pos[i].y = (y + hh) / m_h;
+}
+
+void StimulusSet::render(SpriteBatch& batch, int depth) const
+{
+    // The sprite includes a transparent border, so that with linear filtering its
+    // edges are smoothed over like the inside instead of jumping whole pixels.
+    // Back to front, so Mr.Point is always on top of the distractors.
+    for (size_t i = m_visible; i-- > 0;) {
+        const Target& tg = m_targets[i];
+        float sw = m_sprite.w * tg.scale, sh = m_sprite.h * tg.scale;
+        batch.add(m_sprite, float(m_pos[i].x*m_w - sw*0.5), float(m_pos[i].y*m_h - sh*0.5), sw, sh, tg.color, depth);
+    }
+}
+
+std::string StimulusSet::log_header() const
+{
+    std::string header = "frame,t_us";
+    for (size_t i = 0; i < m_targets.size(); ++i)
+        header += ",x" + std::to_string(i) + ",y" + std::to_string(i);
+    return header;
+}
+
+void StimulusSet::log(SessionLog& log, unsigned frame, Uint64 t_us)
+{
+    if (!log.is_open())
+        return;
+
+    char buf[32];
+    m_row.clear();
+    for (const Point& p : m_pos) {
+        std::sprintf(buf, ",%.6f,%.6f", p.x, p.y);
+        m_row += buf;
+    }
+    log.row("%u,%llu%s", frame, (unsigned long long)t_us, m_row.c_str());
+}
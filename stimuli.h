@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include <SDL.h>
+
+#include "session.h"
+#include "spritebatch.h"
+#include "trajectory.h"
+
+// All targets on screen at once. Target 0 is always Mr.Point following the
+// choreography, any further ones are distractors for visual-search paradigms.
+// They all share one sprite and are drawn as part of the frame's `SpriteBatch`.
+//
+// Positions are snapped to what the renderer can actually draw: 1/256 of a pixel
+// with the batch's OpenGL path (needing a linearly filtered texture), whole pixels
+// otherwise. So the logged positions are exactly where the targets were drawn.
+class StimulusSet {
+public:
+    struct Target {
+        const Trajectory* traj;
+        double phase;        // Seconds ahead of Mr.Point along `traj`, wrapping around.
+        bool mirror_x, mirror_y;
+        SDL_Color color;     // Modulates the texture.
+        float scale;         // Relative to the texture's size.
+    };
+
+    StimulusSet() : m_w(0), m_h(0), m_step(1.0), m_visible(0) {}
+
+    // `sprite` is the part of the batch's texture that shows a target, with at least
+    // a pixel of transparent padding around it (as in an `Atlas`). `w`x`h` is the screen's
+    // size, and `subpixel` whether the batch draws in between pixels.
+    void init(const SDL_Rect& sprite, int w, int h, bool subpixel);
+
+    // How fine positions are, in pixels.
+    double step_px() const { return m_step; }
+
+    // Mr.Point on `traj`, plus `ndistractors` others on the same path at random
+    // phases, mirrored and tinted, all reproducible from `seed`.
+    void setup(const Trajectory& traj, int ndistractors, unsigned seed);
+
+    // Evaluates all targets at `t` seconds. Returns false once Mr.Point's choreography is over.
+    bool update(double t);
+    // Only Mr.Point, standing still at `p`, e.g. before the recording starts.
+    void hold(Point p);
+
+    // Draws all targets centered on their positions.
+    void render(SpriteBatch& batch, int depth = 0) const;
+
+    // Writes a row `frame,t_us,x0,y0,x1,y1,...` to `log`.
+    void log(SessionLog& log, unsigned frame, Uint64 t_us);
+    std::string log_header() const;
+
+private:
+    // Moves target `i`'s position onto the grid of drawable positions.
+    void snap(size_t i);
+
+    SDL_Rect m_sprite;  // Including a pixel of the padding around it, see `render`.
+    int m_w, m_h;
+    double m_step;
+
+    std::vector<Target> m_targets;
+    std::vector<Point> m_pos;
+    size_t m_visible;  // The first so many targets are on screen.
+    std::string m_row;  // Reused for formatting log rows.
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <SDL_timer.h>
+
+// Host time in microseconds from the high-resolution performance counter.
+// This is the one clock everything on the host side (presentation, frame arrival,
+// session logs) is measured in, `SDL_GetTicks` is only good to a millisecond.
+inline Uint64 host_us()
+{
+    static const Uint64 freq = SDL_GetPerformanceFrequency();
+    const Uint64 c = SDL_GetPerformanceCounter();
+    // Split to avoid overflowing when the counter runs at high frequency.
+    return (c / freq) * 1000000 + (c % freq) * 1000000 / freq;
+}
@@ -0,0 +1,341 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "simd.h"
+
+// The easing profiles, mapping time-fraction to arc-length-fraction.
+struct EaseTables {
+    float lut[2][Trajectory::EASE_LUT + 1];
+
+    EaseTables() {
+        for (int i = 0; i <= Trajectory::EASE_LUT; ++i) {
+            double s = double(i) / Trajectory::EASE_LUT;
+            lut[Trajectory::EASE_LINEAR][i] = float(s);
+            lut[Trajectory::EASE_MIN_JERK][i] = float(s*s*s*(10.0 + s*(-15.0 + 6.0*s)));
+        }
+    }
+};
+static const EaseTables g_ease;
+
+// Linear interpolation in a table of `n`+1 entries spanning [0,1].
+static inline double lut(const float* table, int n, double s)
+{
+    double f = s * n;
+    int i = int(f);
+    i = i < 0 ? 0 : (i > n - 1 ? n - 1 : i);
+    double a = f - i;
+    return table[i] + a*(table[i+1] - table[i]);
+}
+
+static inline double clamp01(double v)
+{
+    return v < 0.0 ? 0.0 : (v > 1.0 ? 1.0 : v);
+}
+
+static inline Point bezier(const Point& p0, const Point& c1, const Point& c2, const Point& p3, double u)
+{
+    double v = 1.0 - u;
+    double b0 = v*v*v, b1 = 3.0*v*v*u, b2 = 3.0*v*u*u, b3 = u*u*u;
+    Point p = {
+        b0*p0.x + b1*c1.x + b2*c2.x + b3*p3.x,
+        b0*p0.y + b1*c1.y + b2*c2.y + b3*p3.y,
+    };
+    return p;
+}
+
+bool parse_shape(const char* name, Shape& shape)
+{
+    if (std::strcmp(name, "linear") == 0) shape = SHAPE_LINEAR;
+    else if (std::strcmp(name, "minjerk") == 0) shape = SHAPE_MIN_JERK;
+    else if (std::strcmp(name, "catmullrom") == 0) shape = SHAPE_CATMULL_ROM;
+    else return false;
+    return true;
+}
+
+const char* shape_name(Shape shape)
+{
+    switch (shape) {
+    case SHAPE_LINEAR: return "linear";
+    case SHAPE_MIN_JERK: return "minjerk";
+    case SHAPE_CATMULL_ROM: return "catmullrom";
+    }
+    return "?";
+}
+
+void Trajectory::clear()
+{
+    m_segs.clear();
+    m_end.clear();
+}
+
+void Trajectory::add(double t0, double t1, Point p0, Point c1, Point c2, Point p3, Ease ease, bool arc_length)
+{
+    Segment s;
+    s.t0 = t0;
+    s.inv_dt = 1.0 / (t1 - t0);
+    s.p0 = p0; s.c1 = c1; s.c2 = c2; s.p3 = p3;
+    s.ease = g_ease.lut[ease];
+    s.arc_length = arc_length;
+
+    if (!arc_length) {
+        for (int k = 0; k <= ARC_LUT; ++k)
+            s.arc[k] = float(k) / ARC_LUT;
+        m_segs.push_back(s);
+        m_end.push_back(t1);
+        return;
+    }
+
+    // Cumulative arc-length at finely sampled u, then inverted into u at equidistant lengths.
+    const int FINE = 8 * ARC_LUT;
+    double len[FINE + 1];
+    len[0] = 0.0;
+    Point prev = p0;
+    for (int i = 1; i <= FINE; ++i) {
+        Point p = bezier(p0, c1, c2, p3, double(i) / FINE);
+        len[i] = len[i-1] + std::hypot(p.x - prev.x, p.y - prev.y);
+        prev = p;
+    }
+    for (int k = 0, i = 0; k <= ARC_LUT; ++k) {
+        double target = len[FINE] * k / ARC_LUT;
+        while (i < FINE - 1 && len[i+1] < target)
+            ++i;
+        double seg = len[i+1] - len[i];
+        double a = seg > 0.0 ? clamp01((target - len[i]) / seg) : 0.0;
+        s.arc[k] = float((i + a) / FINE);
+    }
+
+    m_segs.push_back(s);
+    m_end.push_back(t1);
+}
+
+void Trajectory::append(const Keyframe* k, size_t n, Shape shape)
+{
+    const double base = duration() - k[0].t;
+    for (size_t i = 0; i + 1 < n; ++i) {
+        Point p0 = { k[i].x, k[i].y };
+        Point p3 = { k[i+1].x, k[i+1].y };
+        Point c1, c2;
+        if (shape == SHAPE_CATMULL_ROM) {
+            // Catmull-Rom's tangents, the slope between the neighbours, over the
+            // keyframes' times, so the velocity is the same on both sides of each.
+            // The control points are a third of a segment's time along them. It
+            // starts and ends at rest, so tables continue each other smoothly.
+            double h = k[i+1].t - k[i].t;
+            Point m0 = { 0.0, 0.0 }, m1 = { 0.0, 0.0 };
+            if (i > 0) {
+                double span = k[i+1].t - k[i-1].t;
+                m0.x = (k[i+1].x - k[i-1].x) / span;
+                m0.y = (k[i+1].y - k[i-1].y) / span;
+            }
+            if (i + 2 < n) {
+                double span = k[i+2].t - k[i].t;
+                m1.x = (k[i+2].x - k[i].x) / span;
+                m1.y = (k[i+2].y - k[i].y) / span;
+            }
+            c1.x = p0.x + m0.x * h / 3.0; c1.y = p0.y + m0.y * h / 3.0;
+            c2.x = p3.x - m1.x * h / 3.0; c2.y = p3.y - m1.y * h / 3.0;
+            add(base + k[i].t, base + k[i+1].t, p0, c1, c2, p3, EASE_LINEAR, false);
+            continue;
+        }
+        c1.x = p0.x + (p3.x - p0.x) / 3.0; c1.y = p0.y + (p3.y - p0.y) / 3.0;
+        c2.x = p0.x + 2.0*(p3.x - p0.x) / 3.0; c2.y = p0.y + 2.0*(p3.y - p0.y) / 3.0;
+        add(base + k[i].t, base + k[i+1].t, p0, c1, c2, p3, shape == SHAPE_MIN_JERK ? EASE_MIN_JERK : EASE_LINEAR, true);
+    }
+}
+
+void Trajectory::append_bezier(Point p0, Point c1, Point c2, Point p3, double dt, Ease ease)
+{
+    double t0 = duration();
+    add(t0, t0 + dt, p0, c1, c2, p3, ease, true);
+}
+
+// Widens [lo,hi] to where the cubic Bezier with coordinates p0, c1, c2, p3 turns
+// around, which is where its derivative, a quadratic in u, is 0.
+static void widen_by_extrema(double p0, double c1, double c2, double p3, double& lo, double& hi)
+{
+    double d0 = c1 - p0, d1 = c2 - c1, d2 = p3 - c2;
+    double a = d0 - 2.0*d1 + d2, b = 2.0*(d1 - d0), c = d0;
+    double roots[2];
+    int n = 0;
+    if (std::fabs(a) < 1e-12) {
+        if (std::fabs(b) > 1e-12)
+            roots[n++] = -c / b;
+    } else {
+        double disc = b*b - 4.0*a*c;
+        if (disc >= 0.0) {
+            roots[n++] = (-b + std::sqrt(disc)) / (2.0*a);
+            roots[n++] = (-b - std::sqrt(disc)) / (2.0*a);
+        }
+    }
+    for (int i = 0; i < n; ++i) {
+        double u = roots[i];
+        if (!(0.0 < u && u < 1.0))
+            continue;
+        double v = 1.0 - u;
+        double p = v*v*v*p0 + 3.0*v*v*u*c1 + 3.0*v*u*u*c2 + u*u*u*p3;
+        lo = std::min(lo, p);
+        hi = std::max(hi, p);
+    }
+}
+
+void Trajectory::inset()
+{
+    if (m_segs.empty())
+        return;
+
+    // The keyframes' area, and what the curves span.
+    Point lo = m_segs[0].p0, hi = lo;
+    for (const Segment& s : m_segs) {
+        const Point ends[2] = { s.p0, s.p3 };
+        for (const Point& p : ends) {
+            lo.x = std::min(lo.x, p.x); lo.y = std::min(lo.y, p.y);
+            hi.x = std::max(hi.x, p.x); hi.y = std::max(hi.y, p.y);
+        }
+    }
+    Point hull_lo = lo, hull_hi = hi;
+    for (const Segment& s : m_segs) {
+        widen_by_extrema(s.p0.x, s.c1.x, s.c2.x, s.p3.x, hull_lo.x, hull_hi.x);
+        widen_by_extrema(s.p0.y, s.c1.y, s.c2.y, s.p3.y, hull_lo.y, hull_hi.y);
+    }
+    if (hull_lo.x >= lo.x && hull_lo.y >= lo.y && hull_hi.x <= hi.x && hull_hi.y <= hi.y)
+        return;
+
+    // The same linear map for all segments keeps them joined, velocities included.
+    double sx = hull_hi.x > hull_lo.x ? (hi.x - lo.x) / (hull_hi.x - hull_lo.x) : 1.0;
+    double sy = hull_hi.y > hull_lo.y ? (hi.y - lo.y) / (hull_hi.y - hull_lo.y) : 1.0;
+    auto map = [&](Point p) {
+        Point q = { lo.x + (p.x - hull_lo.x) * sx, lo.y + (p.y - hull_lo.y) * sy };
+        return q;
+    };
+    std::vector<Segment> segs;
+    segs.swap(m_segs);
+    std::vector<double> end;
+    end.swap(m_end);
+    for (size_t i = 0; i < segs.size(); ++i) {
+        const Segment& s = segs[i];
+        Ease ease = s.ease == g_ease.lut[EASE_MIN_JERK] ? EASE_MIN_JERK : EASE_LINEAR;
+        add(s.t0, end[i], map(s.p0), map(s.c1), map(s.c2), map(s.p3), ease, s.arc_length);
+    }
+}
+
+// Time -> eased arc-length fraction -> curve parameter u.
+inline double Trajectory::param(const Segment& s, double t) const
+{
+    double tau = clamp01((t - s.t0) * s.inv_dt);
+    return lut(s.arc, ARC_LUT, lut(s.ease, EASE_LUT, tau));
+}
+
+bool Trajectory::at(double t, Point& p) const
+{
+    if (!(0.0 <= t && t < duration()))
+        return false;
+
+    const Segment& s = m_segs[std::upper_bound(m_end.begin(), m_end.end(), t) - m_end.begin()];
+    p = bezier(s.p0, s.c1, s.c2, s.p3, param(s, t));
+    return true;
+}
+
+// Positions at `n` times within one segment, with control points `c`: the same
+// as `Trajectory::at`, to the bit.
+static void eval_run_scalar(const double* t, size_t n, double t0, double inv_dt, const float* ease,
+                            const float* arc, const Point* c, double* x, double* y)
+{
+    for (size_t i = 0; i < n; ++i) {
+        double tau = clamp01((t[i] - t0) * inv_dt);
+        Point p = bezier(c[0], c[1], c[2], c[3], lut(arc, Trajectory::ARC_LUT, lut(ease, Trajectory::EASE_LUT, tau)));
+        x[i] = p.x;
+        y[i] = p.y;
+    }
+}
+
+#ifdef HAVE_AVX2
+// `lut` for 4 at once, with the tables' differences taken in float like there.
+TARGET_AVX2 static inline __m256d lut_avx2(const float* table, int n, __m256d s)
+{
+    __m256d f = _mm256_mul_pd(s, _mm256_set1_pd(n));
+    __m128i i = _mm256_cvttpd_epi32(f);
+    i = _mm_min_epi32(_mm_max_epi32(i, _mm_setzero_si128()), _mm_set1_epi32(n - 1));
+    __m256d a = _mm256_sub_pd(f, _mm256_cvtepi32_pd(i));
+    __m128 lo = _mm_i32gather_ps(table, i, 4), hi = _mm_i32gather_ps(table + 1, i, 4);
+    return _mm256_add_pd(_mm256_cvtps_pd(lo), _mm256_mul_pd(a, _mm256_cvtps_pd(_mm_sub_ps(hi, lo))));
+}
+
+TARGET_AVX2 static void eval_run_avx2(const double* t, size_t n, double t0, double inv_dt, const float* ease,
+                                      const float* arc, const Point* c, double* x, double* y)
+{
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0), three = _mm256_set1_pd(3.0);
+    const __m256d vt0 = _mm256_set1_pd(t0), vinv = _mm256_set1_pd(inv_dt);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d tau = _mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(t + i), vt0), vinv);
+        tau = _mm256_min_pd(_mm256_max_pd(tau, zero), one);
+        __m256d u = lut_avx2(arc, Trajectory::ARC_LUT, lut_avx2(ease, Trajectory::EASE_LUT, tau));
+
+        // Term by term in the same order as `bezier`.
+        __m256d v = _mm256_sub_pd(one, u);
+        __m256d b0 = _mm256_mul_pd(_mm256_mul_pd(v, v), v);
+        __m256d b1 = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(three, v), v), u);
+        __m256d b2 = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(three, v), u), u);
+        __m256d b3 = _mm256_mul_pd(_mm256_mul_pd(u, u), u);
+        __m256d px = _mm256_mul_pd(b0, _mm256_set1_pd(c[0].x));
+        px = _mm256_add_pd(px, _mm256_mul_pd(b1, _mm256_set1_pd(c[1].x)));
+        px = _mm256_add_pd(px, _mm256_mul_pd(b2, _mm256_set1_pd(c[2].x)));
+        px = _mm256_add_pd(px, _mm256_mul_pd(b3, _mm256_set1_pd(c[3].x)));
+        __m256d py = _mm256_mul_pd(b0, _mm256_set1_pd(c[0].y));
+        py = _mm256_add_pd(py, _mm256_mul_pd(b1, _mm256_set1_pd(c[1].y)));
+        py = _mm256_add_pd(py, _mm256_mul_pd(b2, _mm256_set1_pd(c[2].y)));
+        py = _mm256_add_pd(py, _mm256_mul_pd(b3, _mm256_set1_pd(c[3].y)));
+        _mm256_storeu_pd(x + i, px);
+        _mm256_storeu_pd(y + i, py);
+    }
+    eval_run_scalar(t + i, n - i, t0, inv_dt, ease, arc, c, x + i, y + i);
+}
+#else
+static void eval_run_avx2(const double* t, size_t n, double t0, double inv_dt, const float* ease,
+                          const float* arc, const Point* c, double* x, double* y)
+{
+    eval_run_scalar(t, n, t0, inv_dt, ease, arc, c, x, y);
+}
+#endif
+
+void Trajectory::at_batch(const double* t, size_t n, double* x, double* y) const
+{
+    if (m_segs.empty())
+        return;
+
+    // Since `t` is sorted, it's runs of times within the same segment, each of
+    // which is evaluated without any searching, 4 at a time with AVX2.
+    static const bool avx2 = cpu_has_avx2();
+    size_t seg = 0;
+    for (size_t i = 0; i < n;) {
+        while (seg + 1 < m_segs.size() && t[i] >= m_end[seg])
+            ++seg;
+        size_t j = i + 1;
+        if (seg + 1 < m_segs.size()) {
+            while (j < n && t[j] < m_end[seg])
+                ++j;
+        } else {
+            j = n;
+        }
+        const Segment& s = m_segs[seg];
+        const Point c[4] = { s.p0, s.c1, s.c2, s.p3 };
+        if (avx2)
+            eval_run_avx2(t + i, j - i, s.t0, s.inv_dt, s.ease, s.arc, c, x + i, y + i);
+        else
+            eval_run_scalar(t + i, j - i, s.t0, s.inv_dt, s.ease, s.arc, c, x + i, y + i);
+        i = j;
+    }
+}
+
+Trajectory standard_trajectory(Shape shape)
+{
+    Trajectory traj;
+    traj.append(BORDER_SWEEP, shape);
+    traj.append(HORIZONTAL_ZIGZAG, shape);
+    traj.append(VERTICAL_ZIGZAG, shape);
+    traj.inset();
+    return traj;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "choreography.h"
+
+// Smooth versions of the keyframe tables in `choreography.h`.
+//
+// Straight `lerp` segments change velocity instantly at every corner, which no
+// eye can follow, so it catches up with a saccade instead and the labels around
+// there are junk. Here every segment is a cubic Bezier curve with a timing
+// ("easing") along it:
+//  - SHAPE_LINEAR:      straight lines at constant speed, what we always had.
+//  - SHAPE_MIN_JERK:    straight lines, but with the minimum-jerk profile
+//                       10s^3 - 15s^4 + 6s^5, so it starts and stops smoothly.
+//  - SHAPE_CATMULL_ROM: a Catmull-Rom spline through the keyframes at their
+//                       times, so Mr.Point sweeps around them in curves and
+//                       only comes to rest at the ends of a table. Curving
+//                       around a keyframe on the border would take it off the
+//                       screen, so the whole spline is pulled in toward the
+//                       middle just far enough to stay inside the keyframes'
+//                       area (see `inset`).
+// All the expensive parts (arc-length parametrization, easing polynomial) are
+// precomputed into small lookup tables when building the trajectory, so a
+// per-frame lookup is a search and two table lookups more than the plain
+// `lerp`: a few tens of nanoseconds instead of about ten, see
+// `--bench trajectory`. Paths of other shapes can be put together from Bezier
+// curves with `append_bezier`.
+enum Shape {
+    SHAPE_LINEAR,
+    SHAPE_MIN_JERK,
+    SHAPE_CATMULL_ROM,
+};
+
+// Parses "linear", "minjerk" or "catmullrom". Returns false on anything else.
+bool parse_shape(const char* name, Shape& shape);
+const char* shape_name(Shape shape);
+
+class Trajectory {
+public:
+    // Resolution of the per-segment arc-length and the easing lookup tables.
+    static const int ARC_LUT = 64;
+    static const int EASE_LUT = 256;
+
+    enum Ease { EASE_LINEAR, EASE_MIN_JERK };
+
+    void clear();
+
+    // Appends a keyframe table, shifted in time to start where the trajectory
+    // currently ends. The table's first keyframe should be where that is.
+    template<size_t N>
+    void append(const Keyframe (&k)[N], Shape shape) { append(k, N, shape); }
+    void append(const Keyframe* k, size_t n, Shape shape);
+
+    // Appends a cubic Bezier curve from `p0` to `p3` with control points `c1` and
+    // `c2`, taking `dt` seconds, eased along its length. Like a table's first
+    // keyframe, `p0` should be where the trajectory currently ends.
+    void append_bezier(Point p0, Point c1, Point c2, Point p3, double dt, Ease ease);
+
+    // Scales the trajectory toward the middle of its keyframes' area, per axis,
+    // just so far that all of its curves lie in it, their extremes on its border.
+    // Does nothing when they already do, as for straight lines.
+    void inset();
+
+    double duration() const { return m_end.empty() ? 0.0 : m_end.back(); }
+
+    // Position at `t` seconds into the trajectory. Returns false once it's over.
+    bool at(double t, Point& p) const;
+
+    // Positions at many sorted times at once, e.g. for writing the ground truth
+    // at a high rate for offline use, 4 at a time with AVX2. The same as `at`,
+    // to the bit, except that outside the trajectory it's clamped to its ends.
+    void at_batch(const double* t, size_t n, double* x, double* y) const;
+
+private:
+    struct Segment {
+        double t0, inv_dt;
+        Point p0, c1, c2, p3;
+        const float* ease;
+        bool arc_length;
+        // Curve parameter u at equidistant fractions of the arc-length.
+        float arc[ARC_LUT + 1];
+    };
+
+    // With `arc_length`, the easing is along the curve's length, otherwise along
+    // its parameter.
+    void add(double t0, double t1, Point p0, Point c1, Point c2, Point p3, Ease ease, bool arc_length);
+    double param(const Segment& s, double t) const;
+
+    std::vector<Segment> m_segs;
+    std::vector<double> m_end;  // End time of each segment, for searching.
+};
+
+// The standard choreography of `choreography.h` in the given shape.
+Trajectory standard_trajectory(Shape shape);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+// Shows `text` in a message box, and prints it too since headless nobody sees the box.
+void show_error(const char* title, const std::string& text);
+
+// Makes our error-checking life a little easier. The RealSense one is in
+// `capture.h`, so that only what talks to the camera needs its SDK.
+bool sdl_verify(int ret, std::string msg);
+bool ttf_verify(int ret, std::string msg);